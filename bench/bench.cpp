@@ -0,0 +1,606 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Microbenchmarks of the hot paths of BufHashTbl, BufMgr, Page and File.
+ *
+ * Each benchmark sets up its fixture once, then runs its operation in rounds
+ * of growing iteration counts until a round takes at least the minimum time,
+ * and reports the time per operation of that round.  Buffer pool benchmarks
+ * also report the hit ratio from BufMgr::getBufStats().
+ *
+ * Usage: bench [--min-time=SECONDS] [FILTER...]
+ * Only benchmarks whose name contains one of the filters are run.
+ *
+ * Built from every source but main.cpp, from the top directory:
+ *   g++ -std=c++11 -O2 -pthread -I. $(ls *.cpp exceptions/[a-z]*.cpp |
+ *       grep -v main.cpp) bench/bench.cpp -o bench
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bufHashTbl.h"
+#include "buffer.h"
+#include "file.h"
+#include "file_iterator.h"
+#include "page.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * @brief Generates page numbers in [0, n) following an access distribution.
+ */
+class KeyGenerator {
+ public:
+  enum Distribution {
+    UNIFORM,
+    ZIPFIAN,
+    SEQUENTIAL
+  };
+
+  static const char* name(const Distribution distribution) {
+    switch (distribution) {
+      case UNIFORM:
+        return "uniform";
+      case ZIPFIAN:
+        return "zipfian";
+      default:
+        return "sequential";
+    }
+  }
+
+  /**
+   * @param distribution  Distribution of the keys.
+   * @param n             Number of distinct keys.
+   * @param seed          Seed of the random keys.
+   */
+  KeyGenerator(const Distribution distribution, const std::uint32_t n,
+               const std::uint64_t seed = 42)
+      : distribution_(distribution), n_(n), state_(seed), next_(0) {
+    if (distribution_ == ZIPFIAN) {
+      // Gray et al., "Quickly generating billion-record synthetic databases",
+      // as used by YCSB, with the usual skew.
+      theta_ = 0.99;
+      double zeta_n = 0;
+      for (std::uint32_t i = 1; i <= n_; ++i) {
+        zeta_n += 1 / std::pow(static_cast<double>(i), theta_);
+      }
+      zeta_n_ = zeta_n;
+      const double zeta_2 = 1 + 1 / std::pow(2.0, theta_);
+      alpha_ = 1 / (1 - theta_);
+      eta_ = (1 - std::pow(2.0 / n_, 1 - theta_)) / (1 - zeta_2 / zeta_n_);
+    }
+  }
+
+  std::uint32_t next() {
+    switch (distribution_) {
+      case UNIFORM:
+        return static_cast<std::uint32_t>(random() % n_);
+      case ZIPFIAN: {
+        const double u = (random() >> 11) * (1.0 / 9007199254740992.0);
+        const double uz = u * zeta_n_;
+        if (uz < 1) {
+          return 0;
+        }
+        if (uz < 1 + std::pow(0.5, theta_)) {
+          return 1 % n_;
+        }
+        const std::uint32_t key = static_cast<std::uint32_t>(
+            n_ * std::pow(eta_ * u - eta_ + 1, alpha_));
+        // Scatter the popular keys so that they are not all adjacent.
+        return static_cast<std::uint32_t>(
+            (static_cast<std::uint64_t>(std::min(key, n_ - 1)) * 2654435761u) %
+            n_);
+      }
+      default: {
+        const std::uint32_t key = next_;
+        next_ = next_ + 1 == n_ ? 0 : next_ + 1;
+        return key;
+      }
+    }
+  }
+
+ private:
+  /**
+   * splitmix64, which is cheap enough not to distort the measurements.
+   */
+  std::uint64_t random() {
+    std::uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+  }
+
+  Distribution distribution_;
+  std::uint32_t n_;
+  std::uint64_t state_;
+  std::uint32_t next_;
+  double theta_;
+  double zeta_n_;
+  double alpha_;
+  double eta_;
+};
+
+/**
+ * @brief A benchmarked operation and its fixture.
+ */
+class Benchmark {
+ public:
+  explicit Benchmark(const std::string& name) : name_(name) {}
+  virtual ~Benchmark() {}
+
+  const std::string& name() const { return name_; }
+
+  /**
+   * Builds the fixture; not timed.
+   */
+  virtual void setUp() {}
+
+  /**
+   * Runs the operation <iterations> times.
+   */
+  virtual void run(const std::uint64_t iterations) = 0;
+
+  /**
+   * Returns extra results of the last round to report, if any.
+   */
+  virtual std::string counters() { return ""; }
+
+  /**
+   * Releases the fixture; not timed.
+   */
+  virtual void tearDown() {}
+
+ private:
+  std::string name_;
+};
+
+/**
+ * Record that files created for benchmarks hold on each page.
+ */
+const std::string RECORD = "benchmark record";
+
+/**
+ * Creates an empty file for a benchmark, removing any left over.
+ */
+File createFile(const std::string& filename) {
+  try {
+    File::remove(filename);
+  } catch (const FileNotFoundException&) {
+  }
+  return File::create(filename);
+}
+
+/**
+ * Creates a file of <pages> pages holding one record each.
+ */
+File createFile(const std::string& filename, const std::uint32_t pages) {
+  File file = createFile(filename);
+  std::vector<Page> batch(64);
+  std::vector<Page*> pointers;
+  for (std::uint32_t done = 0; done < pages; done += pointers.size()) {
+    pointers.clear();
+    for (std::uint32_t i = 0; i < batch.size() && done + i < pages; ++i) {
+      pointers.push_back(&batch[i]);
+    }
+    file.allocatePages(pointers);
+  }
+  for (FileIterator it = file.begin(); it != file.end(); ++it) {
+    Page page = *it;
+    page.insertRecord(RECORD);
+    file.writePage(page);
+  }
+  return file;
+}
+
+/**
+ * Returns the hit ratio since the statistics were last cleared.
+ */
+std::string hitRatio(const BufMgr& buffers) {
+  const BufStats stats = buffers.getBufStats();
+  char text[32];
+  std::snprintf(text, sizeof(text), "hit=%.1f%%",
+                stats.accesses == 0 ? 0.0
+                                    : 100.0 * stats.hits / stats.accesses);
+  return text;
+}
+
+/**
+ * Pages numbers used as BufHashTbl keys come from a few files.
+ */
+const std::uint32_t HASH_FILES = 4;
+
+class HashLookup : public Benchmark {
+ public:
+  explicit HashLookup(const std::uint32_t entries,
+                      const std::string& name = "HashLookup")
+      : Benchmark(name + "/" + std::to_string(entries)),
+        entries_(entries),
+        keys_(KeyGenerator::UNIFORM, entries) {}
+
+  virtual void setUp() {
+    for (std::uint32_t f = 0; f < HASH_FILES; ++f) {
+      files_.push_back(std::unique_ptr<File>(
+          new File(createFile("bench_hash" + std::to_string(f) + ".db"))));
+    }
+    table_.reset(new BufHashTbl(entries_));
+    for (std::uint32_t i = 0; i < entries_; ++i) {
+      table_->insert(file(i), i / HASH_FILES, i);
+    }
+  }
+
+  virtual void run(const std::uint64_t iterations) {
+    FrameId frame;
+    std::uint64_t found = 0;
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      const std::uint32_t key = keys_.next();
+      found += table_->tryLookup(file(key), key / HASH_FILES, frame);
+    }
+    if (found != iterations) {
+      std::abort();
+    }
+  }
+
+  virtual void tearDown() {
+    table_.reset();
+    for (std::uint32_t f = 0; f < files_.size(); ++f) {
+      const std::string filename = files_[f]->filename();
+      files_[f].reset();
+      File::remove(filename);
+    }
+    files_.clear();
+  }
+
+ protected:
+  const File* file(const std::uint32_t key) const {
+    return files_[key % HASH_FILES].get();
+  }
+
+  std::uint32_t entries_;
+  KeyGenerator keys_;
+  std::vector<std::unique_ptr<File> > files_;
+  std::unique_ptr<BufHashTbl> table_;
+};
+
+/**
+ * Inserts a key and removes it again, with the table holding <entries> other
+ * keys.
+ */
+class HashInsertRemove : public HashLookup {
+ public:
+  explicit HashInsertRemove(const std::uint32_t entries)
+      : HashLookup(entries, "HashInsertRemove") {}
+
+  virtual void run(const std::uint64_t iterations) {
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      const std::uint32_t key = keys_.next();
+      // Past the page numbers of the resident keys, so never present.
+      const PageId pageNo = entries_ + key;
+      table_->insert(file(key), pageNo, key);
+      table_->remove(file(key), pageNo);
+    }
+  }
+};
+
+/**
+ * Pins and unpins pages of a file through a pool of <frames> frames, chosen
+ * from <pages> pages following a distribution.  With as many frames as pages
+ * every access is a hit; with fewer, misses evict.
+ */
+class ReadPage : public Benchmark {
+ public:
+  ReadPage(const std::string& name, const std::uint32_t frames,
+           const std::uint32_t pages,
+           const KeyGenerator::Distribution distribution)
+      : Benchmark(name + "/" + std::to_string(frames) + "/" +
+                  std::to_string(pages) + "/" +
+                  KeyGenerator::name(distribution)),
+        frames_(frames),
+        pages_(pages),
+        keys_(distribution, pages) {}
+
+  virtual void setUp() {
+    file_.reset(new File(createFile("bench_read.db", pages_)));
+    std::vector<PageId> pageNos;
+    for (FileIterator it = file_->begin(); it != file_->end(); ++it) {
+      pageNos.push_back((*it).page_number());
+    }
+    // Drawn up front, as drawing Zipfian keys costs as much as a hit.
+    sequence_.resize(SEQUENCE_LENGTH);
+    for (std::size_t i = 0; i < SEQUENCE_LENGTH; ++i) {
+      sequence_[i] = pageNos[keys_.next()];
+    }
+    next_ = 0;
+    buffers_.reset(new BufMgr(frames_));
+    // Warm the pool up, so that the rounds measure the steady state.
+    run(std::min<std::uint64_t>(4 * pages_, 1000000));
+    buffers_->clearBufStats();
+  }
+
+  virtual void run(const std::uint64_t iterations) {
+    Page* page;
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      const PageId pageNo = sequence_[next_++ & (SEQUENCE_LENGTH - 1)];
+      buffers_->readPage(file_.get(), pageNo, page);
+      buffers_->unPinPage(file_.get(), pageNo, false);
+    }
+  }
+
+  virtual std::string counters() {
+    const std::string ratio = hitRatio(*buffers_);
+    buffers_->clearBufStats();
+    return ratio;
+  }
+
+  virtual void tearDown() {
+    buffers_.reset();
+    file_.reset();
+    File::remove("bench_read.db");
+    sequence_.clear();
+  }
+
+ private:
+  std::uint32_t frames_;
+  /**
+   * Number of accesses drawn before they repeat; a power of two.
+   */
+  static const std::size_t SEQUENCE_LENGTH = 1 << 20;
+
+  std::uint32_t pages_;
+  KeyGenerator keys_;
+  std::vector<PageId> sequence_;
+  std::size_t next_;
+  std::unique_ptr<File> file_;
+  std::unique_ptr<BufMgr> buffers_;
+};
+
+/**
+ * Allocates pages at the end of a growing file, through a pool of <frames>
+ * frames that they are evicted from dirty.
+ */
+class AllocPage : public Benchmark {
+ public:
+  explicit AllocPage(const std::uint32_t frames)
+      : Benchmark("AllocPage/" + std::to_string(frames)), frames_(frames) {}
+
+  virtual void setUp() {
+    file_.reset(new File(createFile("bench_alloc.db")));
+    buffers_.reset(new BufMgr(frames_));
+  }
+
+  virtual void run(const std::uint64_t iterations) {
+    PageId pageNo;
+    Page* page;
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      buffers_->allocPage(file_.get(), pageNo, page);
+      buffers_->unPinPage(file_.get(), pageNo, true);
+    }
+  }
+
+  virtual void tearDown() {
+    buffers_.reset();
+    file_.reset();
+    File::remove("bench_alloc.db");
+  }
+
+ private:
+  std::uint32_t frames_;
+  std::unique_ptr<File> file_;
+  std::unique_ptr<BufMgr> buffers_;
+};
+
+/**
+ * Inserts a record of <length> bytes into a page holding others and deletes
+ * it again.
+ */
+class PageInsertDelete : public Benchmark {
+ public:
+  explicit PageInsertDelete(const std::size_t length)
+      : Benchmark("PageInsertDelete/" + std::to_string(length)),
+        record_(length, 'r') {}
+
+  virtual void setUp() {
+    while (page_.hasSpaceForRecord(record_) &&
+           page_.getFreeSpace() > Page::SIZE / 2) {
+      page_.insertRecord(record_);
+    }
+  }
+
+  virtual void run(const std::uint64_t iterations) {
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      page_.deleteRecord(page_.insertRecord(record_));
+    }
+  }
+
+ private:
+  std::string record_;
+  Page page_;
+};
+
+/**
+ * Looks records up by record id, in random order, in a full page.
+ */
+class PageGetRecord : public Benchmark {
+ public:
+  explicit PageGetRecord(const std::size_t length)
+      : Benchmark("PageGetRecord/" + std::to_string(length)),
+        record_(length, 'r'),
+        keys_(KeyGenerator::UNIFORM, 1) {}
+
+  virtual void setUp() {
+    while (page_.hasSpaceForRecord(record_)) {
+      ids_.push_back(page_.insertRecord(record_));
+    }
+    keys_ = KeyGenerator(KeyGenerator::UNIFORM,
+                         static_cast<std::uint32_t>(ids_.size()));
+  }
+
+  virtual void run(const std::uint64_t iterations) {
+    std::size_t bytes = 0;
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      bytes += page_.getRecordView(ids_[keys_.next()]).size();
+    }
+    if (bytes != iterations * record_.size()) {
+      std::abort();
+    }
+  }
+
+  virtual void tearDown() { ids_.clear(); }
+
+ private:
+  std::string record_;
+  KeyGenerator keys_;
+  std::vector<RecordId> ids_;
+  Page page_;
+};
+
+/**
+ * Scans a file of <pages> pages with a FileIterator, one operation per page.
+ */
+class FileScan : public Benchmark {
+ public:
+  explicit FileScan(const std::uint32_t pages)
+      : Benchmark("FileScan/" + std::to_string(pages)), pages_(pages) {}
+
+  virtual void setUp() {
+    file_.reset(new File(createFile("bench_scan.db", pages_)));
+    it_ = file_->begin();
+  }
+
+  virtual void run(const std::uint64_t iterations) {
+    std::uint64_t bytes = 0;
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      if (!(it_ != file_->end())) {
+        it_ = file_->begin();
+      }
+      const Page page = *it_;
+      bytes += page.getRecordView(RecordId{page.page_number(), 1}).size();
+      ++it_;
+    }
+    if (bytes != iterations * RECORD.size()) {
+      std::abort();
+    }
+  }
+
+  virtual void tearDown() {
+    it_ = FileIterator();
+    file_.reset();
+    File::remove("bench_scan.db");
+  }
+
+ private:
+  std::uint32_t pages_;
+  std::unique_ptr<File> file_;
+  FileIterator it_;
+};
+
+/**
+ * Runs a benchmark and prints its line of results.
+ */
+void runBenchmark(Benchmark& benchmark, const double min_time) {
+  benchmark.setUp();
+  std::uint64_t iterations = 1;
+  double elapsed = 0;
+  for (;;) {
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    benchmark.run(iterations);
+    elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            start).count();
+    if (elapsed >= min_time || iterations >= (1ull << 40)) {
+      break;
+    }
+    // Aim a little past the minimum time, growing at most tenfold a round.
+    const double scale = elapsed > 0 ? 1.4 * min_time / elapsed : 10;
+    iterations = static_cast<std::uint64_t>(
+        iterations * std::min(std::max(scale, 2.0), 10.0));
+  }
+  const std::string counters = benchmark.counters();
+  std::printf("%-44s %12llu %12.1f ns/op %10.2f Mops/s  %s\n",
+              benchmark.name().c_str(),
+              static_cast<unsigned long long>(iterations),
+              elapsed * 1e9 / iterations, iterations / elapsed / 1e6,
+              counters.c_str());
+  std::fflush(stdout);
+  benchmark.tearDown();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  double min_time = 0.5;
+  std::vector<std::string> filters;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--min-time=", 11) == 0) {
+      min_time = std::atof(argv[i] + 11);
+    } else {
+      filters.push_back(argv[i]);
+    }
+  }
+
+  std::vector<std::unique_ptr<Benchmark> > benchmarks;
+  const std::uint32_t table_sizes[] = {1024, 65536, 1048576};
+  for (std::uint32_t entries : table_sizes) {
+    benchmarks.push_back(std::unique_ptr<Benchmark>(new HashLookup(entries)));
+  }
+  for (std::uint32_t entries : table_sizes) {
+    benchmarks.push_back(
+        std::unique_ptr<Benchmark>(new HashInsertRemove(entries)));
+  }
+  const KeyGenerator::Distribution distributions[] = {
+      KeyGenerator::UNIFORM, KeyGenerator::ZIPFIAN, KeyGenerator::SEQUENTIAL};
+  const std::uint32_t pool_sizes[] = {64, 1024, 16384};
+  for (std::uint32_t frames : pool_sizes) {
+    for (KeyGenerator::Distribution distribution : distributions) {
+      benchmarks.push_back(std::unique_ptr<Benchmark>(
+          new ReadPage("ReadPageHit", frames, frames, distribution)));
+    }
+  }
+  for (std::uint32_t frames : pool_sizes) {
+    for (KeyGenerator::Distribution distribution : distributions) {
+      benchmarks.push_back(std::unique_ptr<Benchmark>(
+          new ReadPage("ReadPageMiss", frames, 4 * frames, distribution)));
+    }
+  }
+  for (std::uint32_t frames : pool_sizes) {
+    benchmarks.push_back(std::unique_ptr<Benchmark>(new AllocPage(frames)));
+  }
+  const std::size_t record_lengths[] = {16, 256};
+  for (std::size_t length : record_lengths) {
+    benchmarks.push_back(
+        std::unique_ptr<Benchmark>(new PageInsertDelete(length)));
+  }
+  for (std::size_t length : record_lengths) {
+    benchmarks.push_back(std::unique_ptr<Benchmark>(new PageGetRecord(length)));
+  }
+  const std::uint32_t scan_sizes[] = {1024, 16384};
+  for (std::uint32_t pages : scan_sizes) {
+    benchmarks.push_back(std::unique_ptr<Benchmark>(new FileScan(pages)));
+  }
+
+  for (std::size_t i = 0; i < benchmarks.size(); ++i) {
+    bool selected = filters.empty();
+    for (std::size_t f = 0; f < filters.size() && !selected; ++f) {
+      selected = benchmarks[i]->name().find(filters[f]) != std::string::npos;
+    }
+    if (selected) {
+      runBenchmark(*benchmarks[i], min_time);
+    }
+  }
+  return 0;
+}
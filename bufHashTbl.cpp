@@ -7,6 +7,9 @@
 
 #include <memory>
 #include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
 #include "buffer.h"
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
@@ -15,100 +18,173 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+std::uint64_t BufHashTbl::hash(const File* file, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  // Combine the two halves of the key and run them through the murmur3 finalizer so that consecutive page
+  // numbers of the same file spread over all partitions and buckets.
+  std::uint64_t h = (std::uint64_t)(std::uintptr_t)file * 0x9e3779b97f4a7c15ULL;
+  h ^= pageNo;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
 }
 
-BufHashTbl::BufHashTbl(int htSize)
-	: HTSIZE(htSize)
+std::uint32_t BufHashTbl::probeDistance(const Partition& part, const std::uint32_t pos)
 {
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  const hashBucket& bucket = part.buckets[pos];
+  const std::uint32_t home = (std::uint32_t)hash(bucket.file, bucket.pageNo) & part.mask;
+  return (pos - home) & part.mask;
+}
+
+hashBucket* BufHashTbl::allocBuckets(const std::uint32_t count)
+{
+  void* mem = NULL;
+  if (posix_memalign(&mem, 64, count * sizeof(hashBucket)) != 0)
+    throw HashTableException();
+  memset(mem, 0, count * sizeof(hashBucket));
+  return static_cast<hashBucket*>(mem);
+}
+
+BufHashTbl::BufHashTbl(const std::uint32_t numEntries)
+{
+  // Aim for a load factor of at most one half when pages are spread evenly over the partitions.
+  std::uint32_t size = 8;
+  while (size < (2 * numEntries) / NUM_PARTITIONS)
+    size <<= 1;
+
+  for (int i = 0; i < NUM_PARTITIONS; i++) {
+    partitions[i].buckets = allocBuckets(size);
+    partitions[i].mask = size - 1;
+    partitions[i].count = 0;
+  }
 }
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
+  for (int i = 0; i < NUM_PARTITIONS; i++)
+    free(partitions[i].buckets);
+}
+
+void BufHashTbl::place(Partition& part, hashBucket entry)
+{
+  std::uint32_t pos = (std::uint32_t)hash(entry.file, entry.pageNo) & part.mask;
+  std::uint32_t dist = 0;
+  while (part.buckets[pos].file) {
+    // Robin Hood: whoever is closer to their home bucket gives up the spot.
+    const std::uint32_t other = probeDistance(part, pos);
+    if (other < dist) {
+      std::swap(entry, part.buckets[pos]);
+      dist = other;
     }
+    pos = (pos + 1) & part.mask;
+    dist++;
   }
-  delete [] ht;
+  part.buckets[pos] = entry;
+  part.count++;
 }
 
-void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+void BufHashTbl::grow(Partition& part)
 {
-  int index = hash(file, pageNo);
+  hashBucket* old = part.buckets;
+  const std::uint32_t oldSize = part.mask + 1;
+
+  part.buckets = allocBuckets(2 * oldSize);
+  part.mask = 2 * oldSize - 1;
+  part.count = 0;
+  for (std::uint32_t i = 0; i < oldSize; i++) {
+    if (old[i].file)
+      place(part, old[i]);
+  }
+  free(old);
+}
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
-    tmpBuc = tmpBuc->next;
+bool BufHashTbl::findBucket(const Partition& part, const std::uint64_t h, const File* file, const PageId pageNo,
+                            std::uint32_t& pos)
+{
+  // Robin Hood ordering lets us stop at the first bucket that is closer to its home than we would be.
+  pos = (std::uint32_t)h & part.mask;
+  for (std::uint32_t dist = 0; part.buckets[pos].file && probeDistance(part, pos) >= dist; dist++) {
+    const hashBucket& bucket = part.buckets[pos];
+    if (bucket.file == file && bucket.pageNo == pageNo)
+      return true;
+    pos = (pos + 1) & part.mask;
   }
+  return false;
+}
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-  	throw HashTableException();
+void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  FrameId existing;
+  while (!tryInsert(file, pageNo, frameNo)) {
+    // Report the entry that is in the way; it could have been removed again in the meantime, so retry then.
+    if (tryLookup(file, pageNo, existing))
+  		throw HashAlreadyPresentException(file->filename(), pageNo, existing);
+  }
+}
 
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
+bool BufHashTbl::tryInsert(const File* file, const PageId pageNo, const FrameId frameNo)
+{
+  const std::uint64_t h = hash(file, pageNo);
+  Partition& part = partitionFor(h);
+  std::lock_guard<std::mutex> guard(part.latch);
+
+  std::uint32_t pos;
+  if (findBucket(part, h, file, pageNo, pos))
+    return false;
+
+  // Keep the load factor at or below 7/8 so probe sequences stay short.
+  if (8 * (part.count + 1) > 7 * (part.mask + 1))
+    grow(part);
+
+  hashBucket entry;
+  entry.file = (File*) file;
+  entry.pageNo = pageNo;
+  entry.frameNo = frameNo;
+  place(part, entry);
+  return true;
 }
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
 {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-    {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
-      return;
-    }
-    tmpBuc = tmpBuc->next;
-  }
+  if (!tryLookup(file, pageNo, frameNo))
+    throw HashNotFoundException(file->filename(), pageNo);
+}
 
-  throw HashNotFoundException(file->filename(), pageNo);
+bool BufHashTbl::tryLookup(const File* file, const PageId pageNo, FrameId &frameNo) 
+{
+  const std::uint64_t h = hash(file, pageNo);
+  Partition& part = partitionFor(h);
+  std::lock_guard<std::mutex> guard(part.latch);
+
+  std::uint32_t pos;
+  if (!findBucket(part, h, file, pageNo, pos))
+    return false;
+  frameNo = part.buckets[pos].frameNo; // return frameNo by reference
+  return true;
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = NULL;
-
-  while (tmpBuc)
-	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-		{
-      if(prevBuc) 
-				prevBuc->next = tmpBuc->next;
-      else
-				ht[index] = tmpBuc->next;
-
-      delete tmpBuc;
-      return;
-    }
-		else
-		{
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
-    }
-  }
+  const std::uint64_t h = hash(file, pageNo);
+  Partition& part = partitionFor(h);
+  std::lock_guard<std::mutex> guard(part.latch);
+
+  std::uint32_t pos;
+  if (!findBucket(part, h, file, pageNo, pos))
+    throw HashNotFoundException(file->filename(), pageNo);
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  // Backward-shift the rest of the cluster so no tombstone is left behind.
+  std::uint32_t next = (pos + 1) & part.mask;
+  while (part.buckets[next].file && probeDistance(part, next) > 0) {
+    part.buckets[pos] = part.buckets[next];
+    pos = next;
+    next = (next + 1) & part.mask;
+  }
+  part.buckets[pos].file = NULL;
+  part.count--;
 }
 
 }
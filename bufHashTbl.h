@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <mutex>
+
 #include "file.h"
 
 namespace badgerdb {
@@ -16,7 +19,7 @@ namespace badgerdb {
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * pointer a file object (more on this below).  NULL if the bucket is empty.
 	 */
 	File *file;
 
@@ -29,45 +32,119 @@ struct hashBucket {
 	 * frame number of page in the buffer pool
 	 */
 	FrameId frameNo;
-
-	/**
-	 * Next node in the hash table
-	 */
-	hashBucket*   next;
 };
 
 
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
-* @warning This class is not threadsafe.
+* The table is split into NUM_PARTITIONS partitions, each guarded by its own latch, so operations on
+* different partitions proceed in parallel.  All public methods are threadsafe.
+*
+* Every partition is a flat array of buckets using open addressing with Robin Hood linear probing and
+* backward-shift deletion, so neither insert nor remove allocate memory and a lookup usually touches a single
+* cache line.  Partitions are sized from the number of frames in the buffer pool and only grow if the hash
+* distributes pages very unevenly.
 */
 class BufHashTbl
 {
  private:
 	/**
-	 *	Size of Hash Table
+	 * log2 of the number of independently latched partitions
 	 */
-  int HTSIZE;
+  static const int PARTITION_BITS = 4;
+
+	/**
+	 * Number of independently latched partitions
+	 */
+  static const int NUM_PARTITIONS = 1 << PARTITION_BITS;
+
+	/**
+	 * @brief One independently latched, open-addressed slice of the table
+	 */
+  struct Partition {
+		/**
+		 * Latch guarding the buckets of this partition
+		 */
+    std::mutex latch;
+
+		/**
+		 * Bucket array; its size is always a power of two
+		 */
+    hashBucket* buckets;
+
+		/**
+		 * Number of buckets minus one, used to wrap probe positions
+		 */
+    std::uint32_t mask;
+
+		/**
+		 * Number of buckets in use
+		 */
+    std::uint32_t count;
+  };
+
 	/**
-	 * Actual Hash table object
+	 * The partitions of the table
 	 */
-  hashBucket**  ht;
+  Partition partitions[NUM_PARTITIONS];
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * returns a well mixed 64-bit hash of file and pageNo.  The top PARTITION_BITS bits select the partition and
+	 * the low bits the home bucket within it.
 	 *
 	 * @param file   	File object
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  static std::uint64_t hash(const File* file, const PageId pageNo);
+
+	/**
+	 * returns the partition holding the given hash value
+	 */
+  Partition& partitionFor(const std::uint64_t h) { return partitions[h >> (64 - PARTITION_BITS)]; }
+
+	/**
+	 * returns how far the given (non-empty) bucket of a partition is from its home bucket
+	 */
+  static std::uint32_t probeDistance(const Partition& part, const std::uint32_t pos);
+
+	/**
+	 * Searches a partition for (file, pageNo).  The caller must hold the partition latch.
+	 *
+	 * @param part  	Partition selected by h
+	 * @param h     	hash() of file and pageNo
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param pos   	Bucket position of the entry returned via this variable if found
+	 * @return  			True if the entry is present.
+	 */
+  static bool findBucket(const Partition& part, const std::uint64_t h, const File* file, const PageId pageNo,
+                         std::uint32_t& pos);
+
+	/**
+	 * Places an entry into a partition known not to contain its key.  The caller must hold the partition latch
+	 * and ensure there is a free bucket.
+	 */
+  static void place(Partition& part, hashBucket entry);
+
+	/**
+	 * Doubles the number of buckets of a partition.  The caller must hold the partition latch.
+	 */
+  static void grow(Partition& part);
+
+	/**
+	 * Allocates an array of empty buckets aligned to a cache line
+	 */
+  static hashBucket* allocBuckets(const std::uint32_t count);
 
  public:
 	/**
    * Constructor of BufHashTbl class
+	 *
+	 * @param numEntries  Number of entries the table is expected to hold, i.e. the number of frames in the pool
 	 */
-	BufHashTbl(const int htSize);  // constructor
+	BufHashTbl(const std::uint32_t numEntries);  // constructor
 
 	/**
    * Destructor of BufHashTbl class
@@ -85,6 +162,19 @@ class BufHashTbl
 	 */
   void insert(const File* file, const PageId pageNo, const FrameId frameNo);
 
+	/**
+   * Insert entry into hash table mapping (file, pageNo) to frameNo unless the page is already present.
+	 * Unlike insert() an existing entry is not an error, which makes this the call to use on paths where another
+	 * thread may legitimately have inserted the page first.
+	 *
+	 * @param file   	File object
+	 * @param pageNo 	Page number in the file
+	 * @param frameNo Frame number assigned to that page of the file
+	 * @return  			True if the entry was inserted, false if the page was already present.
+   * @throws  HashTableException (optional) if could not create a new bucket as running of memory
+	 */
+  bool tryInsert(const File* file, const PageId pageNo, const FrameId frameNo);
+
 	/**
    * Check if (file, pageNo) is currently in the buffer pool (ie. in
    * the hash table).
@@ -96,6 +186,17 @@ class BufHashTbl
 	 */
   void lookup(const File* file, const PageId pageNo, FrameId &frameNo);
 
+	/**
+   * Check if (file, pageNo) is currently in the buffer pool (ie. in the hash table) without raising an
+	 * exception when it is not.  This is the lookup used on the buffer manager's hit/miss path.
+	 *
+	 * @param file  	File object
+	 * @param pageNo	Page number in the file
+	 * @param frameNo Frame number reference, only assigned if the page is found
+	 * @return  			True if the page is in the hash table.
+	 */
+  bool tryLookup(const File* file, const PageId pageNo, FrameId &frameNo);
+
 	/**
    * Delete entry (file,pageNo) from hash table.
 	 *
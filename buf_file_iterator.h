@@ -0,0 +1,266 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <vector>
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Iterator for scanning the pages of a file through the buffer pool.
+ *
+ * Unlike FileIterator, which reads pages straight from disk, this iterator
+ * pins each page in a BufMgr frame for as long as the iterator points at it
+ * and follows the used-page list through the pinned frames.  When it sees
+ * the scan moving through consecutive page numbers it asks the buffer manager
+ * to prefetch the next <window> pages, so that by the time the scan reaches
+ * them their reads have already completed.
+ *
+ * The window should be well below the size of the buffer pool, otherwise
+ * prefetched pages may be evicted again before the scan gets to them.
+ *
+ * Iterators own a pin, so they can be moved but not copied.
+ */
+class BufFileIterator {
+ public:
+  /**
+   * Default number of pages prefetched ahead of a sequential scan.
+   */
+  static const std::uint32_t DEFAULT_WINDOW = 16;
+
+  /**
+   * Constructs an iterator over the pages in a file, starting at the given
+   * page number.  Page::INVALID_NUMBER gives the iterator past the last page.
+   *
+   * @param buf_mgr     Buffer manager to read pages through.
+   * @param file        File to iterate over.
+   * @param page_number Number of page to start iterator at.
+   * @param window      Number of pages to prefetch ahead of a sequential scan;
+   *                    0 disables prefetching.
+   */
+  BufFileIterator(BufMgr* buf_mgr, File* file, const PageId page_number,
+                  const std::uint32_t window = DEFAULT_WINDOW)
+      : buf_mgr_(buf_mgr),
+        file_(file),
+        current_page_number_(Page::INVALID_NUMBER),
+        page_(NULL),
+        window_(window),
+        sequential_(false),
+        prefetched_through_(Page::INVALID_NUMBER),
+        dirty_(false) {
+    assert(buf_mgr_ != NULL && file_ != NULL);
+    moveTo(page_number);
+  }
+
+  /**
+   * Returns an iterator at the first page in a file.
+   *
+   * @param buf_mgr Buffer manager to read pages through.
+   * @param file    File to iterate over.
+   * @param window  Number of pages to prefetch ahead of a sequential scan;
+   *                0 disables prefetching.
+   * @return  Iterator at first page of file.
+   */
+  static BufFileIterator begin(BufMgr* buf_mgr, File* file,
+                               const std::uint32_t window = DEFAULT_WINDOW) {
+    assert(file != NULL);
+    return BufFileIterator(buf_mgr, file, file->readHeader().first_used_page,
+                           window);
+  }
+
+  /**
+   * Returns an iterator representing the page after the last page in a file.
+   * This iterator should not be dereferenced.
+   *
+   * @param buf_mgr Buffer manager to read pages through.
+   * @param file    File to iterate over.
+   * @return  Iterator representing page after the last page in the file.
+   */
+  static BufFileIterator end(BufMgr* buf_mgr, File* file) {
+    return BufFileIterator(buf_mgr, file, Page::INVALID_NUMBER);
+  }
+
+  /**
+   * Moves the position (and the pin) of another iterator into this one.
+   *
+   * @param other   Iterator to move from; it is left past the last page.
+   */
+  BufFileIterator(BufFileIterator&& other)
+      : buf_mgr_(other.buf_mgr_),
+        file_(other.file_),
+        current_page_number_(other.current_page_number_),
+        page_(other.page_),
+        window_(other.window_),
+        sequential_(other.sequential_),
+        prefetched_through_(other.prefetched_through_),
+        dirty_(other.dirty_) {
+    other.current_page_number_ = Page::INVALID_NUMBER;
+    other.page_ = NULL;
+    other.dirty_ = false;
+  }
+
+  /**
+   * Unpins the current page.
+   */
+  ~BufFileIterator() {
+    release();
+  }
+
+  /**
+   * Advances the iterator to the next page in the file.
+   */
+	inline BufFileIterator& operator++() {
+    assert(page_ != NULL);
+    moveTo(page_->next_page_number());
+
+		return *this;
+	}
+
+  /**
+   * Returns true if this iterator is equal to the given iterator.
+   *
+   * @param rhs   Iterator to compare against.
+   * @return    True if other iterator is equal to this one.
+   */
+	inline bool operator==(const BufFileIterator& rhs) const {
+    return file_->filename() == rhs.file_->filename() &&
+        current_page_number_ == rhs.current_page_number_;
+  }
+
+	inline bool operator!=(const BufFileIterator& rhs) const {
+    return !(*this == rhs);
+  }
+
+  /**
+   * Dereferences the iterator, returning the pinned frame holding the current
+   * page.  Changes made through it are written back when the frame is
+   * evicted or flushed, provided markDirty() is called.
+   *
+   * @return  Page in the buffer pool.
+   */
+	inline Page& operator*() const {
+    assert(page_ != NULL);
+    return *page_;
+  }
+
+	inline Page* operator->() const {
+    assert(page_ != NULL);
+    return page_;
+  }
+
+  /**
+   * Marks the current page dirty so it is unpinned as such when the iterator
+   * moves on.
+   */
+  void markDirty() { dirty_ = true; }
+
+ private:
+  BufFileIterator(const BufFileIterator&);
+  BufFileIterator& operator=(const BufFileIterator&);
+
+  /**
+   * Unpins the current page, if any.
+   */
+  void release() {
+    if (page_ != NULL) {
+      buf_mgr_->unPinPage(file_, current_page_number_, dirty_);
+      page_ = NULL;
+    }
+    dirty_ = false;
+  }
+
+  /**
+   * Unpins the current page and pins the given one, prefetching ahead of it
+   * if the scan is sequential.
+   *
+   * @param page_number   Number of page to move to.
+   */
+  void moveTo(const PageId page_number) {
+    const PageId previous = current_page_number_;
+    release();
+    current_page_number_ = page_number;
+    if (page_number == Page::INVALID_NUMBER) {
+      return;
+    }
+
+    sequential_ = previous != Page::INVALID_NUMBER &&
+        page_number == previous + 1;
+    if (sequential_ && window_ > 0) {
+      prefetchAhead();
+    }
+    buf_mgr_->readPage(file_, page_number, page_);
+  }
+
+  /**
+   * Keeps the next <window_> pages after the current page in flight.  Pages
+   * are requested in batches of half a window so the buffer manager sees a
+   * few large requests instead of one per page.
+   */
+  void prefetchAhead() {
+    if (prefetched_through_ < current_page_number_) {
+      prefetched_through_ = current_page_number_;
+    }
+    const PageId target = current_page_number_ + window_;
+    if (target - prefetched_through_ < (window_ + 1) / 2) {
+      return;
+    }
+    std::vector<PageId> batch;
+    for (PageId next = prefetched_through_ + 1; next <= target; ++next) {
+      batch.push_back(next);
+    }
+    buf_mgr_->prefetchPages(file_, batch);
+    prefetched_through_ = target;
+  }
+
+  /**
+   * Buffer manager pages are read through.
+   */
+  BufMgr* buf_mgr_;
+
+  /**
+   * File we're iterating over.
+   */
+  File* file_;
+
+  /**
+   * Number of page in file iterator is currently pointing to.
+   */
+  PageId current_page_number_;
+
+  /**
+   * Pinned frame holding the current page, or NULL past the last page.
+   */
+  Page* page_;
+
+  /**
+   * Number of pages to prefetch ahead of a sequential scan.
+   */
+  std::uint32_t window_;
+
+  /**
+   * Whether the last step moved to the next consecutive page number.
+   */
+  bool sequential_;
+
+  /**
+   * Highest page number prefetching has been requested for.
+   */
+  PageId prefetched_through_;
+
+  /**
+   * Whether the current page is to be unpinned as dirty.
+   */
+  bool dirty_;
+};
+
+}
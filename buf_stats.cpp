@@ -0,0 +1,327 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "buf_stats.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "file.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Number of bits of a value below its leading one that select its bucket
+ * within its power of two.
+ */
+const unsigned SUB_BUCKET_BITS = 3;
+
+/**
+ * Latch guarding used_thread_indices.
+ */
+std::mutex thread_indices_latch;
+
+/**
+ * Which shard indices are taken by live threads.
+ */
+bool used_thread_indices[StatsRecorder::NUM_SHARDS];
+
+/**
+ * Marks a thread that has no shard index yet.
+ */
+const std::size_t NO_THREAD_INDEX = ~static_cast<std::size_t>(0);
+
+/**
+ * The calling thread's shard index, once it has one.  Kept apart from
+ * ThreadIndex so that reading it needs no initialization check.
+ */
+thread_local std::size_t thread_index = NO_THREAD_INDEX;
+
+/**
+ * @brief Shard index of a thread, held for the thread's lifetime and then
+ *        handed on to later threads.
+ *
+ * Passing the index on through the latch orders the exiting thread's updates
+ * before those of the next owner.
+ */
+struct ThreadIndex {
+  std::size_t index;
+
+  ThreadIndex() : index(StatsRecorder::NUM_SHARDS) {
+    std::lock_guard<std::mutex> guard(thread_indices_latch);
+    for (std::size_t i = 0; i < StatsRecorder::NUM_SHARDS; ++i) {
+      if (!used_thread_indices[i]) {
+        used_thread_indices[i] = true;
+        index = i;
+        break;
+      }
+    }
+  }
+
+  ~ThreadIndex() {
+    if (index < StatsRecorder::NUM_SHARDS) {
+      std::lock_guard<std::mutex> guard(thread_indices_latch);
+      used_thread_indices[index] = false;
+    }
+  }
+};
+
+}
+
+const std::size_t Histogram::SUB_BUCKETS;
+const std::size_t Histogram::NUM_BUCKETS;
+const std::size_t StatsRecorder::NUM_SHARDS;
+const std::uint32_t StatsRecorder::SAMPLE_PERIOD;
+
+static_assert(Histogram::SUB_BUCKETS == 1u << SUB_BUCKET_BITS,
+              "Sub-buckets are selected by the bits below the leading one.");
+
+std::size_t Histogram::bucketOf(const std::uint64_t value) {
+  if (value < SUB_BUCKETS) {
+    return static_cast<std::size_t>(value);
+  }
+  const unsigned exponent = 63 - __builtin_clzll(value);
+  const std::size_t sub_bucket =
+      (value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return (exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub_bucket;
+}
+
+std::uint64_t Histogram::bucketLowest(const std::size_t bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  const unsigned exponent =
+      static_cast<unsigned>(bucket / SUB_BUCKETS) + SUB_BUCKET_BITS - 1;
+  return static_cast<std::uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS)
+      << (exponent - SUB_BUCKET_BITS);
+}
+
+std::uint64_t Histogram::bucketHighest(const std::size_t bucket) {
+  return bucket + 1 == NUM_BUCKETS ? ~static_cast<std::uint64_t>(0)
+                                   : bucketLowest(bucket + 1) - 1;
+}
+
+void Histogram::record(const std::uint64_t value, const std::uint64_t count) {
+  buckets_[bucketOf(value)] += count;
+  count_ += count;
+  sum_ += value * count;
+  max_ = std::max(max_, value);
+}
+
+void Histogram::merge(const Histogram& other) {
+  for (std::size_t i = 0; i < NUM_BUCKETS; ++i) {
+    buckets_[i] += other.buckets_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  max_ = std::max(max_, other.max_);
+}
+
+void Histogram::clear() {
+  std::memset(buckets_, 0, sizeof(buckets_));
+  count_ = sum_ = max_ = 0;
+}
+
+std::uint64_t Histogram::percentile(const double quantile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  // Rank of the value sought, counting from 1.
+  const double clamped = std::min(std::max(quantile, 0.0), 1.0);
+  const std::uint64_t rank =
+      std::max<std::uint64_t>(1, static_cast<std::uint64_t>(clamped * count_ +
+                                                            0.5));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < NUM_BUCKETS; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      return std::min(bucketHighest(i), max_);
+    }
+  }
+  return max_;
+}
+
+StatsRecorder::Shard::Shard(const bool is_shared)
+    : last_file(NULL), last_entry(NULL), sample_clock(0), shared(is_shared) {
+  for (std::size_t c = 0; c < NUM_COUNTERS; ++c) {
+    counters[c] = 0;
+  }
+  for (std::size_t d = 0; d < NUM_DISTRIBUTIONS; ++d) {
+    for (std::size_t b = 0; b < Histogram::NUM_BUCKETS; ++b) {
+      buckets[d][b] = 0;
+    }
+    counts[d] = sums[d] = maxima[d] = 0;
+  }
+}
+
+StatsRecorder::StatsRecorder() {
+  for (std::size_t i = 0; i <= NUM_SHARDS; ++i) {
+    shards_[i] = NULL;
+  }
+}
+
+StatsRecorder::~StatsRecorder() {
+  for (std::size_t i = 0; i <= NUM_SHARDS; ++i) {
+    delete shards_[i].load();
+  }
+}
+
+std::size_t StatsRecorder::threadIndex() {
+  if (thread_index == NO_THREAD_INDEX) {
+    static thread_local ThreadIndex held;
+    thread_index = held.index;
+  }
+  return thread_index;
+}
+
+StatsRecorder::Shard& StatsRecorder::addShard() {
+  const std::size_t index = threadIndex();
+  std::atomic<Shard*>& slot = shards_[index];
+  Shard* shard = new Shard(index == NUM_SHARDS);
+  Shard* expected = NULL;
+  if (!slot.compare_exchange_strong(expected, shard)) {
+    // Another thread sharing the overflow shard got there first.
+    delete shard;
+    return *expected;
+  }
+  return *shard;
+}
+
+void StatsRecorder::record(Shard& current, const Distribution distribution,
+                           const std::uint64_t value,
+                           const std::uint64_t weight) {
+  add(current, current.buckets[distribution][Histogram::bucketOf(value)],
+      weight);
+  add(current, current.counts[distribution], weight);
+  add(current, current.sums[distribution], value * weight);
+  std::atomic<std::uint64_t>& maximum = current.maxima[distribution];
+  std::uint64_t seen = maximum.load(std::memory_order_relaxed);
+  while (value > seen &&
+         !maximum.compare_exchange_weak(seen, value,
+                                        std::memory_order_relaxed)) {
+  }
+}
+
+std::atomic<std::uint64_t>* StatsRecorder::findFileCounters(
+    Shard& shard, const File* file) {
+  if (shard.shared) {
+    // Entries never move, so the counters may be used after unlatching.
+    std::lock_guard<std::mutex> guard(shard.files_latch);
+    return fileEntry(shard, file).counters;
+  }
+  std::map<const File*, Shard::FileEntry>::iterator entry =
+      shard.files.find(file);
+  if (entry != shard.files.end()) {
+    shard.last_entry = &entry->second;
+  } else {
+    std::lock_guard<std::mutex> guard(shard.files_latch);
+    shard.last_entry = &fileEntry(shard, file);
+  }
+  shard.last_file = file;
+  return shard.last_entry->counters;
+}
+
+StatsRecorder::Shard::FileEntry& StatsRecorder::fileEntry(
+    Shard& shard, const File* file) {
+  std::map<const File*, Shard::FileEntry>::iterator entry =
+      shard.files.find(file);
+  if (entry != shard.files.end()) {
+    return entry->second;
+  }
+  Shard::FileEntry& added = shard.files[file];
+  added.name = file->filename();
+  for (std::size_t c = 0; c < NUM_FILE_COUNTERS; ++c) {
+    added.counters[c] = 0;
+  }
+  return added;
+}
+
+BufStats StatsRecorder::snapshot() const {
+  std::uint64_t counters[NUM_COUNTERS] = {0};
+  Histogram histograms[NUM_DISTRIBUTIONS];
+  BufStats stats;
+  for (std::size_t s = 0; s <= NUM_SHARDS; ++s) {
+    Shard* shard = shards_[s].load(std::memory_order_acquire);
+    if (shard == NULL) {
+      continue;
+    }
+    for (std::size_t c = 0; c < NUM_COUNTERS; ++c) {
+      counters[c] += shard->counters[c].load(std::memory_order_relaxed);
+    }
+    for (std::size_t d = 0; d < NUM_DISTRIBUTIONS; ++d) {
+      Histogram& histogram = histograms[d];
+      for (std::size_t b = 0; b < Histogram::NUM_BUCKETS; ++b) {
+        histogram.buckets_[b] +=
+            shard->buckets[d][b].load(std::memory_order_relaxed);
+      }
+      histogram.count_ += shard->counts[d].load(std::memory_order_relaxed);
+      histogram.sum_ += shard->sums[d].load(std::memory_order_relaxed);
+      histogram.max_ = std::max(
+          histogram.max_, shard->maxima[d].load(std::memory_order_relaxed));
+    }
+    std::lock_guard<std::mutex> guard(shard->files_latch);
+    for (std::map<const File*, Shard::FileEntry>::const_iterator entry =
+             shard->files.begin();
+         entry != shard->files.end(); ++entry) {
+      const std::atomic<std::uint64_t>* counts = entry->second.counters;
+      FileStats& file = stats.files[entry->second.name];
+      file.hits += counts[FILE_HITS].load(std::memory_order_relaxed);
+      file.misses += counts[FILE_MISSES].load(std::memory_order_relaxed);
+      file.writes += counts[FILE_WRITES].load(std::memory_order_relaxed);
+      file.evictions += counts[FILE_EVICTIONS].load(std::memory_order_relaxed);
+    }
+  }
+
+  stats.accesses = counters[HITS] + counters[MISSES];
+  stats.hits = counters[HITS];
+  stats.misses = counters[MISSES];
+  stats.diskreads = counters[DISK_READS];
+  stats.allocations = counters[ALLOCATIONS];
+  stats.diskwrites = counters[DISK_WRITES];
+  stats.cleanEvictions = counters[CLEAN_EVICTIONS];
+  stats.dirtyEvictions = counters[DIRTY_EVICTIONS];
+  stats.sweepSteps = counters[SWEEP_STEPS];
+  stats.pinWaits = counters[PIN_WAITS];
+  stats.readPageLatency = histograms[READ_PAGE_LATENCY];
+  stats.fileReadLatency = histograms[FILE_READ_LATENCY];
+  stats.fileWriteLatency = histograms[FILE_WRITE_LATENCY];
+  stats.sweepLength = histograms[SWEEP_LENGTH];
+  return stats;
+}
+
+void StatsRecorder::clear() {
+  for (std::size_t s = 0; s <= NUM_SHARDS; ++s) {
+    Shard* shard = shards_[s].load(std::memory_order_acquire);
+    if (shard == NULL) {
+      continue;
+    }
+    for (std::size_t c = 0; c < NUM_COUNTERS; ++c) {
+      shard->counters[c].store(0, std::memory_order_relaxed);
+    }
+    for (std::size_t d = 0; d < NUM_DISTRIBUTIONS; ++d) {
+      for (std::size_t b = 0; b < Histogram::NUM_BUCKETS; ++b) {
+        shard->buckets[d][b].store(0, std::memory_order_relaxed);
+      }
+      shard->counts[d].store(0, std::memory_order_relaxed);
+      shard->sums[d].store(0, std::memory_order_relaxed);
+      shard->maxima[d].store(0, std::memory_order_relaxed);
+    }
+    // Entries stay, as owners may be using them without the latch.
+    std::lock_guard<std::mutex> guard(shard->files_latch);
+    for (std::map<const File*, Shard::FileEntry>::iterator entry =
+             shard->files.begin();
+         entry != shard->files.end(); ++entry) {
+      for (std::size_t c = 0; c < NUM_FILE_COUNTERS; ++c) {
+        entry->second.counters[c].store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+}
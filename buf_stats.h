@@ -0,0 +1,541 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Distribution of recorded values, such as latencies in nanoseconds.
+ *
+ * Values are counted in log-linear buckets in the manner of HDR histograms:
+ * each power of two is split into SUB_BUCKETS equal buckets, so any value is
+ * known to within 1/SUB_BUCKETS of itself, over the whole 64-bit range, in a
+ * fixed amount of memory.
+ */
+class Histogram {
+ public:
+  /**
+   * Number of buckets each power of two is split into.
+   */
+  static const std::size_t SUB_BUCKETS = 8;
+
+  /**
+   * Number of buckets.
+   */
+  static const std::size_t NUM_BUCKETS = 62 * SUB_BUCKETS;
+
+  Histogram() { clear(); }
+
+  /**
+   * Adds a value, <count> times.
+   */
+  void record(const std::uint64_t value, const std::uint64_t count = 1);
+
+  /**
+   * Adds all the values of another histogram.
+   */
+  void merge(const Histogram& other);
+
+  /**
+   * Removes all values.
+   */
+  void clear();
+
+  /**
+   * Returns the number of values recorded.
+   */
+  std::uint64_t count() const { return count_; }
+
+  /**
+   * Returns the largest value recorded, or 0 if there is none.
+   */
+  std::uint64_t max() const { return max_; }
+
+  /**
+   * Returns the mean of the values recorded, or 0 if there is none.
+   */
+  double mean() const {
+    return count_ == 0 ? 0 : static_cast<double>(sum_) / count_;
+  }
+
+  /**
+   * Returns an upper bound for the given quantile, e.g. 0.99 for the 99th
+   * percentile, accurate to the bucket width.
+   *
+   * @param quantile  Fraction of values, between 0 and 1, at or below the
+   *                  value returned.
+   */
+  std::uint64_t percentile(const double quantile) const;
+
+  /**
+   * Returns the number of values in a bucket.
+   */
+  std::uint64_t bucketCount(const std::size_t bucket) const {
+    return buckets_[bucket];
+  }
+
+  /**
+   * Returns the bucket a value is counted in.
+   */
+  static std::size_t bucketOf(const std::uint64_t value);
+
+  /**
+   * Returns the smallest value counted in a bucket.
+   */
+  static std::uint64_t bucketLowest(const std::size_t bucket);
+
+  /**
+   * Returns the largest value counted in a bucket.
+   */
+  static std::uint64_t bucketHighest(const std::size_t bucket);
+
+ private:
+  std::uint64_t buckets_[NUM_BUCKETS];
+  std::uint64_t count_;
+  std::uint64_t sum_;
+  std::uint64_t max_;
+
+  friend class StatsRecorder;
+};
+
+/**
+ * @brief Buffer pool statistics of one file.
+ */
+struct FileStats {
+  /**
+   * Number of page requests served from the pool.
+   */
+  std::uint64_t hits;
+
+  /**
+   * Number of page requests that had to read the page from disk.
+   */
+  std::uint64_t misses;
+
+  /**
+   * Number of pages written back to disk.
+   */
+  std::uint64_t writes;
+
+  /**
+   * Number of pages evicted from the pool.
+   */
+  std::uint64_t evictions;
+
+  FileStats() : hits(0), misses(0), writes(0), evictions(0) {}
+};
+
+/**
+ * @brief Statistics of buffer usage, as returned by BufMgr::getBufStats().
+ */
+struct BufStats {
+  /**
+   * Total number of accesses to buffer pool.
+   */
+  std::uint64_t accesses;
+
+  /**
+   * Number of accesses served without reading from disk.
+   */
+  std::uint64_t hits;
+
+  /**
+   * Number of accesses that had to read the page from disk.
+   */
+  std::uint64_t misses;
+
+  /**
+   * Number of pages read from disk.
+   */
+  std::uint64_t diskreads;
+
+  /**
+   * Number of pages allocated in files through the pool.  These are not
+   * counted as disk reads.
+   */
+  std::uint64_t allocations;
+
+  /**
+   * Number of pages written back to disk.
+   */
+  std::uint64_t diskwrites;
+
+  /**
+   * Number of clean pages evicted.
+   */
+  std::uint64_t cleanEvictions;
+
+  /**
+   * Number of dirty pages evicted, each of which had to be written first.
+   */
+  std::uint64_t dirtyEvictions;
+
+  /**
+   * Number of frames the replacement policy examined to find victims; see
+   * sweepLength for the distribution per eviction.
+   */
+  std::uint64_t sweepSteps;
+
+  /**
+   * Number of times a thread pinning a resident page had to wait for its
+   * frame latch.
+   */
+  std::uint64_t pinWaits;
+
+  /**
+   * Nanoseconds taken by BufMgr::readPage() and the other ways of pinning a
+   * page.  Every miss is timed, but only one in StatsRecorder::SAMPLE_PERIOD
+   * hits, each such hit counting SAMPLE_PERIOD times, as reading the clock
+   * would otherwise double the cost of a hit.
+   */
+  Histogram readPageLatency;
+
+  /**
+   * Nanoseconds taken by File::readPage() on misses.
+   */
+  Histogram fileReadLatency;
+
+  /**
+   * Nanoseconds taken by each write of dirty pages to their file, which may
+   * write several pages at once.
+   */
+  Histogram fileWriteLatency;
+
+  /**
+   * Number of frames the replacement policy examined per eviction.
+   */
+  Histogram sweepLength;
+
+  /**
+   * Statistics of each file, by file name.
+   */
+  std::map<std::string, FileStats> files;
+
+  /**
+   * Clears all values.
+   */
+  void clear() {
+    accesses = hits = misses = diskreads = allocations = diskwrites = 0;
+    cleanEvictions = dirtyEvictions = sweepSteps = pinWaits = 0;
+    readPageLatency.clear();
+    fileReadLatency.clear();
+    fileWriteLatency.clear();
+    sweepLength.clear();
+    files.clear();
+  }
+
+  BufStats() { clear(); }
+};
+
+/**
+ * @brief Collects the statistics of a buffer pool.
+ *
+ * Every thread records into a shard of its own, allocated on its first event
+ * and merged with the others only when a snapshot is taken.  As no other
+ * thread writes to it, a shard is updated with plain atomic loads and stores
+ * rather than read-modify-write operations, so keeping statistics adds
+ * neither contention nor locked instructions to the hit path.  Threads beyond
+ * the first NUM_SHARDS alive at once share one more shard, updated
+ * atomically.  Recording is threadsafe; a snapshot taken or a clear() made
+ * while events are being recorded may include some of them only in part.
+ */
+class StatsRecorder {
+ public:
+  enum Counter {
+    HITS,
+    MISSES,
+    DISK_READS,
+    ALLOCATIONS,
+    DISK_WRITES,
+    CLEAN_EVICTIONS,
+    DIRTY_EVICTIONS,
+    SWEEP_STEPS,
+    PIN_WAITS,
+    NUM_COUNTERS
+  };
+
+  enum Distribution {
+    READ_PAGE_LATENCY,
+    FILE_READ_LATENCY,
+    FILE_WRITE_LATENCY,
+    SWEEP_LENGTH,
+    NUM_DISTRIBUTIONS
+  };
+
+  enum FileCounter {
+    FILE_HITS,
+    FILE_MISSES,
+    FILE_WRITES,
+    FILE_EVICTIONS,
+    NUM_FILE_COUNTERS
+  };
+
+  /**
+   * Number of threads that get a shard of their own.
+   */
+  static const std::size_t NUM_SHARDS = 64;
+
+  /**
+   * One in this many events for which Local::sample() is asked is timed.
+   */
+  static const std::uint32_t SAMPLE_PERIOD = 8;
+
+  StatsRecorder();
+  ~StatsRecorder();
+
+  /**
+   * Returns the current time in nanoseconds, for measuring latencies.
+   */
+  static std::uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  class Local;
+
+  /**
+   * Returns a handle on the calling thread's shard, for recording several
+   * events at the cost of finding it once.  The handle must not be passed to
+   * other threads.
+   */
+  Local local();
+
+  /**
+   * Adds to a counter.
+   */
+  void count(const Counter counter, const std::uint64_t amount = 1);
+
+  /**
+   * Adds a value to a distribution, <weight> times.
+   */
+  void record(const Distribution distribution, const std::uint64_t value,
+              const std::uint64_t weight = 1);
+
+  /**
+   * Adds to a counter of a file.
+   */
+  void countFile(const File* file, const FileCounter counter,
+                 const std::uint64_t amount = 1);
+
+  /**
+   * Returns the statistics recorded so far.
+   */
+  BufStats snapshot() const;
+
+  /**
+   * Discards the statistics recorded so far.
+   */
+  void clear();
+
+  /**
+   * Returns the index of the calling thread's shard: the lowest that no other
+   * live thread has, or NUM_SHARDS for the overflow shard.  TraceRecorder
+   * keeps its per-thread buffers by the same index.
+   */
+  static std::size_t threadIndex();
+
+ private:
+  StatsRecorder(const StatsRecorder&);
+  StatsRecorder& operator=(const StatsRecorder&);
+
+  /**
+   * @brief Statistics recorded by one thread, or by the threads sharing the
+   *        overflow shard.
+   */
+  struct Shard {
+    /**
+     * Keeps the counters of neighbouring shards off each other's cache lines.
+     */
+    char padding[64];
+
+    std::atomic<std::uint64_t> counters[NUM_COUNTERS];
+
+    /**
+     * Buckets, count, sum and maximum of each distribution.
+     */
+    std::atomic<std::uint64_t> buckets[NUM_DISTRIBUTIONS]
+                                      [Histogram::NUM_BUCKETS];
+    std::atomic<std::uint64_t> counts[NUM_DISTRIBUTIONS];
+    std::atomic<std::uint64_t> sums[NUM_DISTRIBUTIONS];
+    std::atomic<std::uint64_t> maxima[NUM_DISTRIBUTIONS];
+
+    /**
+     * Name and counters of each file.  Entries are added under files_latch,
+     * which snapshots take, and never removed, so the owner of an unshared
+     * shard can look them up without it.
+     */
+    struct FileEntry {
+      std::string name;
+      std::atomic<std::uint64_t> counters[NUM_FILE_COUNTERS];
+    };
+    std::map<const File*, FileEntry> files;
+    std::mutex files_latch;
+
+    /**
+     * Entry of the file counted last, looked up first next time.  Only used
+     * in unshared shards.
+     */
+    const File* last_file;
+    FileEntry* last_entry;
+
+    /**
+     * Number of calls to sample().
+     */
+    std::atomic<std::uint32_t> sample_clock;
+
+    /**
+     * True for the overflow shard.
+     */
+    bool shared;
+
+    explicit Shard(const bool is_shared);
+  };
+
+  /**
+   * Adds to a value of a shard.
+   */
+  static void add(const Shard& shard, std::atomic<std::uint64_t>& value,
+                  const std::uint64_t amount) {
+    if (shard.shared) {
+      value.fetch_add(amount, std::memory_order_relaxed);
+    } else {
+      value.store(value.load(std::memory_order_relaxed) + amount,
+                  std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * Returns the calling thread's shard, allocating it if necessary.
+   */
+  Shard& shard() {
+    Shard* current = shards_[threadIndex()].load(std::memory_order_acquire);
+    return current != NULL ? *current : addShard();
+  }
+
+  /**
+   * Allocates the calling thread's shard.
+   */
+  Shard& addShard();
+
+  /**
+   * Returns the counters of a file in a shard, adding them if necessary.
+   */
+  static std::atomic<std::uint64_t>* fileCounters(Shard& shard,
+                                                  const File* file) {
+    if (shard.last_file == file && !shard.shared) {
+      return shard.last_entry->counters;
+    }
+    return findFileCounters(shard, file);
+  }
+
+  /**
+   * Looks up the counters of a file in a shard, adding them if necessary,
+   * and remembers them as those of the file counted last.
+   */
+  static std::atomic<std::uint64_t>* findFileCounters(Shard& shard,
+                                                      const File* file);
+
+  /**
+   * Adds a value to a distribution of a shard.
+   */
+  static void record(Shard& shard, const Distribution distribution,
+                     const std::uint64_t value, const std::uint64_t weight);
+
+  /**
+   * Returns the entry of a file in a shard, adding it if necessary.  Caller
+   * must hold the shard's files_latch.
+   */
+  static Shard::FileEntry& fileEntry(Shard& shard, const File* file);
+
+  std::atomic<Shard*> shards_[NUM_SHARDS + 1];
+};
+
+/**
+ * @brief Records events into the shard of the thread that obtained it from
+ *        StatsRecorder::local().
+ */
+class StatsRecorder::Local {
+ public:
+  /**
+   * Returns true for one in SAMPLE_PERIOD calls by each thread, to pick the
+   * cheap, frequent events that are timed.
+   */
+  bool sample() {
+    if (shard_.shared) {
+      return shard_.sample_clock.fetch_add(1, std::memory_order_relaxed) %
+          SAMPLE_PERIOD == 0;
+    }
+    const std::uint32_t tick =
+        shard_.sample_clock.load(std::memory_order_relaxed);
+    shard_.sample_clock.store(tick + 1, std::memory_order_relaxed);
+    return tick % SAMPLE_PERIOD == 0;
+  }
+
+  /**
+   * Adds to a counter.
+   */
+  void count(const Counter counter, const std::uint64_t amount = 1) {
+    add(shard_, shard_.counters[counter], amount);
+  }
+
+  /**
+   * Adds a value to a distribution, <weight> times.
+   */
+  void record(const Distribution distribution, const std::uint64_t value,
+              const std::uint64_t weight = 1) {
+    StatsRecorder::record(shard_, distribution, value, weight);
+  }
+
+  /**
+   * Adds to a counter of a file.
+   */
+  void countFile(const File* file, const FileCounter counter,
+                 const std::uint64_t amount = 1) {
+    add(shard_, fileCounters(shard_, file)[counter], amount);
+  }
+
+ private:
+  explicit Local(Shard& shard) : shard_(shard) {}
+
+  Shard& shard_;
+
+  friend class StatsRecorder;
+};
+
+inline StatsRecorder::Local StatsRecorder::local() {
+  return Local(shard());
+}
+
+inline void StatsRecorder::count(const Counter counter,
+                                 const std::uint64_t amount) {
+  local().count(counter, amount);
+}
+
+inline void StatsRecorder::record(const Distribution distribution,
+                                  const std::uint64_t value,
+                                  const std::uint64_t weight) {
+  local().record(distribution, value, weight);
+}
+
+inline void StatsRecorder::countFile(const File* file,
+                                     const FileCounter counter,
+                                     const std::uint64_t amount) {
+  local().countFile(file, counter, amount);
+}
+
+}
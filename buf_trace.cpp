@@ -0,0 +1,297 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "buf_trace.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "file.h"
+#include "exceptions/file_io_exception.h"
+
+namespace badgerdb {
+
+static_assert(sizeof(TraceEvent) == 8, "Trace events are stored as is.");
+
+const std::uint16_t TraceEvent::OVERFLOW_FILE;
+const std::uint32_t TraceFileHeader::MAGIC;
+const std::uint32_t TraceFileHeader::VERSION;
+const std::size_t TraceRecorder::THREAD_BUFFER_SIZE;
+
+namespace {
+
+/**
+ * Appends the bytes of a value to a buffer.
+ */
+template <typename T>
+void append(std::vector<char>& buffer, const T& value) {
+  const char* bytes = reinterpret_cast<const char*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+}
+
+}
+
+TraceRecorder::Buffer::Buffer()
+    : overflowed(0), file(NULL), file_number(0), generation(0) {}
+
+TraceRecorder::TraceRecorder()
+    : active_(false), generation_(0), fd_(-1), error_(0) {}
+
+TraceRecorder::~TraceRecorder() {
+  try {
+    stop();
+  } catch (...) {
+  }
+}
+
+void TraceRecorder::start(const std::string& filename) {
+  std::lock_guard<std::mutex> write_guard(write_latch_);
+  if (active()) {
+    throw FileIOException(filename, EBUSY);
+  }
+  const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    throw FileIOException(filename, errno);
+  }
+
+  filename_ = filename;
+  fd_ = fd;
+  TraceFileHeader header;
+  header.magic = TraceFileHeader::MAGIC;
+  header.version = TraceFileHeader::VERSION;
+  error_ = writeFully(reinterpret_cast<const char*>(&header), sizeof(header));
+  if (error_ != 0) {
+    ::close(fd_);
+    fd_ = -1;
+    throw FileIOException(filename_, error_);
+  }
+  named_files_.clear();
+  file_names_.clear();
+  // File numbers cached by the buffers are of the previous trace from now on.
+  generation_.fetch_add(1);
+  active_.store(true);
+}
+
+std::uint64_t TraceRecorder::stop() {
+  std::lock_guard<std::mutex> write_guard(write_latch_);
+  if (!active()) {
+    return 0;
+  }
+  // Threads check active_ under their buffer latch, so none appends to a
+  // buffer once it has been emptied below.
+  active_.store(false);
+
+  int error = error_;
+  std::uint64_t overflowed = 0;
+  std::vector<char> rest;
+  for (std::size_t i = 0; i <= StatsRecorder::NUM_SHARDS; ++i) {
+    Buffer& buffer = buffers_[i];
+    {
+      std::lock_guard<std::mutex> guard(buffer.latch);
+      rest.swap(buffer.events);
+      overflowed += buffer.overflowed;
+      buffer.overflowed = 0;
+    }
+    if (error == 0) {
+      error = writeFully(rest.data(), rest.size());
+    }
+    rest.clear();
+  }
+  if (::close(fd_) != 0 && error == 0) {
+    error = errno;
+  }
+  fd_ = -1;
+  if (error != 0) {
+    throw FileIOException(filename_, error);
+  }
+  return overflowed;
+}
+
+void TraceRecorder::record(const TraceEventType type, const File* file,
+                           const PageId pageNo, const std::uint8_t flags) {
+  Buffer& buffer = buffers_[StatsRecorder::threadIndex()];
+  std::unique_lock<std::mutex> lock(buffer.latch);
+  if (!active()) {
+    return;
+  }
+  const std::uint32_t generation = generation_.load();
+  if (buffer.file != file || buffer.generation != generation ||
+      buffer.file_name != file->filename()) {
+    lock.unlock();
+    std::uint16_t number;
+    if (!fileNumber(file, generation, number)) {
+      return;
+    }
+    lock.lock();
+    if (!active() || generation_.load() != generation) {
+      return;
+    }
+    buffer.file = file;
+    buffer.file_name = file->filename();
+    buffer.file_number = number;
+    buffer.generation = generation;
+  }
+
+  TraceEvent event;
+  event.page_number = pageNo;
+  event.file = buffer.file_number;
+  event.type = type;
+  event.flags = flags;
+  if (buffer.events.capacity() == 0) {
+    buffer.events.reserve(THREAD_BUFFER_SIZE);
+  }
+  append(buffer.events, event);
+  if (event.file == TraceEvent::OVERFLOW_FILE) {
+    ++buffer.overflowed;
+  }
+  if (buffer.events.size() < THREAD_BUFFER_SIZE) {
+    return;
+  }
+
+  // Write the buffer out, unless another thread is already writing; the next
+  // event recorded by this thread tries again.  Buffers are only taken with
+  // write_latch_ held, so each thread's are written in order.
+  std::unique_lock<std::mutex> writing(write_latch_, std::try_to_lock);
+  if (!writing.owns_lock()) {
+    return;
+  }
+  std::vector<char> full;
+  full.swap(buffer.events);
+  buffer.events.reserve(THREAD_BUFFER_SIZE);
+  lock.unlock();
+  // After a failure, events are dropped until stop() reports it.
+  if (error_ == 0) {
+    error_ = writeFully(full.data(), full.size());
+  }
+}
+
+bool TraceRecorder::fileNumber(const File* file,
+                               const std::uint32_t generation,
+                               std::uint16_t& number) {
+  std::lock_guard<std::mutex> write_guard(write_latch_);
+  if (!active() || generation_.load() != generation) {
+    return false;
+  }
+  const std::string& name = file->filename();
+  std::map<std::string, std::uint16_t>::const_iterator named =
+      named_files_.find(name);
+  if (named != named_files_.end()) {
+    number = named->second;
+    return true;
+  }
+  if (file_names_.size() >= TraceEvent::OVERFLOW_FILE) {
+    number = TraceEvent::OVERFLOW_FILE;
+    return true;
+  }
+
+  // Named in the file right away, ahead of every buffer that may use the
+  // number, as those are only written after it is handed out.
+  number = static_cast<std::uint16_t>(file_names_.size());
+  named_files_[name] = number;
+  file_names_.push_back(name);
+  std::vector<char> naming;
+  TraceEvent event;
+  event.page_number = static_cast<PageId>(name.size());
+  event.file = number;
+  event.type = TRACE_FILE;
+  event.flags = 0;
+  append(naming, event);
+  naming.insert(naming.end(), name.begin(), name.end());
+  if (error_ == 0) {
+    error_ = writeFully(naming.data(), naming.size());
+  }
+  return true;
+}
+
+int TraceRecorder::writeFully(const char* data, const std::size_t length) {
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t count = ::write(fd_, data + done, length - done);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    done += count;
+  }
+  return 0;
+}
+
+TraceReader::TraceReader(const std::string& filename)
+    : filename_(filename), fd_(-1), position_(0) {
+  fd_ = ::open(filename_.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    throw FileIOException(filename_, errno);
+  }
+  try {
+    TraceFileHeader header;
+    if (!readFully(&header, sizeof(header)) ||
+        header.magic != TraceFileHeader::MAGIC ||
+        header.version != TraceFileHeader::VERSION) {
+      throw FileIOException(filename_, EINVAL);
+    }
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
+}
+
+TraceReader::~TraceReader() { ::close(fd_); }
+
+bool TraceReader::next(TraceEvent& event) {
+  for (;;) {
+    if (!readFully(&event, sizeof(event))) {
+      return false;
+    }
+    if (event.type != TRACE_FILE) {
+      return true;
+    }
+    std::string name(event.page_number, '\0');
+    if (!readFully(&name[0], name.size())) {
+      return false;
+    }
+    if (event.file >= file_names_.size()) {
+      file_names_.resize(event.file + 1);
+    }
+    file_names_[event.file] = name;
+  }
+}
+
+bool TraceReader::readFully(void* buffer, const std::size_t length) {
+  char* target = static_cast<char*>(buffer);
+  std::size_t done = 0;
+  while (done < length) {
+    if (position_ == buffer_.size()) {
+      buffer_.resize(1 << 20);
+      position_ = 0;
+      ssize_t count;
+      while ((count = ::read(fd_, &buffer_[0], buffer_.size())) < 0) {
+        if (errno != EINTR) {
+          buffer_.clear();
+          throw FileIOException(filename_, errno);
+        }
+      }
+      buffer_.resize(count);
+      if (count == 0) {
+        return false;
+      }
+    }
+    const std::size_t taken =
+        std::min(length - done, buffer_.size() - position_);
+    std::memcpy(target + done, &buffer_[position_], taken);
+    position_ += taken;
+    done += taken;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,383 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "buf_stats.h"
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+
+/**
+ * @brief Kinds of events in a buffer pool trace.
+ */
+enum TraceEventType {
+  /**
+   * A page was pinned by BufMgr::readPage() or one of its variants.
+   */
+  TRACE_PIN = 1,
+
+  /**
+   * A page was unpinned.
+   */
+  TRACE_UNPIN = 2,
+
+  /**
+   * A page was allocated in a file, and pinned in the pool.
+   */
+  TRACE_ALLOC = 3,
+
+  /**
+   * A page was deleted from a file, and dropped from the pool.
+   */
+  TRACE_DISPOSE = 4,
+
+  /**
+   * Names the file of the following events with the record's file number.
+   * The record is followed by the name, of as many bytes as its page number
+   * says.  Readers handle these records themselves.
+   */
+  TRACE_FILE = 5
+};
+
+/**
+ * @brief Flags of trace events.
+ */
+enum TraceEventFlags {
+  /**
+   * On TRACE_UNPIN: the page was unpinned dirty.
+   */
+  TRACE_DIRTY = 1,
+
+  /**
+   * On TRACE_PIN: the page was resident in the traced pool.
+   */
+  TRACE_HIT = 2
+};
+
+/**
+ * @brief One event of a buffer pool trace, as stored in the trace file.
+ */
+struct TraceEvent {
+  /**
+   * Page the event is about.
+   */
+  PageId page_number;
+
+  /**
+   * Number of the page's file in the trace (see TraceReader::filename()), or
+   * OVERFLOW_FILE.
+   */
+  std::uint16_t file;
+
+  /**
+   * Kind of event, one of TraceEventType.
+   */
+  std::uint8_t type;
+
+  /**
+   * TraceEventFlags of the event.
+   */
+  std::uint8_t flags;
+
+  /**
+   * File number of the events of files seen after all others were taken.
+   * Never named in the trace.
+   */
+  static const std::uint16_t OVERFLOW_FILE = 0xFFFF;
+};
+
+/**
+ * @brief Header at the start of a trace file.
+ */
+struct TraceFileHeader {
+  /**
+   * Always MAGIC.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Format of the events; always VERSION.
+   */
+  std::uint32_t version;
+
+  static const std::uint32_t MAGIC = 0x43525442;
+  static const std::uint32_t VERSION = 1;
+};
+
+/**
+ * @brief Records the page accesses of a buffer pool to a trace file while it
+ *        is started (see BufMgr::startTrace()).
+ *
+ * Events take eight bytes each and are buffered per thread, as StatsRecorder
+ * keeps its statistics, so that recording threads do not contend with each
+ * other; threads beyond the first StatsRecorder::NUM_SHARDS share one more
+ * buffer.  A full buffer is written out by the thread that filled it, unless
+ * another thread is writing, in which case it keeps growing until the next
+ * event.  Files are numbered in the order they are first seen, and each number
+ * is named in the trace file before any event using it is written.  After
+ * OVERFLOW_FILE files the rest share that number, which stop() reports.
+ *
+ * As buffers are written whole, events of concurrent threads are interleaved
+ * in runs of up to THREAD_BUFFER_SIZE bytes, rather than in the order in which
+ * the pool served them.  Events of one thread keep their order.
+ *
+ * All methods are threadsafe.  The latches taken by record() are taken last,
+ * after any of the buffer manager's, and the buffer manager records events
+ * with none of its frame latches held.
+ */
+class TraceRecorder {
+ public:
+  TraceRecorder();
+
+  /**
+   * Stops any trace being recorded, swallowing errors.
+   */
+  ~TraceRecorder();
+
+  /**
+   * Starts recording to a new trace file, replacing any file of that name.
+   *
+   * @param filename  Name of the trace file.
+   * @throws  FileIOException  If a trace is already being recorded, or the
+   *                           file cannot be created.
+   */
+  void start(const std::string& filename);
+
+  /**
+   * Writes out the events recorded and closes the trace file.  Does nothing
+   * if no trace is being recorded.
+   *
+   * @return  Number of events recorded with TraceEvent::OVERFLOW_FILE, as the
+   *          trace ran out of file numbers; 0 if every file got its own.
+   * @throws  FileIOException  If the trace could not be written, at any time
+   *                           since it was started.  The events recorded after
+   *                           the failure are lost.
+   */
+  std::uint64_t stop();
+
+  /**
+   * Returns true while a trace is started.  Cheap enough for the buffer
+   * manager to check on every access.
+   */
+  bool active() const { return active_.load(std::memory_order_relaxed); }
+
+  /**
+   * Records an event, if a trace is started.
+   *
+   * @param type      Kind of event.
+   * @param file      File of the page.
+   * @param pageNo    Page the event is about.
+   * @param flags     TraceEventFlags of the event.
+   */
+  void record(const TraceEventType type, const File* file,
+              const PageId pageNo, const std::uint8_t flags = 0);
+
+ private:
+  /**
+   * Size of a thread's buffer at which it is written out, in bytes.
+   */
+  static const std::size_t THREAD_BUFFER_SIZE = 64 << 10;
+
+  /**
+   * @brief Events recorded by one thread, or by the threads sharing the
+   *        overflow buffer, and the file they last recorded an event of.
+   */
+  struct Buffer {
+    /**
+     * Keeps the buffers of neighbouring threads off each other's cache lines.
+     */
+    char padding[64];
+
+    /**
+     * Guards the members below.  Only contended by stop(), and in the
+     * overflow buffer.
+     */
+    std::mutex latch;
+
+    /**
+     * Events recorded but not yet written.
+     */
+    std::vector<char> events;
+
+    /**
+     * Number of events recorded with TraceEvent::OVERFLOW_FILE.
+     */
+    std::uint64_t overflowed;
+
+    /**
+     * File of the last event recorded, with its name, its number and the
+     * trace it was numbered in (see generation_).  A File object may be
+     * reused for another file, so the name is checked as well.
+     */
+    const File* file;
+    std::string file_name;
+    std::uint16_t file_number;
+    std::uint32_t generation;
+
+    Buffer();
+  };
+
+  /**
+   * Returns the number of the given file in the trace started as <generation>,
+   * writing a record naming it if it is new.  Takes write_latch_, so it must be
+   * called with no buffer latch held.
+   *
+   * @return  False if another trace has been started meanwhile.
+   */
+  bool fileNumber(const File* file, const std::uint32_t generation,
+                  std::uint16_t& number);
+
+  /**
+   * Appends bytes to the trace file.  Called with write_latch_ held.
+   *
+   * @return  0, or the errno of the failure.
+   */
+  int writeFully(const char* data, const std::size_t length);
+
+  /**
+   * Disallow copying.
+   */
+  TraceRecorder(const TraceRecorder&);
+  TraceRecorder& operator=(const TraceRecorder&);
+
+  /**
+   * True while a trace is started.  Set and cleared with write_latch_ held.
+   */
+  std::atomic<bool> active_;
+
+  /**
+   * Incremented by every start(), so that buffers can tell file numbers of
+   * an earlier trace from current ones.
+   */
+  std::atomic<std::uint32_t> generation_;
+
+  /**
+   * Serializes writes to the trace file and guards the members below.  Taken
+   * before any buffer latch, except by record(), which only tries it.
+   */
+  std::mutex write_latch_;
+
+  /**
+   * Name of the trace file.
+   */
+  std::string filename_;
+
+  /**
+   * Descriptor of the trace file, or -1.
+   */
+  int fd_;
+
+  /**
+   * errno of the first failed write since the trace was started, or 0.
+   */
+  int error_;
+
+  /**
+   * Numbers of the files seen, by name.
+   */
+  std::map<std::string, std::uint16_t> named_files_;
+
+  /**
+   * Names of the files seen, by number.
+   */
+  std::vector<std::string> file_names_;
+
+  /**
+   * Buffer of each thread, by StatsRecorder::threadIndex(); the last is the
+   * overflow buffer.
+   */
+  Buffer buffers_[StatsRecorder::NUM_SHARDS + 1];
+};
+
+/**
+ * @brief Reads back a trace written by TraceRecorder.
+ */
+class TraceReader {
+ public:
+  /**
+   * Opens a trace file.
+   *
+   * @param filename  Name of the trace file.
+   * @throws  FileIOException  If the file cannot be opened or is not a trace
+   *                           (EINVAL).
+   */
+  explicit TraceReader(const std::string& filename);
+
+  ~TraceReader();
+
+  /**
+   * Reads the next event.  A final event cut short, as by a crash while
+   * tracing, is ignored.
+   *
+   * @param event   Receives the event; never a TRACE_FILE record.
+   * @return  False at the end of the trace.
+   * @throws  FileIOException  If the trace cannot be read.
+   */
+  bool next(TraceEvent& event);
+
+  /**
+   * Returns the name of a file number seen in the events read so far, other
+   * than TraceEvent::OVERFLOW_FILE.
+   */
+  const std::string& filename(const std::uint16_t file) const {
+    return file_names_[file];
+  }
+
+  /**
+   * Returns the number of distinct file numbers seen so far.  Numbers are
+   * dense, so they are all below this.
+   */
+  std::size_t numFiles() const { return file_names_.size(); }
+
+ private:
+  /**
+   * Reads exactly <length> bytes.
+   *
+   * @return  False if the trace ends first.
+   */
+  bool readFully(void* buffer, const std::size_t length);
+
+  /**
+   * Disallow copying.
+   */
+  TraceReader(const TraceReader&);
+  TraceReader& operator=(const TraceReader&);
+
+  /**
+   * Name of the trace file.
+   */
+  std::string filename_;
+
+  /**
+   * Descriptor of the trace file.
+   */
+  int fd_;
+
+  /**
+   * Bytes read ahead from the file, and the next of them to hand out.
+   */
+  std::vector<char> buffer_;
+  std::size_t position_;
+
+  /**
+   * Names of the files seen, by number.
+   */
+  std::vector<std::string> file_names_;
+};
+
+}
@@ -14,83 +14,346 @@
   *including frame allocation and deallocation to pages in the file.
   */
 
+  #include <algorithm>
   #include <memory>
   #include <iostream>
+  #include <new>
+  #include <cassert>
+  #include <cerrno>
+  #include <cstring>
+  #include <exception>
+  #include <fcntl.h>
+  #include <unistd.h>
   #include "buffer.h"
+  #include "page_guard.h"
+  #include "exceptions/file_io_exception.h"
   #include "exceptions/buffer_exceeded_exception.h"
   #include "exceptions/page_not_pinned_exception.h"
   #include "exceptions/page_pinned_exception.h"
   #include "exceptions/bad_buffer_exception.h"
-  #include "exceptions/hash_not_found_exception.h"
+  #include "exceptions/invalid_page_exception.h"
 
   namespace badgerdb { 
 
+  namespace {
+
+	/**
+   * Header of a file written by BufMgr::saveResidentSet().  It is followed by num_files names, each a 32-bit length
+   * and that many bytes, and by num_pages ResidentPage entries, hottest first.
+	 */
+  struct ResidentSetHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint32_t page_size;
+    std::uint32_t num_files;
+    std::uint32_t num_pages;
+  };
+
+  const std::uint32_t RESIDENT_SET_MAGIC = 0x53524442;
+  const std::uint32_t RESIDENT_SET_VERSION = 1;
+
+	/**
+   * A resident page: index of its file among the names, page number and flags
+	 */
+  struct ResidentPage {
+    std::uint32_t file;
+    PageId pageNo;
+    std::uint32_t flags;
+  };
+
+	/**
+   * Flag of a ResidentPage whose reference bit was set
+	 */
+  const std::uint32_t RESIDENT_REFERENCED = 1;
+
+	/**
+   * Appends the bytes of a value to a buffer
+	 */
+  template <typename T>
+  void appendBytes(std::vector<char>& buffer, const T& value)
+  {
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(value));
+  }
+
+	/**
+   * Copies the next <length> bytes of a buffer out, advancing the position
+   *
+   * @return  False if the buffer ends first.
+	 */
+  bool takeBytes(const std::vector<char>& buffer, std::size_t& position, void* target, const std::size_t length)
+  {
+    if (buffer.size() - position < length)
+      return false;
+    std::memcpy(target, buffer.data() + position, length);
+    position += length;
+    return true;
+  }
+
+  }
+
   //----------------------------------------
   // Constructor of the class BufMgr
   //----------------------------------------
 
-  BufMgr::BufMgr(std::uint32_t bufs)
-    : numBufs(bufs) {
+  BufMgr::BufMgr(std::uint32_t bufs, ReplacementPolicy::Type policyType, const std::uint32_t numaNodes)
+    : numBufs(bufs), ioEngine(NULL), log(NULL), numPartitions(numaNodes > 1 && numaNodes <= bufs ? numaNodes : 1),
+      writerStop(false), writerBatch(0), writerInterval(0) {
     bufDescTable = new BufDesc[bufs];
+    frameStates = new FrameState[bufs];
 
     for (FrameId i = 0; i < bufs; i++) 
     {
       bufDescTable[i].frameNo = i;
-      bufDescTable[i].valid = false;
+      bufDescTable[i].state = &frameStates[i];
     }
 
-    bufPool = new Page[bufs];
+    // All frames live in one contiguous, page-aligned allocation so that pages can be read and written in place.
+    arena = new MemoryArena(static_cast<std::size_t>(bufs) * sizeof(Page), numPartitions);
+    bufPool = static_cast<Page*>(arena->base());
+    for (FrameId i = 0; i < bufs; i++)
+      new (&bufPool[i]) Page();
+
+    hashTable = new BufHashTbl (bufs);  // allocate the buffer hash table, sized for one entry per frame
 
-    int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-    hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+    policy = ReplacementPolicy::create(policyType, frameStates, bufs, numPartitions);
 
-    clockHand = bufs - 1;
+    // Hand out low frame numbers first.
+    freeFrames.resize(numPartitions);
+    for (FrameId i = bufs; i > 0; i--)
+      freeFrames[partitionOf(i - 1)].push_back(i - 1);
   }
 
 	/**
    * Destructor of BufMgr class
 	 */
   BufMgr::~BufMgr() {
+    stopBackgroundWriter();
+    delete ioEngine;  // finishes outstanding requests, which still use the pool
+    delete policy;
     delete[] bufDescTable;
-    delete[] bufPool;
+    delete[] frameStates;
+    delete arena;
     delete hashTable;
   }
 
-  void BufMgr::advanceClock()
-  {   
-    clockHand = (clockHand + 1) % numBufs;
+  bool BufMgr::FrameClaimer::tryClaim(const FrameId frame)
+  {
+    // The state word is checked first so that frames which cannot be evicted are passed over without touching
+    // their descriptors.
+    examined_++;
+    if (!FrameState::evictable(states_[frame].load()))
+      return false;
+    BufDesc& desc = descTable_[frame];
+    // A frame whose latch is taken is being used by another thread; treat it like a pinned frame.
+    if (!desc.latch.try_lock())
+      return false;
+    if (!FrameState::evictable(states_[frame].load())) {
+      desc.latch.unlock();
+      return false;
+    }
+    return true;
+  }
+
+  std::uint32_t BufMgr::partitionOf(const FrameId frame) const
+  {
+    return std::min(frame / (numBufs / numPartitions), numPartitions - 1);
+  }
+
+  void BufMgr::releaseFrame(const FrameId frame)
+  {
+    std::lock_guard<std::mutex> guard(freeFramesLatch);
+    freeFrames[partitionOf(frame)].push_back(frame);
+  }
+
+  void BufMgr::linkFrame(const FrameId frame)
+  {
+    std::lock_guard<std::mutex> guard(fileFramesLatch);
+    BufDesc& desc = bufDescTable[frame];
+    std::map<const File*, FrameId>::iterator head = fileFrames.find(desc.file);
+    desc.prevInFile = BufDesc::NO_FRAME;
+    desc.nextInFile = head == fileFrames.end() ? BufDesc::NO_FRAME : head->second;
+    if (desc.nextInFile != BufDesc::NO_FRAME)
+      bufDescTable[desc.nextInFile].prevInFile = frame;
+    fileFrames[desc.file] = frame;
+  }
+
+  void BufMgr::unlinkFrame(const FrameId frame)
+  {
+    std::lock_guard<std::mutex> guard(fileFramesLatch);
+    BufDesc& desc = bufDescTable[frame];
+    if (desc.nextInFile != BufDesc::NO_FRAME)
+      bufDescTable[desc.nextInFile].prevInFile = desc.prevInFile;
+    if (desc.prevInFile != BufDesc::NO_FRAME)
+      bufDescTable[desc.prevInFile].nextInFile = desc.nextInFile;
+    else if (desc.nextInFile != BufDesc::NO_FRAME)
+      fileFrames[desc.file] = desc.nextInFile;
+    else
+      fileFrames.erase(desc.file);
+    desc.prevInFile = desc.nextInFile = BufDesc::NO_FRAME;
+  }
+
+  void BufMgr::residentFrames(const File* file, std::vector<FrameId>& frames)
+  {
+    {
+      std::lock_guard<std::mutex> guard(fileFramesLatch);
+      std::map<const File*, FrameId>::const_iterator head = fileFrames.find(file);
+      if (head == fileFrames.end())
+        return;
+      for (FrameId f = head->second; f != BufDesc::NO_FRAME; f = bufDescTable[f].nextInFile)
+        frames.push_back(f);
+    }
+    std::sort(frames.begin(), frames.end());
+  }
+
+  bool BufMgr::takeFreeFrame(FrameId& frame)
+  {
+    const std::uint32_t home = numPartitions > 1 ? MemoryArena::currentNode() % numPartitions : 0;
+    std::unique_lock<std::mutex> guard(freeFramesLatch);
+    for (std::uint32_t i = 0; i < numPartitions; i++) {
+      std::vector<FrameId>& partitionFrames = freeFrames[(home + i) % numPartitions];
+      if (!partitionFrames.empty()) {
+        frame = partitionFrames.back();
+        partitionFrames.pop_back();
+        guard.unlock();
+        bufDescTable[frame].latch.lock();
+        return true;
+      }
+    }
+    return false;
   }
 
   void BufMgr::allocBuf(FrameId & frame) 
   {
+    if (takeFreeFrame(frame))
+      return;
 
-    std::uint32_t count = 0;
-    while (count <= numBufs) {
-      advanceClock();
-      if (bufDescTable[clockHand].valid) {
-        if (bufDescTable[clockHand].refbit) {
-          bufDescTable[clockHand].refbit = false;
-          continue;
-        }
-        if (bufDescTable[clockHand].pinCnt > 0) {
-            count++;
-            continue;
-        }
-        if (bufDescTable[clockHand].dirty) {
-          bufDescTable[clockHand].file->writePage(bufPool[clockHand]);
-          hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-          bufDescTable[clockHand].dirty = false;
-          frame = clockHand;
-          return;
-        }
-        //hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
-        frame = clockHand;
-        return;     
+    FrameClaimer claimer(bufDescTable, frameStates);
+    FrameId victim;
+    const bool found = policy->chooseVictim(claimer, victim);
+    stats.count(StatsRecorder::SWEEP_STEPS, claimer.examined());
+    stats.record(StatsRecorder::SWEEP_LENGTH, claimer.examined());
+    if (!found)
+      throw BufferExceededException(); 
+
+    BufDesc& desc = bufDescTable[victim];
+    if (desc.state->dirty()) {
+      writerWake.notify_one();  // the background writer, if running, is falling behind
+      try {
+        flushLog(bufPool[victim].lsn());
+        const std::uint64_t start = StatsRecorder::now();
+        desc.file->writePage(bufPool[victim]);
+        recordWrite(desc.file, 1, start);
       }
-      frame = clockHand;
+      catch (...) {
+        policy->loaded(victim, desc.file, desc.pageNo);  // the page stays resident, so keep it evictable
+        desc.latch.unlock();
+        throw;
+      }
+      desc.state->clear(FrameState::DIRTY);
+      stats.count(StatsRecorder::DIRTY_EVICTIONS);
+    }
+    else
+      stats.count(StatsRecorder::CLEAN_EVICTIONS);
+    stats.countFile(desc.file, StatsRecorder::FILE_EVICTIONS);
+    hashTable->remove(desc.file, desc.pageNo);
+    unlinkFrame(victim);
+    desc.Clear();
+    frame = victim;
+  }
+
+  void BufMgr::recordWrite(const File* file, const std::uint32_t pages, const std::uint64_t start)
+  {
+    stats.record(StatsRecorder::FILE_WRITE_LATENCY, StatsRecorder::now() - start);
+    stats.count(StatsRecorder::DISK_WRITES, pages);
+    stats.countFile(file, StatsRecorder::FILE_WRITES, pages);
+  }
+
+  void BufMgr::attachLog(LogManager* logManager)
+  {
+    log = logManager;
+  }
+
+  void BufMgr::flushLog(const Lsn lsn)
+  {
+    LogManager* logManager = log;
+    if (logManager != NULL && lsn != LogManager::INVALID_LSN)
+      logManager->flush(lsn);
+  }
+
+  void BufMgr::startBackgroundWriter(const std::uint32_t batch, const unsigned intervalMs)
+  {
+    std::lock_guard<std::mutex> guard(writerLatch);
+    if (writerThread.joinable())
       return;
+    writerStop = false;
+    writerBatch = batch;
+    writerInterval = std::chrono::milliseconds(intervalMs);
+    writerThread = std::thread(&BufMgr::runBackgroundWriter, this);
+  }
+
+  void BufMgr::stopBackgroundWriter()
+  {
+    {
+      std::lock_guard<std::mutex> guard(writerLatch);
+      if (!writerThread.joinable())
+        return;
+      writerStop = true;
+    }
+    writerWake.notify_all();
+    writerThread.join();
+  }
+
+  void BufMgr::runBackgroundWriter()
+  {
+    std::vector<FrameId> candidates;
+    std::unique_lock<std::mutex> lock(writerLatch);
+    while (!writerStop) {
+      const std::uint32_t batch = writerBatch;
+      lock.unlock();
+
+      candidates.clear();
+      policy->upcomingVictims(batch, candidates);
+      for (std::size_t i = 0; i < candidates.size(); i++)
+        cleanFrame(candidates[i]);
+
+      lock.lock();
+      if (!writerStop)
+        writerWake.wait_for(lock, writerInterval);
     }
-    throw BufferExceededException(); 
+  }
+
+  bool BufMgr::cleanFrame(const FrameId frame)
+  {
+    BufDesc& desc = bufDescTable[frame];
+    std::unique_lock<std::mutex> lock(desc.latch, std::try_to_lock);
+    if (!lock.owns_lock() || !desc.state->dirty() || !FrameState::evictable(desc.state->load()))
+      return false;
+    // While CLEANING the frame keeps its page, so only the copy has to be taken under the latch.
+    const Page copy = bufPool[frame];
+    File* file = desc.file;
+    desc.state->clear(FrameState::DIRTY);
+    desc.state->set(FrameState::CLEANING);
+    lock.unlock();
+
+    bool written = true;
+    try {
+      flushLog(copy.lsn());
+      const std::uint64_t start = StatsRecorder::now();
+      file->writePage(copy);
+      recordWrite(file, 1, start);
+    }
+    catch (...) {
+      written = false;  // left dirty; eviction will retry the write and report the error
+    }
+
+    lock.lock();
+    if (!written)
+      desc.state->set(FrameState::DIRTY);
+    desc.state->clear(FrameState::CLEANING);
+    lock.unlock();
+    cleaned.notify_all();
+    return written;
   }
 
 	/**
@@ -105,20 +368,211 @@
   void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
   {
     FrameId frameNumber;
-    try{
-      hashTable->lookup(file, pageNo, frameNumber);
-      bufDescTable[frameNumber].pinCnt++;
-      bufDescTable[frameNumber].refbit = true;
-      page = &bufPool[frameNumber];
+    page = pinPage(file, pageNo, frameNumber);
+  }
+
+  Page* BufMgr::pinPage(File* file, const PageId pageNo, FrameId& frameNumber)
+  {
+    // Only a sample of accesses is timed from the start; misses are timed from the lookup.
+    StatsRecorder::Local local = stats.local();
+    const bool timed = local.sample();
+    std::uint64_t start = timed ? StatsRecorder::now() : 0;
+    if (file->isMapped()) {
+      // Pages of mapped files are used in place, without a frame; unPinPage() has nothing to do for them.
+      frameNumber = BufDesc::NO_FRAME;
+      Page* page = const_cast<Page*>(file->mappedPage(pageNo));
+      recordHit(local, file, timed, start);
+      return page;
     }
-    catch(HashNotFoundException& e){
-      allocBuf(frameNumber); //Call allocBuf() to allocate a buffer frame
-      bufPool[frameNumber] = file->readPage(pageNo); //call the method file->readPage() to read the page from disk into the buffer pool frame
-      hashTable->insert(file, pageNo, frameNumber); // Next, insert the page into the hashtable
-      bufDescTable[frameNumber].Set(file, pageNo); //Finally, invoke Set() on the frame to set it up properly
-      page = &bufPool[frameNumber]; //Return a pointer to the frame containing the page via the page parameter
+
+    for (;;) {
+      if (!hashTable->tryLookup(file, pageNo, frameNumber)) {
+        if (!timed)
+          start = StatsRecorder::now();
+        allocBuf(frameNumber); //Call allocBuf() to allocate a buffer frame, which comes back latched
+        BufDesc& desc = bufDescTable[frameNumber];
+        // Publish the frame first so that other readers wait on its latch.  If another thread brought the page
+        // in while we were allocating, use its frame instead.
+        if (!hashTable->tryInsert(file, pageNo, frameNumber)) {
+          releaseFrame(frameNumber);
+          desc.latch.unlock();
+          continue;
+        }
+        try {
+          const std::uint64_t readStart = StatsRecorder::now();
+          file->readPage(pageNo, bufPool[frameNumber]); //call the method file->readPage() to read the page from disk straight into the buffer pool frame
+          local.record(StatsRecorder::FILE_READ_LATENCY, StatsRecorder::now() - readStart);
+        }
+        catch(...) {
+          hashTable->remove(file, pageNo);
+          releaseFrame(frameNumber);
+          desc.latch.unlock();
+          throw;
+        }
+        desc.Set(file, pageNo); //Finally, invoke Set() on the frame to set it up properly
+        linkFrame(frameNumber);
+        policy->loaded(frameNumber, file, pageNo);
+        desc.latch.unlock();
+        traceEvent(TRACE_PIN, file, pageNo);
+        local.count(StatsRecorder::MISSES);
+        local.count(StatsRecorder::DISK_READS);
+        local.countFile(file, StatsRecorder::FILE_MISSES);
+        local.record(StatsRecorder::READ_PAGE_LATENCY, StatsRecorder::now() - start);
+        return &bufPool[frameNumber]; //Return a pointer to the frame containing the page
+      }
+
+      BufDesc& desc = bufDescTable[frameNumber];
+      std::unique_lock<std::mutex> guard(desc.latch, std::try_to_lock);
+      if (!guard.owns_lock()) {
+        // The frame is being read in, written out or pinned by another thread.
+        local.count(StatsRecorder::PIN_WAITS);
+        guard.lock();
+      }
+      // The frame may have been evicted and reassigned between the lookup and taking the latch.
+      if (desc.state->valid() && desc.file == file && desc.pageNo == pageNo) {
+        desc.state->pin();
+        policy->accessed(frameNumber);
+        guard.unlock();
+        traceEvent(TRACE_PIN, file, pageNo, TRACE_HIT);
+        recordHit(local, file, timed, start);
+        return &bufPool[frameNumber];
+      }
     }
+  }
 
+  IOEngine& BufMgr::engine()
+  {
+    std::call_once(ioEngineStarted, [this]() { ioEngine = new IOEngine(NUM_IO_THREADS); });
+    return *ioEngine;
+  }
+
+  void BufMgr::recordHit(StatsRecorder::Local& local, const File* file, const bool timed, const std::uint64_t start)
+  {
+    local.count(StatsRecorder::HITS);
+    local.countFile(file, StatsRecorder::FILE_HITS);
+    if (timed)
+      local.record(StatsRecorder::READ_PAGE_LATENCY, StatsRecorder::now() - start, StatsRecorder::SAMPLE_PERIOD);
+  }
+
+  bool BufMgr::tryPinResident(File* file, const PageId pageNo, Page*& page)
+  {
+    StatsRecorder::Local local = stats.local();
+    const bool timed = local.sample();
+    const std::uint64_t start = timed ? StatsRecorder::now() : 0;
+    FrameId frameNumber;
+    if (!hashTable->tryLookup(file, pageNo, frameNumber))
+      return false;
+
+    BufDesc& desc = bufDescTable[frameNumber];
+    // A busy latch means the frame is being read in or evicted; let the caller take the blocking path.
+    std::unique_lock<std::mutex> lock(desc.latch, std::try_to_lock);
+    if (!lock.owns_lock() || !desc.state->valid() || desc.file != file || desc.pageNo != pageNo)
+      return false;
+    desc.state->pin();
+    policy->accessed(frameNumber);
+    lock.unlock();
+    traceEvent(TRACE_PIN, file, pageNo, TRACE_HIT);
+    recordHit(local, file, timed, start);
+    page = &bufPool[frameNumber];
+    return true;
+  }
+
+  std::vector<std::future<Page*> > BufMgr::readPagesAsync(const std::vector<std::pair<File*, PageId> >& requests)
+  {
+    std::vector<std::future<Page*> > results;
+    results.reserve(requests.size());
+    for (std::size_t i = 0; i < requests.size(); i++) {
+      File* file = requests[i].first;
+      const PageId pageNo = requests[i].second;
+
+      if (file->isMapped()) {
+        // Pages of mapped files need no reading into the pool, so they are ready at once.
+        std::promise<Page*> ready;
+        try {
+          ready.set_value(const_cast<Page*>(file->mappedPage(pageNo)));
+        }
+        catch (...) {
+          ready.set_exception(std::current_exception());
+        }
+        results.push_back(ready.get_future());
+        continue;
+      }
+
+      Page* page;
+      if (tryPinResident(file, pageNo, page)) {
+        std::promise<Page*> ready;
+        ready.set_value(page);
+        results.push_back(ready.get_future());
+        continue;
+      }
+
+      results.push_back(engine().submit([this, file, pageNo]() {
+        Page* loaded;
+        readPage(file, pageNo, loaded);
+        return loaded;
+      }));
+    }
+    return results;
+  }
+
+  void BufMgr::prefetchPages(File* file, const std::vector<PageId>& pageNos)
+  {
+    if (file->isMapped())
+      return;  // nothing to load into the pool; the operating system does its own read-ahead
+
+    FrameId frameNumber;
+    for (std::size_t i = 0; i < pageNos.size(); i++) {
+      const PageId pageNo = pageNos[i];
+      if (hashTable->tryLookup(file, pageNo, frameNumber))
+        continue;
+      // The future is dropped; a failed prefetch just leaves the page out.  Ending the read is the last use of the
+      // File object, which its owner may destroy right after.
+      file->beginBackgroundRead();
+      try {
+        engine().submit([this, file, pageNo]() {
+          try {
+            prefetchPage(file, pageNo);
+          }
+          catch (...) {
+          }
+          file->endBackgroundRead();
+        });
+      }
+      catch (...) {
+        file->endBackgroundRead();
+        throw;
+      }
+    }
+  }
+
+  void BufMgr::prefetchPage(File* file, const PageId pageNo)
+  {
+    FrameId frameNumber;
+    if (hashTable->tryLookup(file, pageNo, frameNumber))
+      return;
+    allocBuf(frameNumber);
+    BufDesc& desc = bufDescTable[frameNumber];
+    if (!hashTable->tryInsert(file, pageNo, frameNumber)) {
+      // A reader brought the page in meanwhile.
+      releaseFrame(frameNumber);
+      desc.latch.unlock();
+      return;
+    }
+    try {
+      file->readPage(pageNo, bufPool[frameNumber]);
+    }
+    catch(...) {
+      hashTable->remove(file, pageNo);
+      releaseFrame(frameNumber);
+      desc.latch.unlock();
+      throw;
+    }
+    desc.Set(file, pageNo);
+    desc.state->unpin();
+    linkFrame(frameNumber);
+    policy->loaded(frameNumber, file, pageNo);
+    desc.latch.unlock();
+    stats.count(StatsRecorder::DISK_READS);
   }
 
 	/**
@@ -132,18 +586,22 @@
   void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
   {
     FrameId f;
-    try{
-      hashTable->lookup(file, pageNo, f);
-      if (bufDescTable[f].pinCnt == 0) {
-        throw PageNotPinnedException(file->filename(), pageNo, f);
-      }
-      bufDescTable[f].pinCnt = bufDescTable[f].pinCnt - 1;
-      
-      if(dirty)
-        bufDescTable[f].dirty = true;
-    }
-    catch (HashNotFoundException& e) {}
+    if (!hashTable->tryLookup(file, pageNo, f))
+      return;
 
+    BufDesc& desc = bufDescTable[f];
+    std::unique_lock<std::mutex> lock(desc.latch);
+    if (!desc.state->valid() || desc.file != file || desc.pageNo != pageNo)
+      return;
+    if (desc.state->pinCnt() == 0) {
+      throw PageNotPinnedException(file->filename(), pageNo, f);
+    }
+    desc.state->unpin();
+      
+    if(dirty)
+      desc.state->set(FrameState::DIRTY);
+    lock.unlock();
+    traceEvent(TRACE_UNPIN, file, pageNo, dirty ? TRACE_DIRTY : 0);
   }
 
 	/**
@@ -173,15 +631,116 @@
       bufDescTable[clockHand].Set(file, pageNo);
       */
       FrameId f;
-      Page p = file->allocatePage();
-      allocBuf(f);
-      bufPool[f] = p;
-      
-      hashTable->insert(file, p.page_number(), f);
-      bufDescTable[f].Set(file, p.page_number());
-      page = &bufPool[f];
+      page = allocPinnedPage(file, f);
       pageNo = page->page_number();
-      
+  }
+
+  Page* BufMgr::allocPinnedPage(File* file, FrameId& f)
+  {
+      // Take the frame first, so that running out of frames leaves the file untouched, and set the page up
+      // directly in it.
+      allocBuf(f);
+      Page& page = bufPool[f];
+      try {
+        file->allocatePage(page);
+      }
+      catch (...) {
+        releaseFrame(f);
+        bufDescTable[f].latch.unlock();
+        throw;
+      }
+      stats.count(StatsRecorder::ALLOCATIONS);
+      const PageId pageNo = page.page_number();
+
+      hashTable->insert(file, pageNo, f);
+      bufDescTable[f].Set(file, pageNo);
+      linkFrame(f);
+      policy->loaded(f, file, pageNo);
+      bufDescTable[f].latch.unlock();
+      traceEvent(TRACE_ALLOC, file, pageNo);
+      return &page;
+  }
+
+  void BufMgr::unPinFrame(const FrameId frame, const bool dirty)
+  {
+    if (frame == BufDesc::NO_FRAME)
+      return;  // a page of a mapped file
+
+    // The pin keeps the frame from being evicted, so it still holds the page and no lookup is needed.
+    BufDesc& desc = bufDescTable[frame];
+    std::unique_lock<std::mutex> lock(desc.latch);
+    assert(desc.state->valid() && desc.state->pinCnt() > 0);
+    // Once unpinned the frame may be given to another page, so the page is noted for the trace first.
+    const File* file = desc.file;
+    const PageId pageNo = desc.pageNo;
+    desc.state->unpin();
+    if (dirty)
+      desc.state->set(FrameState::DIRTY);
+    lock.unlock();
+    traceEvent(TRACE_UNPIN, file, pageNo, dirty ? TRACE_DIRTY : 0);
+  }
+
+  ReadPageGuard BufMgr::readPageGuarded(File* file, const PageId pageNo)
+  {
+    FrameId frame;
+    Page* page = pinPage(file, pageNo, frame);
+    return ReadPageGuard(this, frame, page);
+  }
+
+  WritePageGuard BufMgr::writePageGuarded(File* file, const PageId pageNo)
+  {
+    if (file->isMapped())
+      throw FileIOException(file->filename(), EBADF);  // mapped files are read-only
+    FrameId frame;
+    Page* page = pinPage(file, pageNo, frame);
+    return WritePageGuard(this, frame, page);
+  }
+
+  WritePageGuard BufMgr::allocPageGuarded(File* file)
+  {
+    FrameId frame;
+    Page* page = allocPinnedPage(file, frame);
+    return WritePageGuard(this, frame, page);
+  }
+
+  void BufMgr::allocPages(File* file, const std::uint32_t count, std::vector<PageId>& pageNos, std::vector<Page*>& pages)
+  {
+    // Take all the frames first, so that running out of frames leaves the file untouched.  They stay latched
+    // until the pages are set up in them.
+    std::vector<FrameId> frames;
+    frames.reserve(count);
+    std::vector<Page*> newPages;
+    newPages.reserve(count);
+    try {
+      for (std::uint32_t i = 0; i < count; i++) {
+        FrameId f;
+        allocBuf(f);
+        frames.push_back(f);
+        newPages.push_back(&bufPool[f]);
+      }
+      file->allocatePages(newPages);
+      stats.count(StatsRecorder::ALLOCATIONS, count);
+    }
+    catch (...) {
+      for (std::size_t i = 0; i < frames.size(); i++) {
+        releaseFrame(frames[i]);
+        bufDescTable[frames[i]].latch.unlock();
+      }
+      throw;
+    }
+
+    for (std::uint32_t i = 0; i < count; i++) {
+      const FrameId f = frames[i];
+      const PageId pageNo = bufPool[f].page_number();
+      hashTable->insert(file, pageNo, f);
+      bufDescTable[f].Set(file, pageNo);
+      linkFrame(f);
+      policy->loaded(f, file, pageNo);
+      bufDescTable[f].latch.unlock();
+      traceEvent(TRACE_ALLOC, file, pageNo);
+      pageNos.push_back(pageNo);
+      pages.push_back(&bufPool[f]);
+    }
   }
 
 	/**
@@ -195,44 +754,503 @@
 	 */
   void BufMgr::flushFile(const File* file) 
   {
-    for (size_t i = 0; i < numBufs; i++)
-    { 
-      BufDesc frame = bufDescTable[i];
-      if (!frame.valid)
-        throw BadBufferException(frame.frameNo, frame.dirty, frame.valid, frame.refbit);
-      
-      if (frame.file == file)
-      {
-          if(frame.pinCnt != 0)
+    file->waitForBackgroundReads();
+    std::lock_guard<std::mutex> checkpointGuard(checkpointLatch);
+    // Only the frames on the file's list are visited.  Dirty frames stay latched (taken in frame order) until
+    // they have been written, so that they cannot be pinned or evicted in between.
+    std::vector<FrameId> candidates;
+    residentFrames(file, candidates);
+    std::vector<std::pair<PageId, FrameId> > dirtyFrames;
+    try {
+      for (size_t i = 0; i < candidates.size(); i++)
+      { 
+        BufDesc& frame = bufDescTable[candidates[i]];
+        std::unique_lock<std::mutex> lock(frame.latch);
+        waitUntilCleaned(frame, lock);
+
+        if (frame.file == file)
+        {
+          if (!frame.state->valid())
+            throw BadBufferException(frame.frameNo, frame.state->dirty(), frame.state->valid(),
+                                     frame.state->referenced());
+          if(frame.state->pinCnt() != 0)
             throw PagePinnedException(frame.file->filename(), frame.pageNo, frame.frameNo);
-          if(frame.dirty) {        
-          frame.file->writePage(bufPool[i]);
-          frame.dirty = false;
-        }      
-        hashTable->remove(frame.file, frame.pageNo);
-        frame.Clear();
+          if(frame.state->dirty()) {        
+            dirtyFrames.push_back(std::make_pair(frame.pageNo, frame.frameNo));
+            lock.release();
+            continue;
+          }      
+          hashTable->remove(frame.file, frame.pageNo);
+          unlinkFrame(frame.frameNo);
+          frame.Clear();
+          policy->removed(frame.frameNo);
+          releaseFrame(frame.frameNo);
+        }
       }
+
+      if (!dirtyFrames.empty()) {
+        // Written in page order, so that runs of adjacent pages go out as single writes, and synced once.
+        std::sort(dirtyFrames.begin(), dirtyFrames.end());
+        std::vector<const Page*> pages;
+        pages.reserve(dirtyFrames.size());
+        Lsn maxLsn = LogManager::INVALID_LSN;
+        for (size_t i = 0; i < dirtyFrames.size(); i++) {
+          pages.push_back(&bufPool[dirtyFrames[i].second]);
+          maxLsn = std::max(maxLsn, pages.back()->lsn());
+        }
+        flushLog(maxLsn);
+        File* dirtyFile = bufDescTable[dirtyFrames[0].second].file;
+        const std::uint64_t start = StatsRecorder::now();
+        dirtyFile->writePages(pages);
+        recordWrite(dirtyFile, pages.size(), start);
+        dirtyFile->sync();
+      }
+    }
+    catch (...) {
+      for (size_t i = 0; i < dirtyFrames.size(); i++)
+        bufDescTable[dirtyFrames[i].second].latch.unlock();
+      throw;
+    }
+
+    for (size_t i = 0; i < dirtyFrames.size(); i++) {
+      BufDesc& frame = bufDescTable[dirtyFrames[i].second];
+      hashTable->remove(frame.file, frame.pageNo);
+      unlinkFrame(frame.frameNo);
+      frame.Clear();
+      policy->removed(frame.frameNo);
+      releaseFrame(frame.frameNo);
+      frame.latch.unlock();
     }
   }
   
+  CheckpointProgress BufMgr::checkpoint(const std::uint32_t batch)
+  {
+    std::lock_guard<std::mutex> guard(checkpointLatch);
+    LogManager* logManager = log;
+    CheckpointProgress progress;
+    if (logManager != NULL)
+      progress.beginLsn = logManager->append(LOG_CHECKPOINT_BEGIN, NULL, 0);
+    {
+      std::lock_guard<std::mutex> progressGuard(checkpointProgressLatch);
+      lastCheckpoint = progress;
+    }
+
+    std::vector<File*> written;
+    FrameId next = 0;
+    while (next < numBufs)
+      checkpointBatch(next, std::max<std::uint32_t>(batch, 1), written);
+
+    for (size_t i = 0; i < written.size(); i++)
+      written[i]->sync();
+    if (logManager != NULL)
+      logManager->flush(logManager->append(LOG_CHECKPOINT_END, &progress.beginLsn, sizeof(progress.beginLsn)));
+
+    std::lock_guard<std::mutex> progressGuard(checkpointProgressLatch);
+    lastCheckpoint.done = true;
+    return lastCheckpoint;
+  }
+
+  std::future<CheckpointProgress> BufMgr::checkpointAsync(const std::uint32_t batch)
+  {
+    return engine().submit([this, batch]() { return checkpoint(batch); });
+  }
+
+  CheckpointProgress BufMgr::checkpointProgress() const
+  {
+    std::lock_guard<std::mutex> guard(checkpointProgressLatch);
+    return lastCheckpoint;
+  }
+
+  void BufMgr::checkpointBatch(FrameId& next, const std::uint32_t batch, std::vector<File*>& written)
+  {
+    struct Copy {
+      File* file;
+      PageId pageNo;
+      FrameId frame;
+      const Page* page;
+    };
+
+    std::vector<Page> pages;
+    pages.reserve(batch);
+    std::vector<Copy> copies;
+    std::uint32_t scanned = 0;
+    std::uint32_t deferred = 0;
+
+    // Copy under the frame latch, which only holds up threads pinning that very page.  The copy is marked clean
+    // right away: pinning threads that change the page unpin it dirty again.  Pinned pages may be halfway through a
+    // change, so they are left for a later checkpoint.  A page the background writer is writing out is waited for.
+    for (; next < numBufs && pages.size() < batch; next++) {
+      scanned++;
+      const std::uint32_t state = frameStates[next].load();
+      if ((state & (FrameState::VALID | FrameState::DIRTY)) != (FrameState::VALID | FrameState::DIRTY))
+        continue;
+
+      BufDesc& desc = bufDescTable[next];
+      std::unique_lock<std::mutex> lock(desc.latch);
+      waitUntilCleaned(desc, lock);
+      if (!desc.state->valid() || !desc.state->dirty())
+        continue;
+      if (desc.state->pinCnt() != 0) {
+        deferred++;
+        continue;
+      }
+      pages.push_back(bufPool[next]);
+      Copy copy = {desc.file, desc.pageNo, next, NULL};
+      copies.push_back(copy);
+      desc.state->clear(FrameState::DIRTY);
+      desc.state->set(FrameState::CLEANING);
+    }
+    for (size_t i = 0; i < copies.size(); i++)
+      copies[i].page = &pages[i];
+
+    std::uint32_t pagesWritten = 0;
+    try {
+      std::sort(copies.begin(), copies.end(), [](const Copy& a, const Copy& b) {
+        return a.file != b.file ? a.file < b.file : a.pageNo < b.pageNo;
+      });
+      Lsn maxLsn = LogManager::INVALID_LSN;
+      for (size_t i = 0; i < copies.size(); i++)
+        maxLsn = std::max(maxLsn, copies[i].page->lsn());
+      flushLog(maxLsn);
+
+      // One sorted, coalesced write per file, as in flushFile().  Should a page have been deleted since it was
+      // copied, the file's pages are written one by one and the deleted ones skipped.
+      for (size_t start = 0; start < copies.size(); ) {
+        size_t end = start;
+        std::vector<const Page*> run;
+        for (; end < copies.size() && copies[end].file == copies[start].file; end++)
+          run.push_back(copies[end].page);
+        File* file = copies[start].file;
+        try {
+          const std::uint64_t writeStart = StatsRecorder::now();
+          file->writePages(run);
+          recordWrite(file, run.size(), writeStart);
+          pagesWritten += run.size();
+        }
+        catch (InvalidPageException&) {
+          for (size_t i = 0; i < run.size(); i++) {
+            try {
+              const std::uint64_t writeStart = StatsRecorder::now();
+              file->writePage(*run[i]);
+              recordWrite(file, 1, writeStart);
+              pagesWritten++;
+            }
+            catch (InvalidPageException&) {
+            }
+          }
+        }
+        if (std::find(written.begin(), written.end(), file) == written.end())
+          written.push_back(file);
+        start = end;
+      }
+    }
+    catch (...) {
+      // Pages whose copy may not have been written are dirty again.
+      for (size_t i = 0; i < copies.size(); i++) {
+        BufDesc& desc = bufDescTable[copies[i].frame];
+        std::lock_guard<std::mutex> guard(desc.latch);
+        if (desc.state->valid() && desc.file == copies[i].file && desc.pageNo == copies[i].pageNo)
+          desc.state->set(FrameState::DIRTY);
+        desc.state->clear(FrameState::CLEANING);
+      }
+      cleaned.notify_all();
+      throw;
+    }
+
+    for (size_t i = 0; i < copies.size(); i++) {
+      BufDesc& desc = bufDescTable[copies[i].frame];
+      std::lock_guard<std::mutex> guard(desc.latch);
+      desc.state->clear(FrameState::CLEANING);
+    }
+    cleaned.notify_all();
+
+    std::lock_guard<std::mutex> progressGuard(checkpointProgressLatch);
+    lastCheckpoint.framesScanned += scanned;
+    lastCheckpoint.pagesWritten += pagesWritten;
+    lastCheckpoint.pagesDeferred += deferred;
+  }
+
+  void BufMgr::waitUntilCleaned(BufDesc& desc, std::unique_lock<std::mutex>& lock)
+  {
+    while (desc.state->cleaning())
+      cleaned.wait(lock);
+  }
+
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number
+   * @throws  InvalidPageException If the page is not a used page of the file
 	 */
   void BufMgr::disposePage(File* file, const PageId PageNo)
   {
     FrameId f;
-    try {
-    hashTable->lookup(file, PageNo, f);
-    hashTable->remove(file, PageNo);
-    bufDescTable[f].Clear();
+    if (hashTable->tryLookup(file, PageNo, f)) {
+      std::unique_lock<std::mutex> lock(bufDescTable[f].latch);
+      waitUntilCleaned(bufDescTable[f], lock);
+      if (bufDescTable[f].state->valid() && bufDescTable[f].file == file && bufDescTable[f].pageNo == PageNo) {
+        hashTable->remove(file, PageNo);
+        unlinkFrame(f);
+        bufDescTable[f].Clear();
+        policy->removed(f);
+        releaseFrame(f);
+      }
+    }
     file->deletePage(PageNo);
-    } catch (...){/*do nothing*/}
+    traceEvent(TRACE_DISPOSE, file, PageNo);
   }
   
+  void BufMgr::saveResidentSet(const std::string& filename)
+  {
+    // The policy lists the frames coldest first; any it leaves out go first, as the hottest.
+    std::vector<FrameId> coldestFirst;
+    policy->upcomingVictims(numBufs, coldestFirst);
+    std::vector<bool> listed(numBufs, false);
+    for (std::size_t i = 0; i < coldestFirst.size(); i++)
+      listed[coldestFirst[i]] = true;
+    std::vector<FrameId> order;
+    order.reserve(numBufs);
+    for (FrameId f = 0; f < numBufs; f++) {
+      if (!listed[f])
+        order.push_back(f);
+    }
+    order.insert(order.end(), coldestFirst.rbegin(), coldestFirst.rend());
+
+    std::vector<std::string> names;
+    std::map<std::string, std::uint32_t> fileIndices;
+    std::vector<ResidentPage> pages;
+    for (std::size_t i = 0; i < order.size(); i++) {
+      BufDesc& desc = bufDescTable[order[i]];
+      std::lock_guard<std::mutex> guard(desc.latch);
+      if (!desc.state->valid())
+        continue;
+      std::map<std::string, std::uint32_t>::iterator known = fileIndices.find(desc.file->filename());
+      if (known == fileIndices.end()) {
+        known = fileIndices.insert(std::make_pair(desc.file->filename(), static_cast<std::uint32_t>(names.size()))).first;
+        names.push_back(desc.file->filename());
+      }
+      ResidentPage page = {known->second, desc.pageNo, desc.state->referenced() ? RESIDENT_REFERENCED : 0};
+      pages.push_back(page);
+    }
+
+    std::vector<char> contents;
+    ResidentSetHeader header = {RESIDENT_SET_MAGIC, RESIDENT_SET_VERSION, Page::SIZE,
+                                static_cast<std::uint32_t>(names.size()), static_cast<std::uint32_t>(pages.size())};
+    appendBytes(contents, header);
+    for (std::size_t i = 0; i < names.size(); i++) {
+      appendBytes(contents, static_cast<std::uint32_t>(names[i].size()));
+      contents.insert(contents.end(), names[i].begin(), names[i].end());
+    }
+    for (std::size_t i = 0; i < pages.size(); i++)
+      appendBytes(contents, pages[i]);
+
+    // Write a new file and rename it over the old one, so that the list is never seen half written.
+    const std::string temporary = filename + ".tmp";
+    const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      throw FileIOException(temporary, errno);
+    std::size_t done = 0;
+    while (done < contents.size()) {
+      const ssize_t count = ::write(fd, contents.data() + done, contents.size() - done);
+      if (count < 0) {
+        if (errno == EINTR)
+          continue;
+        const int error = errno;
+        ::close(fd);
+        throw FileIOException(temporary, error);
+      }
+      done += count;
+    }
+    if (::fsync(fd) != 0) {
+      const int error = errno;
+      ::close(fd);
+      throw FileIOException(temporary, error);
+    }
+    if (::close(fd) != 0)
+      throw FileIOException(temporary, errno);
+    if (::rename(temporary.c_str(), filename.c_str()) != 0)
+      throw FileIOException(filename, errno);
+  }
+
+  std::uint32_t BufMgr::preloadResidentSet(const std::string& filename, const std::vector<File*>& files,
+                                           const std::uint32_t batch)
+  {
+    std::vector<char> contents;
+    {
+      const int fd = ::open(filename.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw FileIOException(filename, errno);
+      char chunk[1 << 16];
+      for (;;) {
+        const ssize_t count = ::read(fd, chunk, sizeof(chunk));
+        if (count < 0) {
+          if (errno == EINTR)
+            continue;
+          const int error = errno;
+          ::close(fd);
+          throw FileIOException(filename, error);
+        }
+        if (count == 0)
+          break;
+        contents.insert(contents.end(), chunk, chunk + count);
+      }
+      ::close(fd);
+    }
+
+    std::size_t position = 0;
+    ResidentSetHeader header;
+    if (!takeBytes(contents, position, &header, sizeof(header)) || header.magic != RESIDENT_SET_MAGIC ||
+        header.version != RESIDENT_SET_VERSION || header.page_size != Page::SIZE)
+      throw FileIOException(filename, EINVAL);
+    // Files of the list by index; NULL for those not given.
+    std::vector<File*> listFiles(header.num_files, static_cast<File*>(NULL));
+    for (std::uint32_t i = 0; i < header.num_files; i++) {
+      std::uint32_t length;
+      if (!takeBytes(contents, position, &length, sizeof(length)) || contents.size() - position < length)
+        throw FileIOException(filename, EINVAL);
+      const std::string name(contents.data() + position, length);
+      position += length;
+      for (std::size_t f = 0; f < files.size(); f++) {
+        if (files[f]->filename() == name && !files[f]->isMapped())
+          listFiles[i] = files[f];
+      }
+    }
+    std::vector<ResidentPage> listed(header.num_pages);
+    if (header.num_pages > 0 && !takeBytes(contents, position, &listed[0], listed.size() * sizeof(ResidentPage)))
+      throw FileIOException(filename, EINVAL);
+
+    // Keep the hottest pages that fit into the free frames, then read them in file order.
+    std::size_t freeCount = 0;
+    {
+      std::lock_guard<std::mutex> guard(freeFramesLatch);
+      for (std::uint32_t p = 0; p < numPartitions; p++)
+        freeCount += freeFrames[p].size();
+    }
+    std::vector<ResidentPage> chosen;
+    for (std::size_t i = 0; i < listed.size() && chosen.size() < freeCount; i++) {
+      if (listed[i].file < listFiles.size() && listFiles[listed[i].file] != NULL)
+        chosen.push_back(listed[i]);
+    }
+    std::vector<std::size_t> sorted(chosen.size());
+    for (std::size_t i = 0; i < sorted.size(); i++)
+      sorted[i] = i;
+    std::sort(sorted.begin(), sorted.end(), [&chosen](const std::size_t a, const std::size_t b) {
+      return chosen[a].file != chosen[b].file ? chosen[a].file < chosen[b].file : chosen[a].pageNo < chosen[b].pageNo;
+    });
+
+    std::vector<std::future<std::vector<FrameId> > > runs;
+    std::vector<std::size_t> runStarts;
+    const std::uint32_t runLength = std::max<std::uint32_t>(batch, 1);
+    for (std::size_t start = 0; start < sorted.size(); ) {
+      const ResidentPage& first = chosen[sorted[start]];
+      std::size_t end = start + 1;
+      while (end < sorted.size() && end - start < runLength && chosen[sorted[end]].file == first.file &&
+             chosen[sorted[end]].pageNo == chosen[sorted[end - 1]].pageNo + 1)
+        end++;
+      File* file = listFiles[first.file];
+      std::vector<PageId> pageNos;
+      for (std::size_t i = start; i < end; i++)
+        pageNos.push_back(chosen[sorted[i]].pageNo);
+      runs.push_back(engine().submit([this, file, pageNos]() { return preloadRun(file, pageNos); }));
+      runStarts.push_back(start);
+      start = end;
+    }
+    // Frame read for each chosen page, or NO_FRAME.
+    std::vector<FrameId> frames(chosen.size(), BufDesc::NO_FRAME);
+    std::exception_ptr failure;
+    for (std::size_t r = 0; r < runs.size(); r++) {
+      try {
+        const std::vector<FrameId> runFrames = runs[r].get();
+        for (std::size_t i = 0; i < runFrames.size(); i++)
+          frames[sorted[runStarts[r] + i]] = runFrames[i];
+      }
+      catch (...) {
+        if (!failure)
+          failure = std::current_exception();
+      }
+    }
+
+    // Publish the pages coldest first, each presented to the policy once as just loaded, so that the hottest are
+    // the most recently loaded, and put their reference bits back as they were.  A page some reader loaded itself
+    // meanwhile keeps that frame.
+    std::uint32_t loaded = 0;
+    for (std::size_t i = chosen.size(); i > 0; i--) {
+      const FrameId f = frames[i - 1];
+      if (f == BufDesc::NO_FRAME)
+        continue;
+      const ResidentPage& page = chosen[i - 1];
+      File* file = listFiles[page.file];
+      BufDesc& desc = bufDescTable[f];
+      std::lock_guard<std::mutex> guard(desc.latch);
+      if (!hashTable->tryInsert(file, page.pageNo, f)) {
+        releaseFrame(f);
+        continue;
+      }
+      desc.Set(file, page.pageNo);
+      desc.state->unpin();
+      linkFrame(f);
+      policy->loaded(f, file, page.pageNo);
+      if ((page.flags & RESIDENT_REFERENCED) == 0)
+        desc.state->clear(FrameState::REFERENCED);
+      loaded++;
+    }
+    if (failure)
+      std::rethrow_exception(failure);
+    return loaded;
+  }
+
+  std::vector<FrameId> BufMgr::preloadRun(File* file, const std::vector<PageId>& pageNos)
+  {
+    // Claim a free frame for every page not yet resident.  Until preloadResidentSet() publishes them the frames
+    // are neither free nor in the hash table, so nobody else touches them and they need not stay latched.
+    std::vector<FrameId> frames(pageNos.size(), BufDesc::NO_FRAME);
+    for (std::size_t i = 0; i < pageNos.size(); i++) {
+      FrameId f;
+      if (hashTable->tryLookup(file, pageNos[i], f))
+        continue;
+      if (!takeFreeFrame(f))
+        break;  // the pool filled up meanwhile
+      bufDescTable[f].latch.unlock();
+      frames[i] = f;
+    }
+
+    std::uint32_t read = 0;
+    for (std::size_t start = 0; start < frames.size(); ) {
+      if (frames[start] == BufDesc::NO_FRAME) {
+        start++;
+        continue;
+      }
+      std::size_t end = start + 1;
+      while (end < frames.size() && frames[end] != BufDesc::NO_FRAME)
+        end++;
+      std::vector<Page*> pages;
+      for (std::size_t i = start; i < end; i++)
+        pages.push_back(&bufPool[frames[i]]);
+      try {
+        file->readPages(pageNos[start], pages);
+        read += end - start;
+      }
+      catch (...) {
+        // Find out which pages are bad, one at a time.
+        for (std::size_t i = start; i < end; i++) {
+          try {
+            file->readPage(pageNos[i], bufPool[frames[i]]);
+            read++;
+          }
+          catch (...) {
+            releaseFrame(frames[i]);  // a preload is best effort; the page is read again when it is used
+            frames[i] = BufDesc::NO_FRAME;
+          }
+        }
+      }
+      start = end;
+    }
+    stats.count(StatsRecorder::DISK_READS, read);
+    return frames;
+  }
+
 	/**
    * Print member variable values. 
 	 */
@@ -247,10 +1265,11 @@
       std::cout << "FrameNo:" << i << " ";
       tmpbuf->Print();
 
-      if (tmpbuf->valid == true)
+      if (tmpbuf->state->valid() == true)
         validFrames++;
     }
 
     std::cout << "Total Number of Valid Frames:" << validFrames << "\n";
+    policy->printSelf();
   }
 }
@@ -7,8 +7,25 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
 #include "file.h"
 #include "bufHashTbl.h"
+#include "buf_stats.h"
+#include "buf_trace.h"
+#include "io_engine.h"
+#include "log_manager.h"
+#include "memory_arena.h"
+#include "replacement_policy.h"
 
 namespace badgerdb {
 
@@ -16,6 +33,75 @@ namespace badgerdb {
 * forward declaration of BufMgr class 
 */
 class BufMgr;
+class PageGuard;
+class ReadPageGuard;
+class WritePageGuard;
+
+/**
+* @brief Eviction-relevant state of a buffer pool frame packed into one word: the valid, dirty and reference bits and
+*        the pin count.
+*
+* BufMgr keeps the words of all frames in one array, separate from the BufDesc table, so that a clock sweep reads 16
+* frames per cache line and can pass over pinned or invalid frames without touching their descriptors.  Every change
+* is an atomic read-modify-write; valid and dirty are only changed with the frame latch held.
+*
+* CLEANING marks a frame whose copy a checkpoint or the background writer is writing out (see BufMgr::checkpoint());
+* such a frame is not evicted or written by anyone else until the copy is on disk, so an older copy can never
+* overwrite a newer one.
+*/
+class FrameState {
+ public:
+  static const std::uint32_t VALID = 1u << 31;
+  static const std::uint32_t DIRTY = 1u << 30;
+  static const std::uint32_t REFERENCED = 1u << 29;
+  static const std::uint32_t CLEANING = 1u << 28;
+  static const std::uint32_t PIN_MASK = CLEANING - 1;
+
+  FrameState() : word(0) {}
+
+	/**
+   * Returns the whole state word
+	 */
+  std::uint32_t load() const { return word.load(); }
+
+  bool valid() const { return (load() & VALID) != 0; }
+  bool dirty() const { return (load() & DIRTY) != 0; }
+  bool referenced() const { return (load() & REFERENCED) != 0; }
+  bool cleaning() const { return (load() & CLEANING) != 0; }
+  std::uint32_t pinCnt() const { return load() & PIN_MASK; }
+
+	/**
+   * Returns true if a state word describes a valid, unpinned frame that no checkpoint is writing, i.e. one that may
+   * be evicted
+	 */
+  static bool evictable(const std::uint32_t state)
+  {
+    return (state & (VALID | CLEANING)) == VALID && (state & PIN_MASK) == 0;
+  }
+
+  void pin() { word.fetch_add(1); }
+  void unpin() { word.fetch_sub(1); }
+
+	/**
+   * Sets the given flags
+	 */
+  void set(const std::uint32_t flags) { word.fetch_or(flags); }
+
+	/**
+	 * Clears the given flags
+	 *
+	 * @return  True if any of them was set.
+	 */
+  bool clear(const std::uint32_t flags) { return (word.fetch_and(~flags) & flags) != 0; }
+
+	/**
+   * Replaces the whole state word
+	 */
+  void reset(const std::uint32_t state) { word.store(state); }
+
+ private:
+  std::atomic<std::uint32_t> word;
+};
 
 /**
 * @brief Class for maintaining information about buffer pool frames
@@ -41,36 +127,31 @@ class BufDesc {
   FrameId	frameNo;
 
 	/**
-   * Number of times this page has been pinned
-	 */
-  int pinCnt;
-
-	/**
-   * True if page is dirty;  false otherwise
+   * Valid, dirty and reference bits and pin count of this frame, in BufMgr's state array
 	 */
-  bool dirty;
+  FrameState* state;
 
 	/**
-   * True if page is valid
+   * Neighbours of this frame in the list of frames holding pages of the same file (see BufMgr::fileFrames), or
+   * NO_FRAME at either end of the list
 	 */
-  bool valid;
+  FrameId prevInFile;
+  FrameId nextInFile;
 
 	/**
-   * Has this buffer frame been reference recently
+   * Latch protecting the assignment of this frame (file, pageNo, valid, dirty) and the
+   * contents of the frame while it is being read in or written out
 	 */
-  bool refbit;
+  std::mutex latch;
 
 	/**
    * Initialize buffer frame for a new user
 	 */
   void Clear()
 	{
-    pinCnt = 0;
 		file = NULL;
 		pageNo = Page::INVALID_NUMBER;
-    dirty = false;
-    refbit = false;
-		valid = false;
+    state->reset(0);
   };
 
 	/**
@@ -84,10 +165,7 @@ class BufDesc {
 	{ 
 		file = filePtr;
     pageNo = pageNum;
-    pinCnt = 1;
-    dirty = false;
-    valid = true;
-    refbit = true;
+    state->reset(FrameState::VALID | FrameState::REFERENCED | 1);  // valid, clean and pinned once
   }
 
   void Print()
@@ -100,10 +178,10 @@ class BufDesc {
 		else
 			std::cout << "file:NULL ";
 
-		std::cout << "valid:" << valid << " ";
-		std::cout << "pinCnt:" << pinCnt << " ";
-		std::cout << "dirty:" << dirty << " ";
-		std::cout << "refbit:" << refbit << "\n";
+		std::cout << "valid:" << state->valid() << " ";
+		std::cout << "pinCnt:" << state->pinCnt() << " ";
+		std::cout << "dirty:" << state->dirty() << " ";
+		std::cout << "refbit:" << state->referenced() << "\n";
   }
 
 	/**
@@ -111,60 +189,77 @@ class BufDesc {
 	 */
   BufDesc()
 	{
-  	Clear();
+		file = NULL;
+		pageNo = Page::INVALID_NUMBER;
+    state = NULL;
+    prevInFile = nextInFile = NO_FRAME;
   }
+
+ public:
+	/**
+   * Frame number marking the end of a frame list
+	 */
+  static const FrameId NO_FRAME = ~static_cast<FrameId>(0);
 };
 
 
 /**
-* @brief Class to maintain statistics of buffer usage 
+* @brief Progress of a checkpoint
 */
-struct BufStats
+struct CheckpointProgress
 {
 	/**
-   * Total number of accesses to buffer pool
+   * LSN of the checkpoint's LOG_CHECKPOINT_BEGIN record, or INVALID_LSN without a log
 	 */
-  int accesses;
+  Lsn beginLsn;
 
 	/**
-   * Number of pages read from disk (including allocs)
+   * Number of frames examined so far
 	 */
-  int diskreads;
+  std::uint32_t framesScanned;
 
 	/**
-   * Number of pages written back to disk
+   * Number of dirty pages written out
 	 */
-  int diskwrites;
+  std::uint32_t pagesWritten;
 
 	/**
-   * Clear all values 
+   * Number of dirty pages left for a later checkpoint because they were pinned, as their holders may be halfway
+   * through a change; pinned dirty pages are always deferred, with or without a log
 	 */
-  void clear()
-  {
-		accesses = diskreads = diskwrites = 0;
-  }
-      
+  std::uint32_t pagesDeferred;
+
 	/**
-   * Constructor of BufStats class 
+   * True once the checkpoint has finished
 	 */
-  BufStats()
+  bool done;
+
+  CheckpointProgress()
+    : beginLsn(LogManager::INVALID_LSN), framesScanned(0), pagesWritten(0), pagesDeferred(0), done(false)
   {
-		clear();
   }
 };
 
 
 /**
 * @brief The central class which manages the buffer pool including frame allocation and deallocation to pages in the file 
+*
+* All public methods may be called concurrently from multiple threads.  Each frame is guarded by the latch in its
+* BufDesc, the hash table is guarded by per-partition latches and the replacement policy synchronizes itself, so
+* there is no pool-wide lock on the hit path.  Latches are always acquired in the order frame latch, hash table
+* partition latch, file latch; the policy's, the free list's and the file frame lists' latches are taken after a frame
+* latch, and while holding them frame latches are only ever try-locked.
+*
+* Frames that hold no page are kept on a free list and handed out first.  Once the pool is full, the
+* ReplacementPolicy chosen at construction picks the victims.
+*
+* The frames live in a MemoryArena, backed by huge pages where the system provides them.  On NUMA machines the pool
+* can be split into one partition per node, each placed in its node's memory; threads then take free frames (and,
+* under CLOCK, victims) from the partition of the node they run on before falling back to the others.
 */
 class BufMgr 
 {
  private:
-	/**
-   * Current position of clockhand in our buffer pool
-	 */
-  FrameId clockHand;
-
 	/**
    * Number of frames in the buffer pool
 	 */
@@ -180,24 +275,321 @@ class BufMgr
 	 */
   BufDesc *bufDescTable;
 
+	/**
+   * State words of all frames, indexed by frame number and pointed to by the descriptors
+	 */
+  FrameState *frameStates;
+
 	/**
    * Maintains Buffer pool usage statistics 
 	 */
-  BufStats bufStats;
+  StatsRecorder stats;
 
 	/**
-   * Advance clock to next frame in the buffer pool
+   * Records page accesses while a trace is started (see startTrace())
 	 */
-  void advanceClock();
+  TraceRecorder trace;
 
 	/**
-	 * Allocate a free frame.  
+   * Number of worker threads, and hence of reads that can be in flight at once, used for asynchronous requests
+	 */
+  static const unsigned NUM_IO_THREADS = 32;
+
+	/**
+   * Engine running asynchronous requests; started on first use
+	 */
+  IOEngine* ioEngine;
+
+	/**
+   * Guards the start of ioEngine
+	 */
+  std::once_flag ioEngineStarted;
+
+	/**
+   * Returns the I/O engine, starting it if necessary
+	 */
+  IOEngine& engine();
+
+	/**
+   * Write-ahead log the pool writes pages back under, or NULL
+	 */
+  std::atomic<LogManager*> log;
+
+	/**
+   * Serializes checkpoints with each other and with flushFile(), whose writes could otherwise race with the writes
+   * of a checkpoint's copies.  Taken before any frame latch.
+	 */
+  std::mutex checkpointLatch;
+
+	/**
+   * Progress of the current or latest checkpoint
+	 */
+  CheckpointProgress lastCheckpoint;
+
+	/**
+   * Guards lastCheckpoint
+	 */
+  mutable std::mutex checkpointProgressLatch;
+
+	/**
+   * Signalled whenever CLEANING is cleared on frames, for threads waiting in waitUntilCleaned().  Waited on with
+   * the latch of the frame, which is why it is a condition_variable_any.
+	 */
+  std::condition_variable_any cleaned;
+
+	/**
+   * Waits, with the frame latch held by <lock>, until no copy of the frame is being written out
+	 */
+  void waitUntilCleaned(BufDesc& desc, std::unique_lock<std::mutex>& lock);
+
+	/**
+	 * Copies a batch of dirty frames, marking them CLEANING, writes the copies out and clears the marks.
+	 *
+	 * @param next   	Frame to continue the scan at; advanced past the frames examined
+	 * @param batch   Maximum number of pages copied
+	 * @param written Files written to, to be synced at the end of the checkpoint
+	 */
+  void checkpointBatch(FrameId& next, const std::uint32_t batch, std::vector<File*>& written);
+
+	/**
+	 * Makes the log, if any, durable up to the given page LSN, so that a page is never on disk before the log
+	 * records of its changes.
+	 */
+  void flushLog(const Lsn lsn);
+
+	/**
+	 * Counts an access served from the pool; if it was picked by StatsRecorder::Local::sample(), also its latency
+	 * from the given StatsRecorder::now() time.
+	 */
+  void recordHit(StatsRecorder::Local& local, const File* file, const bool timed, const std::uint64_t start);
+
+	/**
+	 * Counts pages written to a file by a write that started at the given StatsRecorder::now() time.
+	 */
+  void recordWrite(const File* file, const std::uint32_t pages, const std::uint64_t start);
+
+	/**
+	 * Adds an event to the trace, if one is started.
+	 */
+  void traceEvent(const TraceEventType type, const File* file, const PageId pageNo, const std::uint8_t flags = 0)
+  {
+    if (trace.active())
+      trace.record(type, file, pageNo, flags);
+  }
+
+	/**
+	 * Pins the given page if it is resident and its frame is not busy, without ever blocking.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 * @param page  	Reference to page pointer, set to the frame if the page could be pinned
+	 * @return  True if the page was pinned.
+	 */
+  bool tryPinResident(File* file, const PageId pageNo, Page*& page);
+
+	/**
+	 * Loads the given page into a frame for prefetchPages(), leaving it unpinned, unless it is already resident.
+	 * Unlike readPage() this is no access: only the disk read is counted in the statistics, and nothing is traced.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file
+	 */
+  void prefetchPage(File* file, const PageId pageNo);
+
+	/**
+   * Policy choosing which frame to evict
+	 */
+  ReplacementPolicy* policy;
+
+	/**
+   * Memory holding the frames of bufPool
+	 */
+  MemoryArena* arena;
+
+	/**
+   * Number of NUMA partitions the frames are split into.  Partition p holds the frames from
+   * p * (numBufs / numPartitions), with the last one also taking the remainder.
+	 */
+  std::uint32_t numPartitions;
+
+	/**
+   * Returns the partition holding a frame
+	 */
+  std::uint32_t partitionOf(const FrameId frame) const;
+
+	/**
+   * Frames holding no page, per partition, handed out before any frame is evicted
+	 */
+  std::vector<std::vector<FrameId> > freeFrames;
+
+	/**
+   * Latch guarding freeFrames
+	 */
+  std::mutex freeFramesLatch;
+
+	/**
+   * First frame of each file's list of resident frames, linked through BufDesc::prevInFile/nextInFile
+	 */
+  std::map<const File*, FrameId> fileFrames;
+
+	/**
+   * Latch guarding fileFrames and the list links in every BufDesc
+	 */
+  std::mutex fileFramesLatch;
+
+	/**
+	 * Adds a frame that has just been assigned a page to its file's frame list.  Caller must hold the frame's latch.
+	 *
+	 * @param frame   	Frame to add
+	 */
+  void linkFrame(const FrameId frame);
+
+	/**
+	 * Removes a frame whose page is about to leave the pool from its file's frame list.  Caller must hold the
+	 * frame's latch.
+	 *
+	 * @param frame   	Frame to remove
+	 */
+  void unlinkFrame(const FrameId frame);
+
+	/**
+	 * Lists the frames currently holding pages of a file.  Frames may change hands as soon as this returns, so
+	 * callers must check each frame's assignment under its latch.
+	 *
+	 * @param file   	File object
+	 * @param frames  Receives the frames, in ascending order
+	 */
+  void residentFrames(const File* file, std::vector<FrameId>& frames);
+
+	/**
+	 * Returns an emptied frame to the free list.  Caller must hold the frame's latch.
+	 *
+	 * @param frame   	Frame to return
+	 */
+  void releaseFrame(const FrameId frame);
+
+	/**
+   * Thread running the background writer, if started
+	 */
+  std::thread writerThread;
+
+	/**
+   * Latch guarding the background writer's settings below
+	 */
+  std::mutex writerLatch;
+
+	/**
+   * Wakes the background writer early: when it is stopped, or when a reader had to write a dirty victim itself
+	 */
+  std::condition_variable writerWake;
+
+	/**
+   * Set to ask the background writer to exit
+	 */
+  bool writerStop;
+
+	/**
+   * Maximum number of frames the background writer examines per round
+	 */
+  std::uint32_t writerBatch;
+
+	/**
+   * Time the background writer sleeps between rounds
+	 */
+  std::chrono::milliseconds writerInterval;
+
+	/**
+   * Main loop of the background writer thread
+	 */
+  void runBackgroundWriter();
+
+	/**
+	 * Writes out the given frame if it holds a dirty, unpinned page and its latch is free, and marks it clean.  As in
+	 * a checkpoint, the page is copied under the latch and marked CLEANING, and the copy is written with the latch
+	 * released, so that threads pinning the page do not wait for the write.
+	 *
+	 * @param frame   	Frame to clean
+	 * @return  True if the frame was written.
+	 */
+  bool cleanFrame(const FrameId frame);
+
+	/**
+	 * @brief Lets the replacement policy claim frames of this buffer pool: a frame is claimed by taking its latch,
+	 *        and only if it holds an unpinned page.
+	 */
+  class FrameClaimer : public VictimFilter {
+   public:
+    FrameClaimer(BufDesc* descTable, FrameState* states) : descTable_(descTable), states_(states), examined_(0) {}
+    virtual bool tryClaim(const FrameId frame);
+
+    /**
+     * Returns the number of frames the policy has offered so far
+     */
+    std::uint32_t examined() const { return examined_; }
+
+   private:
+    BufDesc* descTable_;
+    FrameState* states_;
+    std::uint32_t examined_;
+  };
+
+	/**
+	 * Pins the given page as readPage() does and also returns its frame.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file to be read
+	 * @param frame   Frame holding the page returned via this variable; BufDesc::NO_FRAME for a mapped file
+	 * @return  The pinned page.
+	 */
+  Page* pinPage(File* file, const PageId pageNo, FrameId& frame);
+
+	/**
+	 * Allocates a new page in the file as allocPage() does and also returns its frame.
+	 *
+	 * @param file   	File object
+	 * @param frame   Frame holding the page returned via this variable
+	 * @return  The pinned page.
+	 */
+  Page* allocPinnedPage(File* file, FrameId& frame);
+
+	/**
+	 * Unpins a page through the frame it was pinned in, without looking it up.
+	 *
+	 * @param frame   	Frame holding the pinned page; BufDesc::NO_FRAME is ignored
+	 * @param dirty		True if the page needs to be marked dirty
+	 */
+  void unPinFrame(const FrameId frame, const bool dirty);
+
+  friend class PageGuard;
+
+	/**
+	 * Allocate a free frame.  The returned frame is invalid and its latch is held by the caller, who must release
+	 * it once the frame has been set up.
 	 *
 	 * @param frame   	Frame reference, frame ID of allocated frame returned via this variable
 	 * @throws BufferExceededException If no such buffer is found which can be allocated
 	 */
   void allocBuf(FrameId & frame);
 
+	/**
+	 * Takes a frame from the free list, without evicting any page.  The frame's latch is held by the caller on
+	 * success, as after allocBuf().
+	 *
+	 * @param frame   	Frame ID of the frame taken returned via this variable
+	 * @return  False if the free list is empty.
+	 */
+  bool takeFreeFrame(FrameId& frame);
+
+	/**
+	 * Reads a run of consecutive pages of a file into free frames for preloadResidentSet(), which publishes them.
+	 * Pages already resident are left alone, and pages that cannot be read are left out.
+	 *
+	 * @param file   	File object
+	 * @param pageNos Numbers of the pages, ascending and consecutive
+	 * @return  Frame read for each page, or BufDesc::NO_FRAME; the frames are unlatched and not yet in the hash table.
+	 */
+  std::vector<FrameId> preloadRun(File* file, const std::vector<PageId>& pageNos);
+
  public:
 	/**
    * Actual buffer pool from which frames are allocated
@@ -206,8 +598,14 @@ class BufMgr
 
 	/**
    * Constructor of BufMgr class
+	 *
+	 * @param bufs   	Number of frames in the buffer pool
+	 * @param policyType	Replacement policy used to pick frames for eviction
+	 * @param numaNodes	Number of NUMA nodes to split the pool across; 1 leaves placement to the operating system.
+	 *              MemoryArena::availableNodes() gives the number of nodes of the machine.
 	 */
-  BufMgr(std::uint32_t bufs);
+  BufMgr(std::uint32_t bufs, ReplacementPolicy::Type policyType = ReplacementPolicy::CLOCK,
+         const std::uint32_t numaNodes = 1);
 	
 	/**
    * Destructor of BufMgr class
@@ -218,6 +616,8 @@ class BufMgr
 	 * Reads the given page from the file into a frame and returns the pointer to page.
 	 * If the requested page is already present in the buffer pool pointer to that frame is returned
 	 * otherwise a new frame is allocated from the buffer pool for reading the page.
+	 * Pages of files opened with File::openMapped() bypass the pool: the pointer returned points into the file's
+	 * mapping, must not be written through, and unpinning it is a no-op.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
@@ -225,6 +625,116 @@ class BufMgr
 	 */
   void readPage(File* file, const PageId PageNo, Page*& page);
 
+	/**
+	 * Reads the given page as readPage() does and returns a guard for reading it, which unpins the page when it goes
+	 * out of scope.  Requires page_guard.h.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file to be read
+	 * @return  Guard holding the pinned page.
+	 */
+  ReadPageGuard readPageGuarded(File* file, const PageId pageNo);
+
+	/**
+	 * Reads the given page as readPage() does and returns a guard for modifying it, which unpins the page when it goes
+	 * out of scope, marking it dirty if it was accessed for writing.  Requires page_guard.h.
+	 *
+	 * @param file   	File object
+	 * @param pageNo  Page number in the file to be read
+	 * @return  Guard holding the pinned page.
+	 * @throws  FileIOException If the file is mapped, and hence read-only
+	 */
+  WritePageGuard writePageGuarded(File* file, const PageId pageNo);
+
+	/**
+	 * Allocates a new, empty page in the file as allocPage() does and returns a guard for modifying it.
+	 * Requires page_guard.h.
+	 *
+	 * @param file   	File object
+	 * @return  Guard holding the pinned new page.
+	 */
+  WritePageGuard allocPageGuarded(File* file);
+
+	/**
+	 * Starts reading a batch of pages into the buffer pool and returns without waiting for the reads.
+	 * Pages that are already resident are pinned immediately; misses are read (evicting as needed) by the I/O
+	 * engine's worker threads, so many of them can be in flight at once.  Each future yields the pinned page as
+	 * readPage() would, or rethrows the exception readPage() would have thrown.  Every page obtained must be
+	 * unpinned with unPinPage().
+	 *
+	 * @param requests  (File, page number) pairs to read
+	 * @return  One future per request, in the same order
+	 */
+  std::vector<std::future<Page*> > readPagesAsync(const std::vector<std::pair<File*, PageId> >& requests);
+
+	/**
+	 * Asks for the given pages to be brought into the buffer pool in the background, without pinning them.
+	 * Pages that are already resident are skipped.  This is only a hint: pages that do not exist or cannot get a
+	 * frame are silently not loaded, and prefetched pages may be evicted again before they are used.  Loading a page
+	 * is not an access: it counts as a disk read but neither as a hit nor as a miss, and it is not traced.
+	 * The reads queued keep <file> in use, so flushFile() and destroying the File object wait for them.
+	 *
+	 * @param file   	File object
+	 * @param pageNos Page numbers in the file to load
+	 */
+  void prefetchPages(File* file, const std::vector<PageId>& pageNos);
+
+	/**
+	 * Starts a background writer thread that repeatedly asks the replacement policy for its next victims and writes
+	 * out the dirty, unpinned ones, so that readers needing a frame rarely have to write one first.  Frames that are
+	 * pinned or latched are skipped, and a failed write leaves the frame dirty for the foreground to retry.
+	 * Does nothing if the writer is already running.
+	 *
+	 * @param batch   	Maximum number of upcoming victims examined per round
+	 * @param intervalMs	Milliseconds between rounds
+	 */
+  void startBackgroundWriter(const std::uint32_t batch = 64, const unsigned intervalMs = 10);
+
+	/**
+	 * Stops the background writer, waiting for its current round to finish.  Called by the destructor.
+	 */
+  void stopBackgroundWriter();
+
+	/**
+	 * Takes a fuzzy checkpoint: writes out every page that is dirty when the checkpoint reaches its frame, in batches
+	 * of sorted writes, and syncs the files written.  Unlike flushFile() nothing is evicted, pinned pages do not make
+	 * it fail and readers are only held up while a frame is being copied: each dirty frame is copied under its latch,
+	 * marked clean and CLEANING, and the copy is written out while the page stays in use.  A page changed again
+	 * meanwhile is simply dirty again afterwards.  Pinned dirty pages are deferred, as their holders may be halfway
+	 * through a change; they are left dirty and counted in pagesDeferred.
+	 *
+	 * Under a log (see attachLog()) the checkpoint is bracketed by LOG_CHECKPOINT_BEGIN and LOG_CHECKPOINT_END
+	 * records.  Progress is available from checkpointProgress() while the checkpoint runs.  The files involved must
+	 * stay open until it finishes.
+	 *
+	 * @param batch   	Maximum number of pages copied and written at a time
+	 * @return  Final progress of the checkpoint.
+	 * @throws  FileIOException If a page cannot be written; pages not written stay dirty
+	 */
+  CheckpointProgress checkpoint(const std::uint32_t batch = 64);
+
+	/**
+	 * Runs checkpoint() on a background I/O thread.
+	 *
+	 * @param batch   	Maximum number of pages copied and written at a time
+	 * @return  Future yielding the final progress, or the exception the checkpoint threw.
+	 */
+  std::future<CheckpointProgress> checkpointAsync(const std::uint32_t batch = 64);
+
+	/**
+	 * Returns the progress of the running checkpoint, or of the last one if none is running.
+	 */
+  CheckpointProgress checkpointProgress() const;
+
+	/**
+	 * Puts the buffer pool under a write-ahead log: from now on, before a dirty page is written back (on eviction,
+	 * by the background writer or by flushFile()), the log is flushed up to the page's LSN.  Callers changing a page
+	 * log the change, stamp the page with Page::set_lsn() and unpin it dirty as usual; see LogManager.
+	 *
+	 * @param logManager	Log to follow, owned by the caller and outliving the buffer manager; NULL detaches it
+	 */
+  void attachLog(LogManager* logManager);
+
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
 	 *
@@ -245,10 +755,25 @@ class BufMgr
 	 */
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
+	/**
+	 * Allocates <count> new, empty pages at the end of the file at once and returns them pinned, as allocPage() would
+	 * for each.  The pages are set up directly in their frames and written out in large writes, with one update of
+	 * the file header; see File::allocatePages().  Every page must be unpinned with unPinPage().
+	 *
+	 * @param file   	File object
+	 * @param count   Number of pages to allocate
+	 * @param pageNos Receives the numbers of the new pages, which are consecutive
+	 * @param pages  	Receives pointers to the frames holding the new pages, in the same order
+	 * @throws BufferExceededException If not enough frames can be allocated; no pages are allocated then
+	 */
+  void allocPages(File* file, const std::uint32_t count, std::vector<PageId>& pageNos, std::vector<Page*>& pages);
+
 	/**
 	 * Writes out all dirty pages of the file to disk.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
+	 * The dirty pages are written in page number order, adjacent pages in a single write, and the file is synced once
+	 * at the end.  Pages of the file still being prefetched (see prefetchPages()) are waited for first.
 	 *
 	 * @param file   	File object
    * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
@@ -258,10 +783,13 @@ class BufMgr
 
 	/**
 	 * Delete page from file and also from buffer pool if present.
-	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
+	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.  Should a
+	 * checkpoint be writing out a copy of the page, waits for that first, so that the copy cannot land on the page
+	 * once it has been reused.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number
+   * @throws  InvalidPageException If the page is not a used page of the file
 	 */
   void disposePage(File* file, const PageId PageNo);
 
@@ -271,11 +799,71 @@ class BufMgr
   void  printSelf();
 
 	/**
-   * Get buffer pool usage statistics
+	 * Writes the list of pages resident in the pool, with their reference bits, to a file, from which
+	 * preloadResidentSet() warms up a later pool.  Pages are listed hottest first, in the replacement policy's
+	 * reverse eviction order.  Only page numbers are saved, not contents, so dirty pages must still be flushed.
+	 *
+	 * Can be called at any time, e.g. periodically or at shutdown: each frame is latched just long enough to read
+	 * its descriptor.  The file is replaced atomically, so a crash leaves the previous list in place.
+	 *
+	 * @param filename  Name of the file to write
+	 * @throws  FileIOException If the file cannot be written
+	 */
+  void saveResidentSet(const std::string& filename);
+
+	/**
+	 * Loads the pages listed by saveResidentSet() into free frames of the pool, as if they had been read, so that
+	 * the pool starts warm.  The hottest pages that fit into the free frames are chosen and read sorted by file and
+	 * page number, runs of consecutive pages in single vectored reads, several runs in parallel.  They are then handed
+	 * to the replacement policy as loaded, once each and hottest last, without counting any accesses, and their
+	 * reference bits are restored.  No page is evicted.
+	 *
+	 * Pages are matched to the given files by name; pages of other files, of mapped files, pages already resident
+	 * and pages that are no longer valid (deleted, or failing their checksum) are skipped.
+	 *
+	 * @param filename  Name of the file written by saveResidentSet()
+	 * @param files   	Open files whose pages to load; the same File objects must be used to access the pages later
+	 * @param batch   	Largest number of pages read at once
+	 * @return  Number of pages loaded.
+	 * @throws  FileIOException If the list cannot be read, or is not such a list (EINVAL) or is for another page size
+	 */
+  std::uint32_t preloadResidentSet(const std::string& filename, const std::vector<File*>& files,
+                                   const std::uint32_t batch = 64);
+
+	/**
+	 * Starts recording every pin, unpin, allocation and disposal of a page in the pool to a trace file, for replay
+	 * against other pool sizes and replacement policies (see tools/trace_replay.cpp).  Pages of mapped files do not
+	 * go through the pool and are not traced.  Tracing costs an append to the calling thread's buffer per event,
+	 * recorded after the frame latch is released.
+	 *
+	 * @param filename  Name of the trace file, which is replaced if it exists
+	 * @throws  FileIOException If a trace is already started or the file cannot be created
+	 */
+  void startTrace(const std::string& filename)
+  {
+		trace.start(filename);
+  }
+
+	/**
+	 * Stops recording the trace and closes its file.
+	 *
+	 * @return  Number of events recorded without a file of their own (TraceEvent::OVERFLOW_FILE), as the trace ran
+	 *          out of file numbers; 0 normally
+	 * @throws  FileIOException If the trace could not be written
+	 */
+  std::uint64_t stopTrace()
+  {
+		return trace.stop();
+  }
+
+	/**
+   * Get buffer pool usage statistics: a snapshot of the counters, latency histograms and per-file breakdown
+   * collected since the pool was created or the statistics were last cleared.  Threads record their events
+   * separately, so taking a snapshot does not hold them up.
 	 */
-  BufStats & getBufStats()
+  BufStats getBufStats() const
   {
-		return bufStats;
+		return stats.snapshot();
   }
 
 	/**
@@ -283,7 +871,7 @@ class BufMgr
 	 */
   void clearBufStats() 
   {
-		bufStats.clear();
+		stats.clear();
   }
 };
 
@@ -0,0 +1,129 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "crc32c.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define BADGERDB_CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define BADGERDB_CRC32C_ARM 1
+#endif
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Reflected CRC-32C polynomial.
+ */
+const std::uint32_t POLYNOMIAL = 0x82F63B78;
+
+struct Crc32cTable {
+  std::uint32_t entries[256];
+
+  Crc32cTable() {
+    for (std::uint32_t i = 0; i < 256; ++i) {
+      std::uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (POLYNOMIAL & (0 - (crc & 1)));
+      }
+      entries[i] = crc;
+    }
+  }
+};
+
+std::uint32_t crc32cSoftware(std::uint32_t crc, const unsigned char* bytes,
+                             std::size_t length) {
+  static const Crc32cTable table;
+  while (length-- > 0) {
+    crc = table.entries[(crc ^ *bytes++) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(BADGERDB_CRC32C_X86)
+
+__attribute__((target("sse4.2")))
+std::uint32_t crc32cHardware(std::uint32_t crc, const unsigned char* bytes,
+                             std::size_t length) {
+#if defined(__x86_64__)
+  std::uint64_t crc64 = crc;
+  for (; length >= 8; length -= 8, bytes += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+  }
+  crc = static_cast<std::uint32_t>(crc64);
+#endif
+  for (; length >= 4; length -= 4, bytes += 4) {
+    std::uint32_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    crc = _mm_crc32_u32(crc, word);
+  }
+  for (; length > 0; --length) {
+    crc = _mm_crc32_u8(crc, *bytes++);
+  }
+  return crc;
+}
+
+bool detectHardware() {
+  return __builtin_cpu_supports("sse4.2");
+}
+
+#elif defined(BADGERDB_CRC32C_ARM)
+
+std::uint32_t crc32cHardware(std::uint32_t crc, const unsigned char* bytes,
+                             std::size_t length) {
+  for (; length >= 8; length -= 8, bytes += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    crc = __crc32cd(crc, word);
+  }
+  for (; length > 0; --length) {
+    crc = __crc32cb(crc, *bytes++);
+  }
+  return crc;
+}
+
+bool detectHardware() {
+  return true;
+}
+
+#else
+
+std::uint32_t crc32cHardware(std::uint32_t crc, const unsigned char* bytes,
+                             std::size_t length) {
+  return crc32cSoftware(crc, bytes, length);
+}
+
+bool detectHardware() {
+  return false;
+}
+
+#endif
+
+}
+
+bool crc32cIsHardware() {
+  static const bool hardware = detectHardware();
+  return hardware;
+}
+
+std::uint32_t crc32c(const void* data, const std::size_t length,
+                     const std::uint32_t crc) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  if (crc32cIsHardware()) {
+    return ~crc32cHardware(~crc, bytes, length);
+  }
+  return ~crc32cSoftware(~crc, bytes, length);
+}
+
+}
@@ -0,0 +1,36 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * Computes the CRC-32C (Castagnoli) checksum of a block of bytes.
+ *
+ * Uses the CRC32 instructions of SSE4.2 on x86 when the processor has them
+ * (checked once at run time) and those of ARMv8 when compiled for a target
+ * with the CRC extension; otherwise a table-driven implementation.
+ *
+ * @param data    First byte.
+ * @param length  Number of bytes.
+ * @param crc     Checksum of the bytes preceding the block, to checksum data
+ *                held in several pieces; 0 for the first piece.
+ * @return  Checksum of all bytes so far.
+ */
+std::uint32_t crc32c(const void* data, const std::size_t length,
+                     const std::uint32_t crc = 0);
+
+/**
+ * Returns true if crc32c() uses hardware instructions.
+ */
+bool crc32cIsHardware();
+
+}
@@ -0,0 +1,59 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a page read from a file does not
+ *        match the checksum it was written with.
+ */
+class ChecksumMismatchException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a checksum mismatch exception for the given page.
+   *
+   * @param name        Name of file the page was read from.
+   * @param page_num    Number of the corrupted page.
+   * @param stored      Checksum stored in the page.
+   * @param computed    Checksum computed from the page's contents.
+   */
+  explicit ChecksumMismatchException(const std::string& name,
+                                     const PageId page_num,
+                                     const std::uint32_t stored,
+                                     const std::uint32_t computed);
+
+  /**
+   * Returns the name of the file the page was read from.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the number of the corrupted page.
+   */
+  virtual PageId page_number() const { return page_number_; }
+
+ protected:
+  /**
+   * Name of file the page was read from.
+   */
+  const std::string filename_;
+
+  /**
+   * Number of the corrupted page.
+   */
+  const PageId page_number_;
+};
+
+}
@@ -0,0 +1,25 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_io_exception.h"
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+FileIOException::FileIOException(const std::string& name,
+                                 const int error_number)
+    : BadgerDbException(""), filename_(name), error_number_(error_number) {
+  std::stringstream ss;
+  ss << "I/O error on file: " << filename_ << ": "
+     << std::strerror(error_number_);
+  message_.assign(ss.str());
+}
+
+}
@@ -7,31 +7,136 @@
 
 #include "file.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
-
+#include <cerrno>
+#include <new>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "exceptions/checksum_mismatch_exception.h"
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "file_iterator.h"
 #include "page.h"
+#include "page_codec.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+namespace {
+
+/**
+ * Frees memory obtained from posix_memalign.
+ */
+struct AlignedDeleter {
+  void operator()(char* buffer) const { free(buffer); }
+};
+
+/**
+ * Returns this thread's Page::ALIGNMENT aligned, one page staging buffer, used
+ * to carry out direct I/O on memory that is not suitably aligned.
+ */
+char* stagingBuffer() {
+  static thread_local std::unique_ptr<char, AlignedDeleter> buffer;
+  if (!buffer) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, Page::ALIGNMENT, Page::SIZE) != 0) {
+      throw std::bad_alloc();
+    }
+    buffer.reset(static_cast<char*>(memory));
+  }
+  return buffer.get();
+}
+
+/**
+ * Returns this thread's Page::ALIGNMENT aligned, one page buffer for
+ * compressed pages.  Separate from the staging buffer, which may hold the page
+ * being compressed.
+ */
+char* compressionBuffer() {
+  static thread_local std::unique_ptr<char, AlignedDeleter> buffer;
+  if (!buffer) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, Page::ALIGNMENT, Page::SIZE) != 0) {
+      throw std::bad_alloc();
+    }
+    buffer.reset(static_cast<char*>(memory));
+  }
+  return buffer.get();
+}
+
+/**
+ * Returns true if a transfer satisfies the alignment rules of direct I/O.
+ */
+bool isAligned(const off_t offset, const void* buffer,
+               const std::size_t length) {
+  return offset % Page::ALIGNMENT == 0 && length % Page::ALIGNMENT == 0 &&
+      reinterpret_cast<std::uintptr_t>(buffer) % Page::ALIGNMENT == 0;
+}
+
+/**
+ * Largest number of buffers passed to one vectored write.
+ */
+#ifdef IOV_MAX
+const int MAX_BLOCKS_PER_WRITE = IOV_MAX;
+#else
+const int MAX_BLOCKS_PER_WRITE = 16;
+#endif
+
+/**
+ * Rounds a transfer length up to the direct I/O alignment.
+ */
+std::size_t alignedLength(const std::size_t length) {
+  return (length + Page::ALIGNMENT - 1) / Page::ALIGNMENT * Page::ALIGNMENT;
+}
+
+}
+
+const std::uint32_t FileHeader::LEGACY_PAGE_SIZE;
+
+File::HandleMap File::open_handles_;
 File::CountMap File::open_counts_;
 
-File File::create(const std::string& filename) {
-  return File(filename, true /* create_new */);
+File::FileHandle::~FileHandle() {
+  if (mapping != NULL) {
+    ::munmap(const_cast<char*>(mapping), mapping_length);
+  }
+  ::close(fd);
+}
+
+File File::create(const std::string& filename, const bool direct_io) {
+  return File(filename, true /* create_new */, direct_io,
+              false /* read_only */);
+}
+
+File File::open(const std::string& filename, const bool direct_io) {
+  return File(filename, false /* create_new */, direct_io,
+              false /* read_only */);
 }
 
-File File::open(const std::string& filename) {
-  return File(filename, false /* create_new */);
+File File::openMapped(const std::string& filename,
+                      const AccessPattern pattern) {
+  if (isOpen(filename)) {
+    throw FileOpenException(filename);
+  }
+  File file(filename, false /* create_new */, false /* direct_io */,
+            true /* read_only */);
+  file.mapFile(pattern);
+  return file;
 }
 
 void File::remove(const std::string& filename) {
@@ -64,149 +169,369 @@ bool File::exists(const std::string& filename) {
 
 File::File(const File& other)
   : filename_(other.filename_),
-    stream_(open_streams_[filename_]) {
+    handle_(open_handles_[filename_]),
+    background_reads_(0) {
   ++open_counts_[filename_];
 }
 
 File& File::operator=(const File& rhs) {
   // This accounts for self-assignment and assignment of a File object for the
-  // same file.
+  // same file.  Reads queued through this object are for the old file.
+  waitForBackgroundReads();
   close();	//close my file and associate me with the new one
   filename_ = rhs.filename_;
-  openIfNeeded(false /* create_new */);
+  openIfNeeded(false /* create_new */, false /* direct_io */,
+               false /* read_only */);
   return *this;
 }
 
 File::~File() {
+  waitForBackgroundReads();
   close();
 }
 
+void File::beginBackgroundRead() {
+  std::lock_guard<std::mutex> guard(background_latch_);
+  ++background_reads_;
+}
+
+void File::endBackgroundRead() {
+  // Notified under the latch, as the waiter may destroy this object as soon
+  // as it runs.
+  std::lock_guard<std::mutex> guard(background_latch_);
+  if (--background_reads_ == 0) {
+    background_done_.notify_all();
+  }
+}
+
+void File::waitForBackgroundReads() const {
+  std::unique_lock<std::mutex> lock(background_latch_);
+  background_done_.wait(lock, [this]() { return background_reads_ == 0; });
+}
+
 Page File::allocatePage() {
-  FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  allocatePage(new_page);
+  return new_page;
+}
+
+void File::allocatePage(Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+  FileHeader header = readHeader();
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
+    readPage(header.first_free_page, true /* allow_free */, new_page);
     new_page.set_page_number(header.first_free_page);
     header.first_free_page = new_page.next_page_number();
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
   } else {
+    new_page.initialize();
     new_page.set_page_number(header.num_pages);
-    if (header.first_used_page == Page::INVALID_NUMBER) {
-      header.first_used_page = new_page.page_number();
-    } else {
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
     ++header.num_pages;
   }
-  writePage(new_page.page_number(), new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page);
+  // The new page goes at the tail of the used list, which the header points
+  // to, so no other page has to be looked at.
+  new_page.set_prev_page_number(header.last_used_page);
+  new_page.set_next_page_number(Page::INVALID_NUMBER);
+  if (header.last_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = new_page.page_number();
+  } else {
+    Page tail_page = readPage(header.last_used_page, false /* allow_free */);
+    tail_page.set_next_page_number(new_page.page_number());
+    writePage(tail_page.page_number(), tail_page);
   }
+  header.last_used_page = new_page.page_number();
+
+  writePage(new_page.page_number(), new_page);
   writeHeader(header);
+}
 
-  return new_page;
+void File::allocatePages(const std::vector<Page*>& pages) {
+  if (pages.empty()) {
+    return;
+  }
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+  FileHeader header = readHeader();
+  const PageId first_page_number = header.num_pages;
+  const PageId count = static_cast<PageId>(pages.size());
+
+  // Reserve the whole run at once so the file system can lay it out
+  // contiguously.  Not every file system supports this, which is harmless.
+  // Compressed pages would only release most of the space again.
+  if (!compression()) {
+    const int error = ::posix_fallocate(handle_->fd,
+                                        pagePosition(first_page_number),
+                                        pagePosition(count));
+    if (error != 0 && error != EINVAL && error != EOPNOTSUPP) {
+      throw FileIOException(filename_, error);
+    }
+  }
+
+  bool aligned = true;
+  for (PageId i = 0; i < count; ++i) {
+    Page& page = *pages[i];
+    page.initialize();
+    page.set_page_number(first_page_number + i);
+    page.set_prev_page_number(i == 0 ? header.last_used_page
+                                     : first_page_number + i - 1);
+    page.set_next_page_number(i + 1 == count ? Page::INVALID_NUMBER
+                                             : first_page_number + i + 1);
+    if (checksums()) {
+      page.header_.checksum = page.computeChecksum();
+    }
+    aligned = aligned && isAligned(0 /* offset */, &page, Page::SIZE);
+  }
+
+  if ((handle_->direct && !aligned) || compression()) {
+    for (PageId i = 0; i < count; ++i) {
+      writePage(first_page_number + i, *pages[i]);
+    }
+  } else {
+    std::vector<struct iovec> blocks;
+    for (PageId start = 0; start < count; start += blocks.size()) {
+      blocks.clear();
+      for (PageId i = start;
+           i < count && static_cast<int>(blocks.size()) < MAX_BLOCKS_PER_WRITE;
+           ++i) {
+        struct iovec block;
+        block.iov_base = pages[i];
+        block.iov_len = Page::SIZE;
+        blocks.push_back(block);
+      }
+      writeBlocks(pagePosition(first_page_number + start), &blocks[0],
+                  static_cast<int>(blocks.size()));
+    }
+  }
+
+  if (header.last_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = first_page_number;
+  } else {
+    Page tail_page = readPage(header.last_used_page, false /* allow_free */);
+    tail_page.set_next_page_number(first_page_number);
+    writePage(tail_page.page_number(), tail_page);
+  }
+  header.last_used_page = first_page_number + count - 1;
+  header.num_pages += count;
+  writeHeader(header);
 }
 
 Page File::readPage(const PageId page_number) const {
-  FileHeader header = readHeader();
-  if (page_number >= header.num_pages) {
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
+
+void File::readPage(const PageId page_number, Page& page) const {
+  if (page_number >= handle_->num_pages.load()) {
     throw InvalidPageException(page_number, filename_);
   }
-  return readPage(page_number, false /* allow_free */);
+  readPage(page_number, false /* allow_free */, page);
 }
 
 Page File::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(page.header_));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
+  readPage(page_number, allow_free, page);
+  return page;
+}
+
+void File::readPages(const PageId first_page_number,
+                     const std::vector<Page*>& pages) const {
+  const PageId count = static_cast<PageId>(pages.size());
+  if (count == 0) {
+    return;
+  }
+  if (first_page_number + count > handle_->num_pages.load() ||
+      first_page_number + count < first_page_number) {
+    throw InvalidPageException(first_page_number, filename_);
+  }
+  bool aligned = true;
+  for (PageId i = 0; i < count; ++i) {
+    aligned = aligned && isAligned(pagePosition(first_page_number + i),
+                                   pages[i], Page::SIZE);
+  }
+  if (handle_->mapping != NULL || (handle_->direct && !aligned)) {
+    for (PageId i = 0; i < count; ++i) {
+      readPage(first_page_number + i, false /* allow_free */, *pages[i]);
+    }
+    return;
+  }
+
+  std::vector<struct iovec> blocks;
+  for (PageId start = 0; start < count; start += blocks.size()) {
+    blocks.clear();
+    for (PageId i = start;
+         i < count && static_cast<int>(blocks.size()) < MAX_BLOCKS_PER_WRITE;
+         ++i) {
+      struct iovec block;
+      block.iov_base = pages[i];
+      block.iov_len = Page::SIZE;
+      blocks.push_back(block);
+    }
+    readBlocks(pagePosition(first_page_number + start), &blocks[0],
+               static_cast<int>(blocks.size()));
+  }
+  // Compressed pages are read whole, the punched out rest as zeros, and
+  // decompressed where they are.
+  for (PageId i = 0; i < count; ++i) {
+    decodeStoredPage(*pages[i]);
+    verifyPage(first_page_number + i, false /* allow_free */, *pages[i]);
+  }
+}
+
+void File::readPage(const PageId page_number, const bool allow_free,
+                    Page& page) const {
+  readStoredPage(page_number, page);
+  verifyPage(page_number, allow_free, page);
+}
+
+void File::verifyPage(const PageId page_number, const bool allow_free,
+                      const Page& page) const {
+  if (page.header_.checksum != 0 && checksums()) {
+    const std::uint32_t computed = page.computeChecksum();
+    if (computed != page.header_.checksum) {
+      throw ChecksumMismatchException(filename_, page_number,
+                                      page.header_.checksum, computed);
+    }
+  }
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
-
-  return page;
 }
 
 void File::writePage(const Page& new_page) {
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
   PageHeader header = readPageHeader(new_page.page_number());
   if (header.current_page_number == Page::INVALID_NUMBER) {
     // Page has been deleted since it was read.
     throw InvalidPageException(new_page.page_number(), filename_);
   }
-  // Page on disk may have had its next page pointer updated since it was read;
-  // we don't modify that, but we do keep all the other modifications to the
-  // page header.
+  // Page on disk may have had its next and previous page pointers updated
+  // since it was read; we don't modify those, but we do keep all the other
+  // modifications to the page header.
   const PageId next_page_number = header.next_page_number;
+  const PageId prev_page_number = header.prev_page_number;
   header = new_page.header_;
   header.next_page_number = next_page_number;
+  header.prev_page_number = prev_page_number;
   writePage(new_page.page_number(), header, new_page);
 }
 
+void File::writePages(const std::vector<const Page*>& pages) {
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+  // As in writePage(), the list pointers on disk win.  Pages whose pointers
+  // have changed, and under direct I/O pages that are not aligned, are copied
+  // with the corrected header; the others are written from where they are.
+  std::vector<const char*> sources(pages.size());
+  std::vector<PageHeader> disk_headers(pages.size());
+  std::vector<std::size_t> copies;
+  for (std::size_t i = 0; i < pages.size(); ++i) {
+    const Page& page = *pages[i];
+    assert(i == 0 || pages[i - 1]->page_number() < page.page_number());
+    const PageHeader header = readPageHeader(page.page_number());
+    if (header.current_page_number == Page::INVALID_NUMBER) {
+      // Page has been deleted since it was read.
+      throw InvalidPageException(page.page_number(), filename_);
+    }
+    sources[i] = reinterpret_cast<const char*>(&page);
+    disk_headers[i] = header;
+    if (header.next_page_number != page.next_page_number() ||
+        header.prev_page_number != page.prev_page_number() ||
+        needsChecksumUpdate(page) ||
+        (handle_->direct && !isAligned(pagePosition(page.page_number()),
+                                       &page, Page::SIZE))) {
+      copies.push_back(i);
+    }
+  }
+
+  std::unique_ptr<char, AlignedDeleter> copy_buffer;
+  if (!copies.empty()) {
+    void* memory = NULL;
+    if (posix_memalign(&memory, Page::ALIGNMENT,
+                       copies.size() * Page::SIZE) != 0) {
+      throw std::bad_alloc();
+    }
+    copy_buffer.reset(static_cast<char*>(memory));
+    for (std::size_t c = 0; c < copies.size(); ++c) {
+      const std::size_t i = copies[c];
+      char* copy = copy_buffer.get() + c * Page::SIZE;
+      std::memcpy(copy, pages[i], Page::SIZE);
+      Page* copied_page = reinterpret_cast<Page*>(copy);
+      copied_page->set_next_page_number(disk_headers[i].next_page_number);
+      copied_page->set_prev_page_number(disk_headers[i].prev_page_number);
+      setChecksum(*copied_page);
+      sources[i] = copy;
+    }
+  }
+
+  if (compression()) {
+    // Each page is compressed to its own length, so they go out one by one.
+    for (std::size_t i = 0; i < pages.size(); ++i) {
+      writePageImage(pages[i]->page_number(), sources[i]);
+    }
+    return;
+  }
+
+  std::vector<struct iovec> blocks;
+  std::size_t start = 0;
+  while (start < pages.size()) {
+    blocks.clear();
+    std::size_t end = start;
+    do {
+      struct iovec block;
+      block.iov_base = const_cast<char*>(sources[end]);
+      block.iov_len = Page::SIZE;
+      blocks.push_back(block);
+      ++end;
+    } while (end < pages.size() &&
+             pages[end]->page_number() == pages[end - 1]->page_number() + 1 &&
+             static_cast<int>(blocks.size()) < MAX_BLOCKS_PER_WRITE);
+    writeBlocks(pagePosition(pages[start]->page_number()), &blocks[0],
+                static_cast<int>(blocks.size()));
+    start = end;
+  }
+}
+
+void File::sync() {
+  {
+    std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+    writeHeaderBack();
+  }
+  while (::fsync(handle_->fd) != 0) {
+    if (errno != EINTR) {
+      throw FileIOException(filename_, errno);
+    }
+  }
+}
+
 void File::deletePage(const PageId page_number) {
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
   FileHeader header = readHeader();
   Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  const PageId prev_page_number = existing_page.prev_page_number();
+  const PageId next_page_number = existing_page.next_page_number();
+  // Unlink the page from its neighbours in the used list, or from the header
+  // where it was at either end.
+  if (prev_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    Page prev_page = readPage(prev_page_number, false /* allow_free */);
+    prev_page.set_next_page_number(next_page_number);
+    writePage(prev_page_number, prev_page);
+  }
+  if (next_page_number == Page::INVALID_NUMBER) {
+    header.last_used_page = prev_page_number;
+  } else {
+    Page next_page = readPage(next_page_number, false /* allow_free */);
+    next_page.set_prev_page_number(prev_page_number);
+    writePage(next_page_number, next_page);
   }
   // Clear the page and add it to the head of the free list.
   existing_page.initialize();
   existing_page.set_next_page_number(header.first_free_page);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page);
-  }
   writePage(page_number, existing_page);
   writeHeader(header);
 }
@@ -220,24 +545,30 @@ FileIterator File::end() {
   return FileIterator(this, Page::INVALID_NUMBER);
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
-  openIfNeeded(create_new);
+File::File(const std::string& name, const bool create_new,
+           const bool direct_io, const bool read_only)
+    : filename_(name), background_reads_(0) {
+  openIfNeeded(create_new, direct_io, read_only);
 
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */, 0 /* checksums */,
+                         0 /* compression */, Page::SIZE /* page_size */};
     writeHeader(header);
+    std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+    writeHeaderBack();
   }
 }
 
-void File::openIfNeeded(const bool create_new) {
+void File::openIfNeeded(const bool create_new, const bool direct_io,
+                        const bool read_only) {
   if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    handle_ = open_handles_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
+    int flags = read_only ? O_RDONLY : O_RDWR;
     const bool already_exists = exists(filename_);
     if (create_new) {
       // Error if we try to overwrite an existing file.
@@ -245,60 +576,367 @@ void File::openIfNeeded(const bool create_new) {
         throw FileExistsException(filename_);
       }
       // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
+      flags = flags | O_CREAT | O_TRUNC;
     } else {
       // Error if we try to open a file that doesn't exist.
       if (!already_exists) {
         throw FileNotFoundException(filename_);
       }
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    bool direct = false;
+#ifdef O_DIRECT
+    if (direct_io) {
+      flags = flags | O_DIRECT;
+      direct = true;
+    }
+#endif
+    const int fd = ::open(filename_.c_str(), flags, 0644);
+    if (fd < 0) {
+      throw FileIOException(filename_, errno);
+    }
+    handle_.reset(new FileHandle);
+    handle_->fd = fd;
+    handle_->direct = direct;
+    handle_->header_dirty = false;
+    handle_->mapping = NULL;
+    handle_->mapping_length = 0;
+    if (create_new) {
+      std::memset(&handle_->header, 0, sizeof(handle_->header));
+    } else {
+      readBlock(0 /* pos */, &handle_->header, sizeof(handle_->header));
+      const std::uint32_t page_size = handle_->header.page_size != 0
+          ? handle_->header.page_size
+          : FileHeader::LEGACY_PAGE_SIZE;
+      if (page_size != Page::SIZE) {
+        // Page positions would be wrong throughout the file.
+        throw FileIOException(filename_, EINVAL);
+      }
+    }
+    handle_->num_pages = handle_->header.num_pages;
+    handle_->checksums = handle_->header.checksums != 0;
+    handle_->compression = handle_->header.compression != 0;
+    open_handles_[filename_] = handle_;
     open_counts_[filename_] = 1;
   }
 }
 
+void File::mapFile(const AccessPattern pattern) {
+  if (compression()) {
+    // Compressed pages cannot be used in place.
+    throw FileIOException(filename_, EINVAL);
+  }
+  struct stat status;
+  if (::fstat(handle_->fd, &status) != 0) {
+    throw FileIOException(filename_, errno);
+  }
+  const std::size_t length = static_cast<std::size_t>(status.st_size);
+  void* mapping = ::mmap(NULL, length, PROT_READ, MAP_SHARED, handle_->fd, 0);
+  if (mapping == MAP_FAILED) {
+    throw FileIOException(filename_, errno);
+  }
+  int advice = MADV_NORMAL;
+  if (pattern == SEQUENTIAL) {
+    advice = MADV_SEQUENTIAL;
+  } else if (pattern == RANDOM) {
+    advice = MADV_RANDOM;
+  }
+  // Only a hint, so failure is not an error.
+  ::madvise(mapping, length, advice);
+  handle_->mapping = static_cast<const char*>(mapping);
+  handle_->mapping_length = length;
+}
+
+const Page* File::mappedPage(const PageId page_number) const {
+  assert(isMapped());
+  if (page_number >= handle_->num_pages.load() ||
+      static_cast<std::size_t>(pagePosition(page_number)) + Page::SIZE >
+          handle_->mapping_length) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const Page* page = reinterpret_cast<const Page*>(
+      handle_->mapping + pagePosition(page_number));
+  if (isCompressedPage(reinterpret_cast<const char*>(page))) {
+    throw FileIOException(filename_, EINVAL);
+  }
+  if (!page->isUsed()) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  return page;
+}
+
 void File::close() {
-  --open_counts_[filename_];
-  stream_.reset();
+  if (--open_counts_[filename_] == 0) {
+    // Last user of the file.  Called from the destructor, so a failure to
+    // write the header back cannot be reported.
+    try {
+      std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+      writeHeaderBack();
+    } catch (...) {
+    }
+  }
+  handle_.reset();
   if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+    open_handles_.erase(filename_);
     open_counts_.erase(filename_);
   }
 }
 
 void File::writePage(const PageId page_number, const Page& new_page) {
-  writePage(page_number, new_page.header_, new_page);
+  if (needsChecksumUpdate(new_page)) {
+    writePage(page_number, new_page.header_, new_page);
+    return;
+  }
+  writePageImage(page_number, reinterpret_cast<const char*>(&new_page));
 }
 
 void File::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  // Assemble the page with its new header so that it goes out in one write.
+  char* staging = stagingBuffer();
+  std::memcpy(staging, &header, sizeof(header));
+  std::memcpy(staging + sizeof(header), new_page.data_, Page::DATA_SIZE);
+  setChecksum(*reinterpret_cast<Page*>(staging));
+  writePageImage(page_number, staging);
 }
 
-FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+void File::writePageImage(const PageId page_number, const char* image) {
+  const off_t position = pagePosition(page_number);
+  if (compression()) {
+    // Only worth it if at least one aligned block of the page is saved.
+    char* compressed = compressionBuffer();
+    const std::size_t length =
+        compressPage(image, compressed, Page::SIZE - Page::ALIGNMENT);
+    if (length > 0) {
+      const std::size_t stored = alignedLength(length);
+      std::memset(compressed + length, 0, stored - length);
+      writeBlock(position, compressed, stored);
+#ifdef FALLOC_FL_PUNCH_HOLE
+      // Release the rest of the page's place; it then reads as zeros.  File
+      // systems without hole punching simply keep the stale bytes, which
+      // decompression ignores.
+      while (::fallocate(handle_->fd,
+                         FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                         position + stored, Page::SIZE - stored) != 0) {
+        if (errno == EOPNOTSUPP || errno == ENOSYS) {
+          break;
+        }
+        if (errno != EINTR) {
+          throw FileIOException(filename_, errno);
+        }
+      }
+#endif
+      return;
+    }
+  }
+  writeBlock(position, image, Page::SIZE);
+}
 
-  return header;
+void File::readStoredPage(const PageId page_number, Page& page) const {
+  // Header and data are contiguous both on disk and in a Page, so one read
+  // fills the whole frame.
+  readBlock(pagePosition(page_number), &page, Page::SIZE);
+  decodeStoredPage(page);
+}
+
+void File::decodeStoredPage(Page& page) const {
+  char* stored = reinterpret_cast<char*>(&page);
+  if (isCompressedPage(stored)) {
+    char* compressed = compressionBuffer();
+    std::memcpy(compressed, stored, Page::SIZE);
+    if (!decompressPage(compressed, Page::SIZE, stored)) {
+      throw FileIOException(filename_, EIO);
+    }
+  }
+}
+
+FileHeader File::readHeader() const {
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+  return handle_->header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(header));
-  stream_->flush();
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+  handle_->header = header;
+  handle_->header_dirty = true;
+  handle_->num_pages = header.num_pages;
+  handle_->checksums = header.checksums != 0;
+  handle_->compression = header.compression != 0;
+}
+
+void File::setCompression(const bool enabled) {
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+  FileHeader header = readHeader();
+  header.compression = enabled ? 1 : 0;
+  writeHeader(header);
+}
+
+void File::setChecksums(const bool enabled) {
+  std::lock_guard<std::recursive_mutex> guard(handle_->latch);
+  FileHeader header = readHeader();
+  header.checksums = enabled ? 1 : 0;
+  writeHeader(header);
+}
+
+bool File::needsChecksumUpdate(const Page& page) const {
+  // A page written while checksums are off must not keep a checksum from
+  // an earlier write, or it would fail once they are turned back on.
+  return checksums() || page.header_.checksum != 0;
+}
+
+void File::setChecksum(Page& page) const {
+  page.header_.checksum = checksums() ? page.computeChecksum() : 0;
+}
+
+void File::writeHeaderBack() {
+  if (handle_->header_dirty) {
+    writeBlock(0 /* pos */, &handle_->header, sizeof(handle_->header));
+    handle_->header_dirty = false;
+  }
 }
 
 PageHeader File::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(header));
+  readBlock(pagePosition(page_number), &header, sizeof(header));
+  if (isCompressedPage(reinterpret_cast<const char*>(&header))) {
+    Page page;
+    readStoredPage(page_number, page);
+    header = page.header_;
+  }
 
   return header;
 }
 
+void File::readBlock(const off_t offset, void* buffer,
+                     const std::size_t length) const {
+  if (handle_->mapping != NULL) {
+    const std::size_t available =
+        static_cast<std::size_t>(offset) < handle_->mapping_length
+            ? std::min(length, handle_->mapping_length - offset)
+            : 0;
+    if (available > 0) {
+      std::memcpy(buffer, handle_->mapping + offset, available);
+    }
+    std::memset(static_cast<char*>(buffer) + available, 0, length - available);
+    return;
+  }
+
+  char* target = static_cast<char*>(buffer);
+  std::size_t transfer = length;
+  if (handle_->direct && !isAligned(offset, buffer, length)) {
+    // Direct I/O needs aligned memory, offsets and lengths, so read the
+    // enclosing aligned block into the staging buffer instead.
+    assert(offset % Page::ALIGNMENT == 0 && length <= Page::SIZE);
+    target = stagingBuffer();
+    transfer = alignedLength(length);
+  }
+
+  std::size_t done = 0;
+  while (done < transfer) {
+    const ssize_t count = ::pread(handle_->fd, target + done, transfer - done,
+                                  offset + done);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    if (count == 0) {
+      // End of file.
+      std::memset(target + done, 0, transfer - done);
+      break;
+    }
+    done += count;
+  }
+
+  if (target != buffer) {
+    std::memcpy(buffer, target, length);
+  }
+}
+
+void File::writeBlock(const off_t offset, const void* buffer,
+                      const std::size_t length) {
+  const char* source = static_cast<const char*>(buffer);
+  std::size_t transfer = length;
+  if (handle_->direct && !isAligned(offset, buffer, length)) {
+    assert(offset % Page::ALIGNMENT == 0 && length <= Page::SIZE);
+    char* staging = stagingBuffer();
+    transfer = alignedLength(length);
+    if (staging != source) {
+      std::memmove(staging, source, length);
+    }
+    std::memset(staging + length, 0, transfer - length);
+    source = staging;
+  }
+
+  std::size_t done = 0;
+  while (done < transfer) {
+    const ssize_t count = ::pwrite(handle_->fd, source + done, transfer - done,
+                                   offset + done);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    done += count;
+  }
+}
+
+void File::readBlocks(const off_t offset, struct iovec* blocks,
+                      int count) const {
+  off_t position = offset;
+  while (count > 0) {
+    ssize_t filled = ::preadv(handle_->fd, blocks, count, position);
+    if (filled < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    if (filled == 0) {
+      // End of file.
+      for (int i = 0; i < count; ++i) {
+        std::memset(blocks[i].iov_base, 0, blocks[i].iov_len);
+      }
+      return;
+    }
+    position += filled;
+    // As in writeBlocks(), resume within the first buffer not yet filled.
+    while (count > 0 && static_cast<std::size_t>(filled) >= blocks->iov_len) {
+      filled -= blocks->iov_len;
+      ++blocks;
+      --count;
+    }
+    if (count > 0) {
+      blocks->iov_base = static_cast<char*>(blocks->iov_base) + filled;
+      blocks->iov_len -= filled;
+    }
+  }
+}
+
+void File::writeBlocks(const off_t offset, struct iovec* blocks, int count) {
+  off_t position = offset;
+  while (count > 0) {
+    ssize_t written = ::pwritev(handle_->fd, blocks, count, position);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    position += written;
+    // Skip the buffers that were written completely and resume within the
+    // first one that was not.
+    while (count > 0 && static_cast<std::size_t>(written) >= blocks->iov_len) {
+      written -= blocks->iov_len;
+      ++blocks;
+      --count;
+    }
+    if (count > 0) {
+      blocks->iov_base = static_cast<char*>(blocks->iov_base) + written;
+      blocks->iov_len -= written;
+    }
+  }
+}
+
 }
@@ -7,13 +7,20 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <fstream>
 #include <string>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/types.h>
 
 #include "page.h"
 
+struct iovec;
+
 namespace badgerdb {
 
 class FileIterator;
@@ -42,6 +49,31 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file, to which newly allocated
+   * pages are appended.
+   */
+  PageId last_used_page;
+
+  /**
+   * Nonzero if pages are written with checksums, which are then verified
+   * when the pages are read back.
+   */
+  std::uint32_t checksums;
+
+  /**
+   * Nonzero if pages are compressed when they are written.
+   */
+  std::uint32_t compression;
+
+  /**
+   * Page size the file was created with, or 0 for files created before it was
+   * recorded, whose pages are LEGACY_PAGE_SIZE bytes.
+   */
+  std::uint32_t page_size;
+
+  static const std::uint32_t LEGACY_PAGE_SIZE = 8192;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,7 +84,11 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        last_used_page == rhs.last_used_page &&
+        checksums == rhs.checksums &&
+        compression == rhs.compression &&
+        page_size == rhs.page_size;
   }
 };
 
@@ -60,37 +96,93 @@ struct FileHeader {
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a file descriptor for an underlying file on disk.  Files
+ * contain fixed-sized pages, and they never deallocate space (though they do
+ * reuse deleted pages if possible).  If multiple File objects refer to the same
+ * underlying file, they will share the descriptor.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_handles_ map) and just returns a file object with
+ * the already opened descriptor for the file without actually opening the UNIX file again. 
+ *
+ * All I/O is positional (pread/pwrite at pagePosition()), so there is no shared
+ * seek pointer and page reads from different threads do not contend.  Operations
+ * that update file metadata (allocating, deleting and writing pages) are
+ * serialized by a latch shared the same way the descriptor is.
  *
- * @warning This class is not threadsafe.
+ * Page i is stored at offset i * Page::SIZE; page 0 holds the FileHeader.
+ * The used pages form a doubly linked list in allocation order whose ends are
+ * kept in the FileHeader, and deleted pages are kept on a free list for reuse,
+ * so allocating or deleting a page touches at most two other pages no matter
+ * how large the file is.
+ *
+ * The FileHeader is cached with the descriptor and only written back to disk
+ * by sync() and when the file is closed; until then the header on disk may be
+ * stale.
+ * Because every page is aligned to its size, a file may be opened for direct
+ * I/O (O_DIRECT), bypassing the operating system's page cache.  Direct I/O
+ * transfers straight to and from Page::ALIGNMENT aligned frames such as the
+ * ones in the buffer pool; other pages are staged through an aligned buffer.
+ *
+ * A file that is no longer modified can instead be opened read-only and mapped
+ * into memory with openMapped().  Its pages can then be used in place through
+ * mappedPage(), without being copied into a Page or a buffer pool frame.
+ *
+ * @warning Creating, opening, closing and removing files is not threadsafe.
  */
 class File {
  public:
+  /**
+   * Expected pattern of accesses to a mapped file, passed on to the operating
+   * system to tune read-ahead.
+   */
+  enum AccessPattern {
+    NORMAL,
+    SEQUENTIAL,
+    RANDOM
+  };
+
   /**
    * Creates a new file.
    *
    * @param filename  Name of the file.
+   * @param direct_io Whether to bypass the operating system's page cache
+   *                  (ignored where O_DIRECT is unavailable).
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static File create(const std::string& filename);
+  static File create(const std::string& filename, const bool direct_io = false);
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
+	 * It first checks if the file is already open. If so, then the new File object created uses the same descriptor to read to or write fom
 	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the handle associated with this File object are inserted into the
+	 * open_handles_ map.
+   *
+   * @param filename  Name of the file.
+   * @param direct_io Whether to bypass the operating system's page cache
+   *                  (ignored where O_DIRECT is unavailable).  Only takes
+   *                  effect if the file is not already open.
+   * @throws  FileNotFoundException   If the requested file doesn't exist.
+   * @throws  FileIOException         If the file was created with a different
+   *                                  page size.
+   */
+  static File open(const std::string& filename, const bool direct_io = false);
+
+  /**
+   * Opens an existing file read-only and maps it into memory.  The file must
+   * not be modified by anyone while it is mapped; operations that would
+   * modify it fail with a FileIOException.
    *
    * @param filename  Name of the file.
+   * @param pattern   Expected access pattern, used as a hint to the
+   *                  operating system.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
+   * @throws  FileOpenException       If the file is already open.
+   * @throws  FileIOException         If the file cannot be mapped or has
+   *                                  compression on.
    */
-  static File open(const std::string& filename);
+  static File openMapped(const std::string& filename,
+                         const AccessPattern pattern = NORMAL);
 
   /**
    * Deletes an existing file.
@@ -134,17 +226,44 @@ class File {
 
   /**
    * Destructor that automatically closes the underlying file if no other
-   * File objects are using it.
+   * File objects are using it.  Waits first for the pages still being
+   * prefetched through this object (see BufMgr::prefetchPages()).
    */
   ~File();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file, reusing a deleted page if there is one.
+   * The page is added to the end of the used list.
    *
    * @return The new page.
    */
   Page allocatePage();
 
+  /**
+   * Allocates a new page in the file, as allocatePage() does, setting it up
+   * directly in memory supplied by the caller (such as a buffer pool frame)
+   * instead of returning a copy.
+   *
+   * @param page  Memory for the new page; returns the new page.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void allocatePage(Page& page);
+
+  /**
+   * Allocates a run of new, consecutively numbered pages at the end of the
+   * file with a single header update, reserving their space on disk up front.
+   * Deleted pages are not reused.  The new pages are added to the end of the
+   * used list in order.
+   *
+   * The pages are set up in memory supplied by the caller (such as buffer pool
+   * frames) and written out from there in as few writes as possible.
+   *
+   * @param pages   Memory for the new pages; one page is allocated for each
+   *                entry.  Returns the new pages.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void allocatePages(const std::vector<Page*>& pages);
+
   /**
    * Reads an existing page from the file.
    *
@@ -152,9 +271,37 @@ class File {
    * @return  The page.
    * @throws  InvalidPageException  If the page doesn't exist in the file or is
    *                                not currently used.
+   * @throws  ChecksumMismatchException  If the page fails its checksum.
    */
   Page readPage(const PageId page_number) const;
 
+  /**
+   * Reads an existing page from the file directly into the given page frame,
+   * without going through a temporary Page.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Frame the page is read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   * @throws  ChecksumMismatchException  If the page fails its checksum.
+   */
+  void readPage(const PageId page_number, Page& page) const;
+
+  /**
+   * Reads a run of consecutively numbered existing pages directly into the
+   * given page frames, as readPage() does for each of them, with as few
+   * system calls as possible: the run is read with vectored reads.
+   *
+   * @param first_page_number   Number of the first page to read.
+   * @param pages   Frames the pages are read into, one for each page.
+   * @throws  InvalidPageException  If any of the pages doesn't exist in the
+   *                                file or is not currently used.
+   * @throws  ChecksumMismatchException  If any of the pages fails its
+   *                                     checksum.
+   */
+  void readPages(const PageId first_page_number,
+                 const std::vector<Page*>& pages) const;
+
   /**
    * Writes a page into the file, replacing any existing contents.  The page
    * must have been already allocated in this file by a call to allocatePage().
@@ -164,6 +311,26 @@ class File {
    */
   void writePage(const Page& new_page);
 
+  /**
+   * Writes a batch of pages into the file, as writePage() does for each of
+   * them, with as few system calls as possible: every run of consecutively
+   * numbered pages goes out in one vectored write.  All pages are checked
+   * before any of them is written.
+   *
+   * @see writePage()
+   * @param pages   Pages to write, sorted by page number without duplicates.
+   * @throws  InvalidPageException  If any of the pages has been deleted.
+   */
+  void writePages(const std::vector<const Page*>& pages);
+
+  /**
+   * Writes back the cached file header and forces everything written to the
+   * file so far out to stable storage.
+   *
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void sync();
+
   /**
    * Deletes a page from the file.
    *
@@ -171,6 +338,64 @@ class File {
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Turns page checksums on or off for the file.  While they are on, every
+   * page written gets a CRC-32C of its contents in its header, and every page
+   * read that carries one is verified, which costs a fraction of the I/O.
+   * Pages written while checksums were off carry none and are read as they
+   * are, so checksums can be turned on for an existing file.  Pages used in
+   * place through mappedPage() are not verified.
+   *
+   * @param enabled   Whether pages are to be checksummed.
+   */
+  void setChecksums(const bool enabled);
+
+  /**
+   * Returns true if page checksums are on for the file.
+   */
+  bool checksums() const { return handle_->checksums.load(); }
+
+  /**
+   * Turns page compression on or off for the file.  While it is on, each page
+   * written is compressed with compressPage() and, if that saves at least one
+   * Page::ALIGNMENT block, stored compressed at the start of the page's place
+   * in the file, the rest of which is released to the file system as a hole.
+   * Page numbers keep mapping straight to file offsets, so a page is still
+   * read with one read, of which only the compressed part touches the
+   * storage device.  Suited to cold files whose pages are mostly empty space;
+   * on file systems that cannot punch holes, only the read saving remains.
+   *
+   * Compressed pages are decompressed when read whether or not compression is
+   * still on, and stored uncompressed again when next written with it off.
+   * Files with compressed pages cannot be used through openMapped().
+   *
+   * @param enabled   Whether pages are to be compressed.
+   */
+  void setCompression(const bool enabled);
+
+  /**
+   * Returns true if page compression is on for the file.
+   */
+  bool compression() const { return handle_->compression.load(); }
+
+  /**
+   * Returns true if the file was opened with openMapped().
+   */
+  bool isMapped() const { return handle_->mapping != NULL; }
+
+  /**
+   * Returns an existing page of a mapped file in place.  The page stays valid
+   * as long as any File object for the file is open, and must not be written
+   * to.
+   *
+   * @param page_number   Number of page to return.
+   * @return  The page inside the mapping.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   * @throws  FileIOException       If the page is stored compressed.
+   */
+  const Page* mappedPage(const PageId page_number) const;
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -201,8 +426,8 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  static off_t pagePosition(const PageId page_number) {
+    return static_cast<off_t>(page_number) * Page::SIZE;
   }
 
   /**
@@ -214,28 +439,43 @@ class File {
    * @see File::open()
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param direct_io   Whether to open the file for direct I/O.
+   * @param read_only   Whether to open the file for reading only.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new, const bool direct_io,
+       const bool read_only);
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
+   * @param direct_io   Whether to open the file for direct I/O.
+   * @param read_only   Whether to open the file for reading only.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
+   * @throws  FileIOException         If the file cannot be opened.
+   */
+  void openIfNeeded(const bool create_new, const bool direct_io,
+                    const bool read_only);
+
+  /**
+   * Maps the whole of the newly opened, read-only file into memory.
+   *
+   * @param pattern   Expected access pattern.
+   * @throws  FileIOException  If the file cannot be mapped.
    */
-  void openIfNeeded(const bool create_new);
+  void mapFile(const AccessPattern pattern);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Closes the underlying file descriptor in <handle_>.
    * This method only closes the file if no other File objects exist that access
    * the same file.
    */
@@ -245,8 +485,8 @@ class File {
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as a free page.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
@@ -256,6 +496,20 @@ class File {
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Reads a page from the file into the given page frame.  If <allow_free> is
+   * not set, an exception will be thrown if the page read from disk is not
+   * currently in use.  No bounds checking is performed.
+   *
+   * @param page_number   Number of page to read.
+   * @param allow_free    Whether to allow reading a free (unused) page.
+   * @param page          Frame the page is read into.
+   * @throws  InvalidPageException  If the page is free (unused) and
+   *                                allow_free is false.
+   */
+  void readPage(const PageId page_number, const bool allow_free,
+                Page& page) const;
+
   /**
    * Writes a page into the file at the given page number.  This does not
    * update ensure that the number in the header equals the position on disk.
@@ -279,19 +533,88 @@ class File {
                  const Page& new_page);
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file, from the cache.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file.  The new header goes to disk with the
+   * next sync() or when the file is closed.
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
+  /**
+   * Writes the cached header to disk if it has changed since it was last
+   * written.  Caller must hold the handle's latch.
+   *
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void writeHeaderBack();
+
+  /**
+   * Returns true if the page cannot be written as it is, because its checksum
+   * field has to be set or cleared.
+   *
+   * @param page  Page to be written.
+   */
+  bool needsChecksumUpdate(const Page& page) const;
+
+  /**
+   * Sets or clears the checksum of a page about to be written, depending on
+   * whether checksums are on.
+   *
+   * @param page  Copy of the page to be written.
+   */
+  void setChecksum(Page& page) const;
+
+  /**
+   * Writes a complete page image to its place in the file, compressed if
+   * compression is on and it pays off.
+   *
+   * @param page_number   Number of page to write.
+   * @param image         Page::SIZE bytes to write.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void writePageImage(const PageId page_number, const char* image);
+
+  /**
+   * Reads a page from its place in the file, decompressing it if it is stored
+   * compressed, without verifying its checksum.  No bounds checking is
+   * performed.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Receives the page.
+   * @throws  FileIOException  If the operating system reports an error or
+   *                           the compressed page is malformed.
+   */
+  void readStoredPage(const PageId page_number, Page& page) const;
+
+  /**
+   * Decompresses, in place, a page read as stored, if it is stored compressed.
+   *
+   * @param page  Page as read from the file.
+   * @throws  FileIOException  If the compressed page is malformed.
+   */
+  void decodeStoredPage(Page& page) const;
+
+  /**
+   * Verifies the checksum of a page read from the file and, unless
+   * <allow_free> is set, that it is in use.
+   *
+   * @param page_number   Number of the page.
+   * @param allow_free    Whether to allow a free (unused) page.
+   * @param page          Page as read and decompressed.
+   * @throws  InvalidPageException  If the page is free and allow_free is not
+   *                                set.
+   * @throws  ChecksumMismatchException  If the page fails its checksum.
+   */
+  void verifyPage(const PageId page_number, const bool allow_free,
+                  const Page& page) const;
+
   /**
    * Reads only the header of the given page from disk (not the record data
    * or slot table).  No bounds checking is performed.
@@ -301,14 +624,133 @@ class File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Reads <length> bytes at <offset> from the file, or copies them from the
+   * mapping if the file is mapped.  Bytes past the end of the file read as
+   * zero.  Under direct I/O, transfers that are not suitably
+   * aligned must start on a page boundary and fit in one page.
+   *
+   * @param offset  Position in the file to read from.
+   * @param buffer  Buffer to read into.
+   * @param length  Number of bytes to read.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void readBlock(const off_t offset, void* buffer,
+                 const std::size_t length) const;
+
+  /**
+   * Writes <length> bytes at <offset> to the file.  Under direct I/O,
+   * transfers that are not suitably aligned must start on a page boundary and
+   * fit in one page; they are padded with zeros to the alignment boundary.
+   *
+   * @param offset  Position in the file to write to.
+   * @param buffer  Data to write.
+   * @param length  Number of bytes to write.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void writeBlock(const off_t offset, const void* buffer,
+                  const std::size_t length);
+
+  /**
+   * Writes the given buffers back to back starting at <offset>, in a single
+   * vectored write unless the operating system splits it.  Under direct I/O
+   * every buffer must be suitably aligned.  The buffer descriptors are
+   * modified.
+   *
+   * @param offset  Position in the file to write to.
+   * @param blocks  Buffers to write.
+   * @param count   Number of buffers.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void writeBlocks(const off_t offset, struct iovec* blocks, int count);
+
+  /**
+   * Reads the given buffers back to back starting at <offset>, in a single
+   * vectored read unless the operating system splits it.  Bytes past the end
+   * of the file read as zeros.  Under direct I/O every buffer must be suitably
+   * aligned.  The buffer descriptors are modified.
+   *
+   * @param offset  Position in the file to read from.
+   * @param blocks  Buffers to fill.
+   * @param count   Number of buffers.
+   * @throws  FileIOException  If the operating system reports an error.
+   */
+  void readBlocks(const off_t offset, struct iovec* blocks, int count) const;
+
+  /**
+   * @brief Operating system state of an opened file, shared by all File
+   *        objects for the same file.
+   */
+  struct FileHandle {
+    /**
+     * Descriptor of the underlying file.
+     */
+    int fd;
+
+    /**
+     * Whether the descriptor was opened for direct I/O.
+     */
+    bool direct;
+
+    /**
+     * Latch serializing operations that update file metadata.  Recursive
+     * because compound operations such as allocatePage() are built from the
+     * public reads and writes.
+     */
+    std::recursive_mutex latch;
+
+    /**
+     * Cached copy of the file's header, guarded by latch.
+     */
+    FileHeader header;
+
+    /**
+     * Whether header has changed since it was last written to disk.
+     */
+    bool header_dirty;
+
+    /**
+     * Copy of header.num_pages, which page reads check against without taking
+     * the latch.
+     */
+    std::atomic<PageId> num_pages;
+
+    /**
+     * Copy of header.checksums, which page reads and writes check without
+     * taking the latch.
+     */
+    std::atomic<bool> checksums;
+
+    /**
+     * Copy of header.compression, which page writes check without taking the
+     * latch.
+     */
+    std::atomic<bool> compression;
+
+    /**
+     * Read-only mapping of the whole file, or NULL if it is not mapped.
+     */
+    const char* mapping;
+
+    /**
+     * Length of mapping in bytes.
+     */
+    std::size_t mapping_length;
+
+    /**
+     * Unmaps the file and closes the descriptor.
+     */
+    ~FileHandle();
+  };
+
   typedef std::map<std::string,
-                   std::shared_ptr<std::fstream> > StreamMap;
+                   std::shared_ptr<FileHandle> > HandleMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
-   * Streams for opened files.
+   * Handles for opened files.
    */
-  static StreamMap open_streams_;
+  static HandleMap open_handles_;
 
   /**
    * Counts for opened files.
@@ -321,11 +763,48 @@ class File {
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Handle for underlying filesystem object.
+   */
+  std::shared_ptr<FileHandle> handle_;
+
+  /**
+   * Notes that a background read through this object has been queued.  Used
+   * by BufMgr::prefetchPages(), whose queued reads hold a pointer to the
+   * object rather than to its handle.
+   */
+  void beginBackgroundRead();
+
+  /**
+   * Notes that a background read through this object has finished.  The
+   * object must not be touched by the caller afterwards, as it may be
+   * destroyed as soon as the last read ends.
+   */
+  void endBackgroundRead();
+
+  /**
+   * Waits until all background reads through this object have finished.
+   */
+  void waitForBackgroundReads() const;
+
+  /**
+   * Number of background reads through this object that have been queued and
+   * have not finished yet.  Per object, not per handle: copies start at 0.
+   */
+  std::uint32_t background_reads_;
+
+  /**
+   * Latch guarding background_reads_.
+   */
+  mutable std::mutex background_latch_;
+
+  /**
+   * Signalled when background_reads_ drops to 0.
    */
-  std::shared_ptr<std::fstream> stream_;
+  mutable std::condition_variable background_done_;
 
   friend class FileIterator;
+  friend class BufFileIterator;
+  friend class BufMgr;
   friend class FileTest;
 };
 
@@ -0,0 +1,57 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_engine.h"
+
+namespace badgerdb {
+
+IOEngine::IOEngine(const unsigned num_threads)
+    : stopping_(false) {
+  for (unsigned i = 0; i < num_threads; ++i) {
+    workers_.push_back(std::thread(&IOEngine::work, this));
+  }
+}
+
+IOEngine::~IOEngine() {
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    stopping_ = true;
+  }
+  wakeup_.notify_all();
+  for (std::size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].join();
+  }
+}
+
+void IOEngine::enqueue(const std::function<void()>& job) {
+  {
+    std::lock_guard<std::mutex> guard(latch_);
+    queue_.push_back(job);
+  }
+  wakeup_.notify_one();
+}
+
+void IOEngine::work() {
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(latch_);
+      while (queue_.empty() && !stopping_) {
+        wakeup_.wait(lock);
+      }
+      // Keep going until the queue is drained, even while stopping.
+      if (queue_.empty()) {
+        return;
+      }
+      job = queue_.front();
+      queue_.pop_front();
+    }
+    job();
+  }
+}
+
+}
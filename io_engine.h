@@ -0,0 +1,105 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief Executes blocking I/O requests in the background.
+ *
+ * The engine owns a fixed set of worker threads which run submitted requests
+ * (typically File or BufMgr reads and writes) in FIFO order, so up to one
+ * request per worker is in flight at the same time.  Results and exceptions
+ * are delivered through std::future.
+ *
+ * Submission and completion are threadsafe.  Requests still queued when the
+ * engine is destroyed are run before the destructor returns.
+ */
+class IOEngine {
+ public:
+  /**
+   * Starts an engine with the given number of worker threads.
+   *
+   * @param num_threads   Number of requests that may be in flight at once.
+   */
+  explicit IOEngine(const unsigned num_threads);
+
+  /**
+   * Runs all queued requests and stops the worker threads.
+   */
+  ~IOEngine();
+
+  /**
+   * Queues a request for execution on a worker thread.
+   *
+   * @param request   Callable taking no arguments.
+   * @return  Future holding the request's result, or the exception it threw.
+   */
+  template <typename Request>
+  std::future<typename std::result_of<Request()>::type> submit(Request request) {
+    typedef typename std::result_of<Request()>::type Result;
+    std::shared_ptr<std::packaged_task<Result()> > task(
+        new std::packaged_task<Result()>(request));
+    std::future<Result> result = task->get_future();
+    enqueue([task]() { (*task)(); });
+    return result;
+  }
+
+ private:
+  IOEngine(const IOEngine&);
+  IOEngine& operator=(const IOEngine&);
+
+  /**
+   * Appends a job to the queue and wakes up a worker.
+   *
+   * @param job   Job to run.
+   */
+  void enqueue(const std::function<void()>& job);
+
+  /**
+   * Main loop of each worker thread.
+   */
+  void work();
+
+  /**
+   * Latch guarding queue_ and stopping_.
+   */
+  std::mutex latch_;
+
+  /**
+   * Signalled when a job is queued or the engine is stopping.
+   */
+  std::condition_variable wakeup_;
+
+  /**
+   * Jobs waiting for a worker.
+   */
+  std::deque<std::function<void()> > queue_;
+
+  /**
+   * Set once the destructor has started.
+   */
+  bool stopping_;
+
+  /**
+   * Worker threads.
+   */
+  std::vector<std::thread> workers_;
+};
+
+}
@@ -0,0 +1,227 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "log_manager.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+
+#include "crc32c.h"
+#include "exceptions/file_io_exception.h"
+
+namespace badgerdb {
+
+const Lsn LogManager::INVALID_LSN;
+
+LogManager::LogManager(const std::string& filename,
+                       const std::chrono::microseconds group_commit_delay)
+    : filename_(filename),
+      fd_(-1),
+      group_commit_delay_(group_commit_delay),
+      tail_start_(0),
+      flushed_lsn_(0),
+      flushing_(false) {
+  fd_ = ::open(filename_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    throw FileIOException(filename_, errno);
+  }
+
+  // Find the end of the last intact record; anything after it was being
+  // written when the log was last closed and is discarded.  A torn header
+  // may claim any length, so the length is checked against the file before
+  // the payload is read.
+  try {
+    struct stat info;
+    if (::fstat(fd_, &info) != 0) {
+      throw FileIOException(filename_, errno);
+    }
+    const Lsn size = info.st_size;
+    Lsn end = 0;
+    LogRecordHeader header;
+    std::vector<char> payload;
+    while (readFully(end, &header, sizeof(header))) {
+      if (header.length > size - end - sizeof(header)) {
+        break;
+      }
+      payload.resize(header.length);
+      if (header.length > 0 &&
+          !readFully(end + sizeof(header), &payload[0], header.length)) {
+        break;
+      }
+      if (header.checksum != checksum(header, payload.data())) {
+        break;
+      }
+      end += sizeof(header) + header.length;
+    }
+    if (::ftruncate(fd_, end) != 0) {
+      throw FileIOException(filename_, errno);
+    }
+    tail_start_ = flushed_lsn_ = end;
+  } catch (...) {
+    ::close(fd_);
+    throw;
+  }
+}
+
+LogManager::~LogManager() {
+  try {
+    flush(lastLsn());
+  } catch (...) {
+  }
+  ::close(fd_);
+}
+
+Lsn LogManager::append(const LogRecordType type, const void* data,
+                       const std::size_t length) {
+  LogRecordHeader header;
+  header.length = length;
+  header.type = type;
+  header.checksum = checksum(header, data);
+  const char* bytes = static_cast<const char*>(data);
+
+  std::lock_guard<std::mutex> guard(latch_);
+  tail_.insert(tail_.end(), reinterpret_cast<const char*>(&header),
+               reinterpret_cast<const char*>(&header) + sizeof(header));
+  tail_.insert(tail_.end(), bytes, bytes + length);
+  return tail_start_ + tail_.size();
+}
+
+void LogManager::flush(const Lsn lsn) {
+  std::unique_lock<std::mutex> lock(latch_);
+  while (flushed_lsn_ < std::min(lsn, tail_start_ + tail_.size())) {
+    if (flushing_) {
+      // Another thread is writing; its write may already cover this LSN.
+      flushed_.wait(lock);
+      continue;
+    }
+    flushing_ = true;
+    if (group_commit_delay_.count() > 0) {
+      lock.unlock();
+      std::this_thread::sleep_for(group_commit_delay_);
+      lock.lock();
+    }
+
+    // Take the whole tail, including records appended by threads that are
+    // still to call flush(); they will find them durable.
+    std::vector<char> batch;
+    batch.swap(tail_);
+    const Lsn start = tail_start_;
+    tail_start_ += batch.size();
+    lock.unlock();
+    try {
+      writeFully(start, batch.data(), batch.size());
+    } catch (...) {
+      lock.lock();
+      batch.insert(batch.end(), tail_.begin(), tail_.end());
+      tail_.swap(batch);
+      tail_start_ = start;
+      flushing_ = false;
+      flushed_.notify_all();
+      throw;
+    }
+    lock.lock();
+    flushed_lsn_ = start + batch.size();
+    flushing_ = false;
+    flushed_.notify_all();
+  }
+}
+
+Lsn LogManager::commit(const std::string& data) {
+  const Lsn lsn = append(LOG_COMMIT, data);
+  flush(lsn);
+  return lsn;
+}
+
+Lsn LogManager::flushedLsn() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return flushed_lsn_;
+}
+
+Lsn LogManager::lastLsn() const {
+  std::lock_guard<std::mutex> guard(latch_);
+  return tail_start_ + tail_.size();
+}
+
+bool LogManager::readRecord(Lsn& position, LogRecord& record) const {
+  const Lsn durable = flushedLsn();
+  LogRecordHeader header;
+  if (position + sizeof(header) > durable ||
+      !readFully(position, &header, sizeof(header))) {
+    return false;
+  }
+  const Lsn end = position + sizeof(header) + header.length;
+  if (end > durable) {
+    return false;
+  }
+  record.data.resize(header.length);
+  if (header.length > 0 &&
+      !readFully(position + sizeof(header), &record.data[0], header.length)) {
+    return false;
+  }
+  record.lsn = end;
+  record.type = header.type;
+  position = end;
+  return true;
+}
+
+std::uint32_t LogManager::checksum(const LogRecordHeader& header,
+                                   const void* data) {
+  const std::uint32_t crc =
+      crc32c(&header, offsetof(LogRecordHeader, checksum));
+  return crc32c(data, header.length, crc);
+}
+
+bool LogManager::readFully(const Lsn offset, void* buffer,
+                           const std::size_t length) const {
+  char* target = static_cast<char*>(buffer);
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t count =
+        ::pread(fd_, target + done, length - done, offset + done);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    if (count == 0) {
+      return false;
+    }
+    done += count;
+  }
+  return true;
+}
+
+void LogManager::writeFully(const Lsn offset, const char* buffer,
+                            const std::size_t length) {
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t count =
+        ::pwrite(fd_, buffer + done, length - done, offset + done);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw FileIOException(filename_, errno);
+    }
+    done += count;
+  }
+  while (::fdatasync(fd_) != 0) {
+    if (errno != EINTR) {
+      throw FileIOException(filename_, errno);
+    }
+  }
+}
+
+}
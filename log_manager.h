@@ -0,0 +1,280 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Kinds of log records.  The payload of each kind is defined by the
+ *        code that writes it; the log only stores it.
+ */
+enum LogRecordType {
+  /**
+   * A change to a page.
+   */
+  LOG_UPDATE = 1,
+
+  /**
+   * End of a transaction; its changes are durable once this record is.
+   */
+  LOG_COMMIT = 2,
+
+  /**
+   * Start of a checkpoint (see BufMgr::checkpoint()).  Has no payload.
+   */
+  LOG_CHECKPOINT_BEGIN = 3,
+
+  /**
+   * End of a checkpoint.  The payload is the LSN of its LOG_CHECKPOINT_BEGIN
+   * record: every change logged before that record is on disk.
+   */
+  LOG_CHECKPOINT_END = 4
+};
+
+/**
+ * @brief Header stored in front of every log record.
+ */
+struct LogRecordHeader {
+  /**
+   * Length of the payload following the header, in bytes.
+   */
+  std::uint32_t length;
+
+  /**
+   * Kind of record, one of LogRecordType.
+   */
+  std::uint32_t type;
+
+  /**
+   * CRC-32C of the fields above and the payload, by which a record torn by a
+   * crash is told from an intact one.
+   */
+  std::uint32_t checksum;
+};
+
+/**
+ * @brief A log record read back from the log.
+ */
+struct LogRecord {
+  /**
+   * LSN of the record, i.e. the log offset just past its end.
+   */
+  Lsn lsn;
+
+  /**
+   * Kind of record, one of LogRecordType.
+   */
+  std::uint32_t type;
+
+  /**
+   * Payload of the record.
+   */
+  std::string data;
+};
+
+/**
+ * @brief Write-ahead log with group commit.
+ *
+ * Records are appended to an in-memory tail and identified by their log
+ * sequence number (LSN), the offset in the log file just past the end of the
+ * record; LSNs therefore grow with every record and INVALID_LSN (0) precedes
+ * all of them.  flush() makes the log durable up to a given LSN.  Concurrent
+ * flushes are combined: one caller writes the whole tail appended so far with
+ * a single sequential write and fdatasync, and the others wait for it, so
+ * committing costs one log append no matter how many threads commit at once.
+ *
+ * The write-ahead rule is kept together with BufMgr (see
+ * BufMgr::attachLog()): whoever changes a page appends a record describing the
+ * change, stamps the page with the record's LSN through Page::set_lsn() and
+ * unpins the page dirty.  Before the buffer manager writes a dirty page back
+ * it flushes the log up to the page's LSN.  A commit appends a LOG_COMMIT
+ * record and flushes up to it; the changed pages themselves can be written
+ * back at any later time.
+ *
+ * All methods are threadsafe.
+ */
+class LogManager {
+ public:
+  /**
+   * Opens the log with the given name, creating it if it does not exist, and
+   * positions the tail after the last intact record.  The first record that
+   * is cut short or fails its checksum, as one being written during a crash
+   * would, is discarded with everything after it.
+   *
+   * @param filename        Name of the log file.
+   * @param group_commit_delay  Time the thread writing the tail waits for
+   *                        other threads to append before it writes; zero
+   *                        writes at once.
+   * @throws  FileIOException  If the log cannot be opened or read.
+   */
+  explicit LogManager(const std::string& filename,
+                      const std::chrono::microseconds group_commit_delay =
+                          std::chrono::microseconds(0));
+
+  /**
+   * Flushes the tail and closes the log.  Errors are swallowed.
+   */
+  ~LogManager();
+
+  /**
+   * Appends a record to the tail.  The record is not durable until flush()
+   * has been called with its LSN or a later one.
+   *
+   * @param type    Kind of record.
+   * @param data    Payload.
+   * @param length  Length of the payload in bytes.
+   * @return  LSN of the record.
+   */
+  Lsn append(const LogRecordType type, const void* data,
+             const std::size_t length);
+
+  /**
+   * Appends a record to the tail.
+   *
+   * @param type    Kind of record.
+   * @param data    Payload.
+   * @return  LSN of the record.
+   */
+  Lsn append(const LogRecordType type, const std::string& data) {
+    return append(type, data.data(), data.length());
+  }
+
+  /**
+   * Makes the log durable at least up to the given LSN, writing the tail if
+   * necessary.  Returns at once if it already is.
+   *
+   * @param lsn   LSN that must be durable.
+   * @throws  FileIOException  If the log cannot be written; the tail is kept
+   *                           and written by the next flush.
+   */
+  void flush(const Lsn lsn);
+
+  /**
+   * Appends a LOG_COMMIT record and waits until it is durable.
+   *
+   * @param data    Payload, e.g. the transaction identifier.
+   * @return  LSN of the commit record.
+   */
+  Lsn commit(const std::string& data);
+
+  /**
+   * Returns the LSN up to which the log is durable.
+   */
+  Lsn flushedLsn() const;
+
+  /**
+   * Returns the LSN of the last record appended, or INVALID_LSN if the log
+   * is empty.
+   */
+  Lsn lastLsn() const;
+
+  /**
+   * Reads the durable record starting at the given log offset.
+   *
+   * @param position  Offset of the record, 0 for the first one; advanced to
+   *                  the next record, i.e. set to the record's LSN.
+   * @param record    Receives the record.
+   * @return  False if there is no durable record at the offset.
+   * @throws  FileIOException  If the log cannot be read.
+   */
+  bool readRecord(Lsn& position, LogRecord& record) const;
+
+  /**
+   * Returns the name of the log file.
+   */
+  const std::string& filename() const { return filename_; }
+
+  /**
+   * LSN preceding every record.
+   */
+  static const Lsn INVALID_LSN = 0;
+
+ private:
+  // Not copyable: the log owns its file descriptor.
+  LogManager(const LogManager&);
+  LogManager& operator=(const LogManager&);
+
+  /**
+   * Reads exactly the given number of bytes at an offset of the log file.
+   *
+   * @return  False if the file ends first.
+   */
+  bool readFully(const Lsn offset, void* buffer,
+                 const std::size_t length) const;
+
+  /**
+   * Returns the checksum of a record; see LogRecordHeader::checksum.
+   */
+  static std::uint32_t checksum(const LogRecordHeader& header,
+                                const void* data);
+
+  /**
+   * Writes all of the given bytes at an offset of the log file and syncs the
+   * file.
+   */
+  void writeFully(const Lsn offset, const char* buffer,
+                  const std::size_t length);
+
+  /**
+   * Name of the log file.
+   */
+  const std::string filename_;
+
+  /**
+   * Descriptor of the log file.
+   */
+  int fd_;
+
+  /**
+   * Time the flushing thread waits for more records.
+   */
+  const std::chrono::microseconds group_commit_delay_;
+
+  /**
+   * Latch guarding all members below.
+   */
+  mutable std::mutex latch_;
+
+  /**
+   * Signalled whenever a flush finishes.
+   */
+  std::condition_variable flushed_;
+
+  /**
+   * Records appended but not yet handed to a flush.
+   */
+  std::vector<char> tail_;
+
+  /**
+   * Offset in the log of the first byte of tail_.  The LSN of the last record
+   * appended is tail_start_ + tail_.size().
+   */
+  Lsn tail_start_;
+
+  /**
+   * LSN up to which the log is durable.
+   */
+  Lsn flushed_lsn_;
+
+  /**
+   * True while a thread is writing part of the tail.
+   */
+  bool flushing_;
+};
+
+}
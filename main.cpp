@@ -1,10 +1,21 @@
 #include <iostream>
 #include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 //#include <stdio.h>
 #include <cstring>
+#include <map>
 #include <memory>
+#include <thread>
+#include <vector>
 #include "page.h"
 #include "buffer.h"
+#include "bufHashTbl.h"
+#include "buf_file_iterator.h"
+#include "buf_trace.h"
+#include "page_guard.h"
+#include "log_manager.h"
+#include "page_codec.h"
 #include "file_iterator.h"
 #include "page_iterator.h"
 #include "exceptions/file_not_found_exception.h"
@@ -12,6 +23,13 @@
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/hash_already_present_exception.h"
+#include "exceptions/hash_not_found_exception.h"
+#include "exceptions/insufficient_space_exception.h"
+#include "exceptions/invalid_record_exception.h"
+#include "exceptions/checksum_mismatch_exception.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/file_open_exception.h"
 
 #define PRINT_ERROR(str) \
 { \
@@ -36,6 +54,23 @@ void test3();
 void test4();
 void test5();
 void test6();
+void test7();
+void test8();
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
 void testBufMgr();
 
 int main() 
@@ -80,7 +115,7 @@ int main()
       for (PageIterator page_iter = curr_page.begin();
            page_iter != curr_page.end();
            ++page_iter) {
-        std::cout << "Found record: " << *page_iter
+        std::cout << "Found record: " << page_iter.view()
             << " on page " << curr_page.page_number() << "\n";
       }
     }
@@ -149,6 +184,25 @@ void testBufMgr()
 	//test5();
 	//test6();
 
+	//The tests below do not depend on the ones above or on each other.
+	test7();
+	test8();
+	test9();
+	test10();
+	test11();
+	test12();
+	test13();
+	test14();
+	test15();
+	test16();
+	test17();
+	test18();
+	test19();
+	test20();
+	test21();
+	test22();
+	test23();
+
 	//Close files before deleting them
 	file1.~File();
 	file2.~File();
@@ -321,3 +375,1624 @@ void test6()
 
 	bufMgr->flushFile(file1ptr);
 }
+
+void test7()
+{
+	//Hash table against a map: more entries than it was sized for, removals, and lookups of absent pages
+	BufHashTbl table(64);
+	std::map<std::pair<const File*, PageId>, FrameId> model;
+	const File* files[3] = {file1ptr, file2ptr, file3ptr};
+	FrameId frameNo;
+	srandom(7);
+	for (FrameId op = 0; op < 20000; op++)
+	{
+		const File* file = files[random() % 3];
+		const PageId pageNo = 1 + random() % 500;
+		std::map<std::pair<const File*, PageId>, FrameId>::iterator entry = model.find(std::make_pair(file, pageNo));
+		const bool present = entry != model.end();
+		if (table.tryLookup(file, pageNo, frameNo) != present || (present && frameNo != entry->second))
+		{
+			PRINT_ERROR("ERROR :: HASH TABLE LOOKUP DID NOT MATCH");
+		}
+
+		if (!present)
+		{
+			table.insert(file, pageNo, op);
+			model[std::make_pair(file, pageNo)] = op;
+		}
+		else if (random() % 2 == 0)
+		{
+			table.remove(file, pageNo);
+			model.erase(entry);
+		}
+		else if (table.tryInsert(file, pageNo, op))
+		{
+			PRINT_ERROR("ERROR :: Page is already in the hash table. It should not have been inserted again.");
+		}
+	}
+
+	for (std::map<std::pair<const File*, PageId>, FrameId>::iterator entry = model.begin(); entry != model.end(); ++entry)
+	{
+		table.lookup(entry->first.first, entry->first.second, frameNo);
+		if (frameNo != entry->second)
+		{
+			PRINT_ERROR("ERROR :: HASH TABLE LOOKUP DID NOT MATCH");
+		}
+	}
+
+	try
+	{
+		table.insert(model.begin()->first.first, model.begin()->first.second, 0);
+		PRINT_ERROR("ERROR :: Page is already in the hash table. Exception should have been thrown before execution reaches this point.");
+	}
+	catch(const HashAlreadyPresentException &e)
+	{
+	}
+
+	try
+	{
+		table.remove(file1ptr, 501);
+		PRINT_ERROR("ERROR :: Page is not in the hash table. Exception should have been thrown before execution reaches this point.");
+	}
+	catch(const HashNotFoundException &e)
+	{
+	}
+
+	std::cout << "Test 7 passed" << "\n";
+}
+
+void test8()
+{
+	//Every replacement policy serves the same pages; LRU-K and ARC keep a hot set through a one-time scan
+	const std::string& filename = "test.8";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+	const PageId hot = 10, scanned = 100;
+	PageId pageNos[hot + scanned];
+	{
+		File file = File::create(filename);
+		for (i = 0; i < hot + scanned; i++)
+		{
+			Page new_page = file.allocatePage();
+			pageNos[i] = new_page.page_number();
+			sprintf((char*)tmpbuf, "test.8 Page %u", pageNos[i]);
+			new_page.insertRecord(tmpbuf);
+			file.writePage(new_page);
+		}
+	}
+
+	const ReplacementPolicy::Type policies[3] = {ReplacementPolicy::CLOCK, ReplacementPolicy::LRU_K,
+	                                             ReplacementPolicy::ARC};
+	for (int p = 0; p < 3; p++)
+	{
+		File file = File::open(filename);
+		BufMgr pool(2 * hot, policies[p]);
+		for (int round = 0; round < 3; round++)
+		{
+			for (i = 0; i < hot + (round == 1 ? scanned : 0); i++)
+			{
+				pool.readPage(&file, pageNos[i], page);
+				sprintf((char*)tmpbuf, "test.8 Page %u", pageNos[i]);
+				if(strncmp(page->getRecord(RecordId{pageNos[i], 1}).c_str(), tmpbuf, strlen(tmpbuf)) != 0)
+				{
+					PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+				}
+				pool.unPinPage(&file, pageNos[i], false);
+			}
+			if (round == 1)
+				pool.clearBufStats();
+		}
+		//The last round only touches the hot set again
+		if (policies[p] != ReplacementPolicy::CLOCK && pool.getBufStats().misses != 0)
+		{
+			PRINT_ERROR("ERROR :: The scan evicted hot pages.");
+		}
+
+		for (i = 0; i < 2 * hot; i++)
+			pool.readPage(&file, pageNos[i], page);
+		try
+		{
+			pool.readPage(&file, pageNos[2 * hot], page);
+			PRINT_ERROR("ERROR :: No more frames left for allocation. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(const BufferExceededException &e)
+		{
+		}
+		for (i = 0; i < 2 * hot; i++)
+			pool.unPinPage(&file, pageNos[i], false);
+	}
+	File::remove(filename);
+
+	std::cout << "Test 8 passed" << "\n";
+}
+
+void test9()
+{
+	//Allocating and deleting pages against a model of the used list and the free list, which is reused last in
+	//first out before the file grows
+	const std::string& filename = "test.9";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		std::vector<PageId> used, freed;
+		PageId highest = 0;
+		srandom(9);
+		for (int op = 0; op < 2000; op++)
+		{
+			if (used.empty() || random() % 3 != 0)
+			{
+				Page new_page = file.allocatePage();
+				const PageId pageNo = new_page.page_number();
+				if (!freed.empty())
+				{
+					if (pageNo != freed.back())
+					{
+						PRINT_ERROR("ERROR :: The most recently deleted page should have been reused.");
+					}
+					freed.pop_back();
+				}
+				else if (pageNo != ++highest)
+				{
+					PRINT_ERROR("ERROR :: The file should have grown by one page.");
+				}
+				sprintf((char*)tmpbuf, "test.9 Page %u op %d", pageNo, op);
+				new_page.insertRecord(tmpbuf);
+				file.writePage(new_page);
+				used.push_back(pageNo);
+			}
+			else
+			{
+				const std::size_t victim = random() % used.size();
+				file.deletePage(used[victim]);
+				freed.push_back(used[victim]);
+				used.erase(used.begin() + victim);
+			}
+		}
+
+		//The used list holds the live pages in allocation order
+		std::size_t seen = 0;
+		for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+		{
+			if (seen == used.size() || (*iter).page_number() != used[seen])
+			{
+				PRINT_ERROR("ERROR :: Used pages were not found in allocation order.");
+			}
+			seen++;
+		}
+		if (seen != used.size())
+		{
+			PRINT_ERROR("ERROR :: Not all used pages were found.");
+		}
+
+		try
+		{
+			file.readPage(freed.empty() ? highest + 1 : freed.back());
+			PRINT_ERROR("ERROR :: Page is not in use. Exception should have been thrown before execution reaches this point.");
+		}
+		catch(const InvalidPageException &e)
+		{
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 9 passed" << "\n";
+}
+
+void test10()
+{
+	//Write-ahead log: a dirty page is only written after the log records of its changes, and a log reopened after a
+	//torn write ends at the last intact record
+	const std::string& filename = "test.10";
+	const std::string& logname = "test.10.log";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+	unlink(logname.c_str());
+
+	Lsn ends[4];
+	{
+		LogManager log(logname);
+		File file = File::create(filename);
+		BufMgr pool(1);
+		pool.attachLog(&log);
+		pool.allocPage(&file, pageno1, page);
+		page->insertRecord("logged");
+		const Lsn changed = log.append(LOG_UPDATE, "logged");
+		page->set_lsn(changed);
+		pool.unPinPage(&file, pageno1, true);
+		if (log.flushedLsn() >= changed)
+		{
+			PRINT_ERROR("ERROR :: The log should not have been flushed yet.");
+		}
+		//Evicting the page writes it, which must flush the log first
+		pool.allocPage(&file, pageno2, page);
+		if (log.flushedLsn() < changed)
+		{
+			PRINT_ERROR("ERROR :: The log was not flushed before the page was written.");
+		}
+		pool.unPinPage(&file, pageno2, false);
+		pool.flushFile(&file);
+
+		ends[0] = changed;
+		for (int r = 1; r < 4; r++)
+		{
+			sprintf((char*)tmpbuf, "test.10 record %d", r);
+			ends[r] = log.append(LOG_UPDATE, std::string(tmpbuf) + std::string(100, 'x'));
+		}
+		log.flush(ends[3]);
+	}
+	File::remove(filename);
+
+	//Cut the last record short: it is dropped
+	if (truncate(logname.c_str(), ends[3] - 10) != 0)
+	{
+		PRINT_ERROR("ERROR :: Could not truncate the log.");
+	}
+	{
+		LogManager log(logname);
+		if (log.lastLsn() != ends[2])
+		{
+			PRINT_ERROR("ERROR :: A torn record was not dropped.");
+		}
+	}
+
+	//Overwrite part of the second record: it fails its checksum and is dropped with the one after it
+	const int fd = open(logname.c_str(), O_WRONLY);
+	if (fd < 0 || pwrite(fd, "torn", 4, ends[1] - 20) != 4 || close(fd) != 0)
+	{
+		PRINT_ERROR("ERROR :: Could not overwrite the log.");
+	}
+	{
+		LogManager log(logname);
+		Lsn position = 0;
+		LogRecord record;
+		if (log.lastLsn() != ends[0] || !log.readRecord(position, record) || record.data != "logged" ||
+		    log.readRecord(position, record))
+		{
+			PRINT_ERROR("ERROR :: A corrupted record was not dropped.");
+		}
+
+		//Appending carries on after the last intact record
+		log.commit("test.10");
+	}
+	{
+		LogManager log(logname);
+		Lsn position = ends[0];
+		LogRecord record;
+		if (!log.readRecord(position, record) || record.type != LOG_COMMIT || record.data != "test.10")
+		{
+			PRINT_ERROR("ERROR :: The log did not continue after the last intact record.");
+		}
+	}
+	unlink(logname.c_str());
+
+	std::cout << "Test 10 passed" << "\n";
+}
+
+void test11()
+{
+	//Fuzzy checkpoints while other threads keep changing pages: pinned dirty pages are deferred, and once the
+	//threads are done a checkpoint leaves the file matching the pool
+	const std::string& filename = "test.11";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		BufMgr pool(64);
+		const int threads = 4, pagesPerThread = 8;
+		PageId pageNos[threads * pagesPerThread];
+		for (int p = 0; p < threads * pagesPerThread; p++)
+		{
+			pool.allocPage(&file, pageNos[p], page);
+			page->insertRecord("t0 v000000");
+			pool.unPinPage(&file, pageNos[p], true);
+		}
+
+		//A page held pinned is left dirty
+		pool.readPage(&file, pageNos[0], page);
+		CheckpointProgress progress = pool.checkpoint(8);
+		if (!progress.done || progress.pagesDeferred != 1 || progress.pagesWritten != threads * pagesPerThread - 1)
+		{
+			PRINT_ERROR("ERROR :: The checkpoint did not defer exactly the pinned page.");
+		}
+		pool.unPinPage(&file, pageNos[0], false);
+
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++)
+		{
+			workers.push_back(std::thread([&pool, &file, &pageNos, t]() {
+				char value[16];
+				for (int v = 1; v <= 2000; v++)
+				{
+					const PageId pageNo = pageNos[t * pagesPerThread + v % pagesPerThread];
+					Page* changed;
+					pool.readPage(&file, pageNo, changed);
+					sprintf(value, "t%d v%06d", t, v);
+					changed->updateRecord(RecordId{pageNo, 1}, value);
+					pool.unPinPage(&file, pageNo, true);
+				}
+			}));
+		}
+		for (int c = 0; c < 20; c++)
+		{
+			if (!pool.checkpointAsync(2).get().done)
+			{
+				PRINT_ERROR("ERROR :: A checkpoint did not finish.");
+			}
+		}
+		for (int t = 0; t < threads; t++)
+			workers[t].join();
+
+		pool.checkpoint();
+		for (int p = 0; p < threads * pagesPerThread; p++)
+		{
+			//The last value each thread wrote to the page
+			const int t = p / pagesPerThread, last = 2000 - (2000 - p % pagesPerThread) % pagesPerThread;
+			sprintf((char*)tmpbuf, "t%d v%06d", t, last);
+			if (file.readPage(pageNos[p]).getRecord(RecordId{pageNos[p], 1}) != tmpbuf)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+		pool.flushFile(&file);
+	}
+	File::remove(filename);
+
+	std::cout << "Test 11 passed" << "\n";
+}
+
+void test12()
+{
+	//Inserting, updating and deleting records against a model of the page; holes left behind must be reused by
+	//compacting the page, and no other record may change
+	const std::string& filename = "test.12";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		Page model_page = file.allocatePage();
+		const PageId pageNo = model_page.page_number();
+		std::map<SlotId, std::string> model;
+		srandom(12);
+		for (int op = 0; op < 20000; op++)
+		{
+			const std::string value(1 + random() % 300, (char)('a' + op % 26));
+			const int kind = model.empty() ? 0 : random() % 3;
+			if (kind == 0)
+			{
+				if (model_page.hasSpaceForRecord(value))
+				{
+					const RecordId added = model_page.insertRecord(value);
+					if (model.count(added.slot_number) != 0)
+					{
+						PRINT_ERROR("ERROR :: Insert reused a slot in use.");
+					}
+					model[added.slot_number] = value;
+				}
+				else
+				{
+					try
+					{
+						model_page.insertRecord(value);
+						PRINT_ERROR("ERROR :: Insert into a full page did not throw.");
+					}
+					catch(const InsufficientSpaceException &)
+					{
+					}
+				}
+			}
+			else
+			{
+				std::map<SlotId, std::string>::iterator chosen = model.begin();
+				std::advance(chosen, random() % model.size());
+				const RecordId changed = {pageNo, chosen->first};
+				if (kind == 1)
+				{
+					try
+					{
+						model_page.updateRecord(changed, value);
+						chosen->second = value;
+					}
+					catch(const InsufficientSpaceException &)
+					{
+						if (value.length() <= model_page.getFreeSpace() + chosen->second.length())
+						{
+							PRINT_ERROR("ERROR :: Update that fits did not succeed.");
+						}
+					}
+				}
+				else
+				{
+					model_page.deleteRecord(changed);
+					model.erase(chosen);
+					try
+					{
+						model_page.getRecord(changed);
+						PRINT_ERROR("ERROR :: Deleted record could still be read.");
+					}
+					catch(const InvalidRecordException &)
+					{
+					}
+				}
+			}
+
+			if (op % 100 == 0 || op == 19999)
+			{
+				//Records come back in slot order, as the model keeps them
+				std::map<SlotId, std::string>::const_iterator expected = model.begin();
+				for (PageIterator iter = model_page.begin(); iter != model_page.end(); ++iter, ++expected)
+				{
+					if (expected == model.end() || *iter != expected->second)
+					{
+						PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+					}
+				}
+				if (expected != model.end())
+				{
+					PRINT_ERROR("ERROR :: Records are missing from the page.");
+				}
+			}
+		}
+
+		//And the page survives a trip to disk
+		file.writePage(model_page);
+		const Page stored = file.readPage(pageNo);
+		for (std::map<SlotId, std::string>::const_iterator expected = model.begin(); expected != model.end(); ++expected)
+		{
+			if (stored.getRecord(RecordId{pageNo, expected->first}) != expected->second)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 12 passed" << "\n";
+}
+
+void test13()
+{
+	//Batch scans must find the same records as iterating over the page, whatever the batch size and with unused
+	//slots scattered and in long runs
+	Page scanned;
+	std::map<SlotId, std::string> model;
+	for (int r = 0; ; r++)
+	{
+		sprintf((char*)tmpbuf, "r%d", r);
+		if (!scanned.hasSpaceForRecord(tmpbuf))
+			break;
+		model[scanned.insertRecord(tmpbuf).slot_number] = tmpbuf;
+	}
+	srandom(13);
+	for (std::map<SlotId, std::string>::iterator slot = model.begin(); slot != model.end(); )
+	{
+		if (random() % 2 == 0 || (slot->first > 100 && slot->first <= 180))
+		{
+			scanned.deleteRecord(RecordId{scanned.page_number(), slot->first});
+			model.erase(slot++);
+		}
+		else
+			++slot;
+	}
+
+	const std::string prefix = "r1";
+	const RecordPredicate predicates[] = {RecordPredicate(), RecordPredicate::prefix(prefix),
+	                                      RecordPredicate::byteAt(2, '7')};
+	const std::size_t capacities[] = {1, 3, 4, 7, Page::MAX_SLOTS};
+	std::vector<ScannedRecord> batch(Page::MAX_SLOTS);
+	for (const RecordPredicate& predicate : predicates)
+	{
+		std::vector<std::pair<SlotId, std::string> > expected;
+		for (PageIterator iter = scanned.begin(); iter != scanned.end(); ++iter)
+		{
+			if (predicate.matches(RecordView(*iter)))
+				expected.push_back(std::make_pair(SlotId(0), *iter));
+		}
+		std::size_t e = 0;
+		for (std::map<SlotId, std::string>::const_iterator slot = model.begin(); slot != model.end(); ++slot)
+		{
+			if (predicate.matches(RecordView(slot->second)))
+			{
+				if (e == expected.size() || expected[e].second != slot->second)
+				{
+					PRINT_ERROR("ERROR :: The page iterator did not match the model.");
+				}
+				expected[e++].first = slot->first;
+			}
+		}
+		if (e != expected.size())
+		{
+			PRINT_ERROR("ERROR :: The page iterator did not match the model.");
+		}
+
+		for (std::size_t capacity : capacities)
+		{
+			std::vector<std::pair<SlotId, std::string> > found;
+			SlotId next = Page::INVALID_SLOT;
+			std::size_t count;
+			do
+			{
+				count = scanned.scanRecords(&batch[0], capacity, next, predicate);
+				if (count > capacity)
+				{
+					PRINT_ERROR("ERROR :: The scan overran its batch.");
+				}
+				for (std::size_t r = 0; r < count; r++)
+					found.push_back(std::make_pair(batch[r].slot_number, batch[r].record.str()));
+			} while (count == capacity);
+			if (found != expected)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+	}
+
+	std::cout << "Test 13 passed" << "\n";
+}
+
+void test14()
+{
+	//A page damaged on disk must fail its checksum when read, through the file and through the pool, without
+	//taking the pages around it along
+	const std::string& filename = "test.14";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		file.setChecksums(true);
+		BufMgr pool(8);
+		PageId pageNos[3];
+		RecordId rids[3];
+		for (int p = 0; p < 3; p++)
+		{
+			pool.allocPage(&file, pageNos[p], page);
+			sprintf((char*)tmpbuf, "test.14 Page %d", p);
+			rids[p] = page->insertRecord(tmpbuf);
+			pool.unPinPage(&file, pageNos[p], true);
+		}
+		pool.flushFile(&file);
+
+		//Flip one byte of the middle page's record
+		const int fd = open(filename.c_str(), O_RDWR);
+		const off_t position = (off_t)pageNos[1] * Page::SIZE + Page::SIZE - 1;
+		char byte;
+		if (fd < 0 || pread(fd, &byte, 1, position) != 1)
+		{
+			PRINT_ERROR("ERROR :: Could not read the page back.");
+		}
+		byte ^= 0x20;
+		if (pwrite(fd, &byte, 1, position) != 1)
+		{
+			PRINT_ERROR("ERROR :: Could not damage the page.");
+		}
+		close(fd);
+
+		try
+		{
+			file.readPage(pageNos[1]);
+			PRINT_ERROR("ERROR :: Damaged page was read from the file.");
+		}
+		catch(const ChecksumMismatchException &e)
+		{
+			if (e.page_number() != pageNos[1] || e.filename() != filename)
+			{
+				PRINT_ERROR("ERROR :: The checksum failure named the wrong page.");
+			}
+		}
+		for (int attempt = 0; attempt < 2; attempt++)
+		{
+			try
+			{
+				pool.readPage(&file, pageNos[1], page);
+				PRINT_ERROR("ERROR :: Damaged page was read into the pool.");
+			}
+			catch(const ChecksumMismatchException &)
+			{
+			}
+		}
+
+		//The pages around it still read, and the failed reads left no frame pinned
+		for (int p = 0; p < 3; p += 2)
+		{
+			sprintf((char*)tmpbuf, "test.14 Page %d", p);
+			if (file.readPage(pageNos[p]).getRecord(rids[p]) != tmpbuf)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+		Page* pinned[8];
+		PageId more[8];
+		for (int p = 0; p < 8; p++)
+			pool.allocPage(&file, more[p], pinned[p]);
+		for (int p = 0; p < 8; p++)
+			pool.unPinPage(&file, more[p], false);
+		pool.flushFile(&file);
+	}
+	File::remove(filename);
+
+	std::cout << "Test 14 passed" << "\n";
+}
+
+//Returns true if the page is stored compressed in the file
+bool storedCompressed(const std::string& filename, const PageId pageNo)
+{
+	//The file may end inside the last page when that one is stored compressed
+	std::vector<char> stored(Page::SIZE);
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0 || pread(fd, &stored[0], Page::SIZE, (off_t)pageNo * Page::SIZE) <= 0)
+	{
+		PRINT_ERROR("ERROR :: Could not read the page back.");
+	}
+	close(fd);
+	return isCompressedPage(&stored[0]);
+}
+
+void test15()
+{
+	//Pages written with compression on must read back the same after the file is reopened; sparse pages are
+	//stored compressed, full ones as they are, and turning compression off stores pages uncompressed again
+	const std::string& filename = "test.15";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	PageId sparse, full, holed;
+	std::vector<std::pair<RecordId, std::string> > records;
+	{
+		File file = File::create(filename);
+		file.setCompression(true);
+		BufMgr pool(8);
+		pool.allocPage(&file, sparse, page);
+		records.push_back(std::make_pair(page->insertRecord("test.15 sparse"), "test.15 sparse"));
+		pool.unPinPage(&file, sparse, true);
+
+		srandom(15);
+		pool.allocPage(&file, full, page);
+		for (;;)
+		{
+			std::string value(1 + random() % 40, 'x');
+			for (std::size_t c = 0; c < value.length(); c++)
+				value[c] = (char)('a' + random() % 26);
+			if (!page->hasSpaceForRecord(value))
+				break;
+			records.push_back(std::make_pair(page->insertRecord(value), value));
+		}
+		pool.unPinPage(&file, full, true);
+
+		//Deleted records leave zeroed holes between the ones kept
+		pool.allocPage(&file, holed, page);
+		std::vector<RecordId> added;
+		for (int r = 0; page->hasSpaceForRecord(std::string(100, 'h')); r++)
+			added.push_back(page->insertRecord(std::string(100, (char)('a' + r % 26))));
+		for (std::size_t r = 0; r < added.size(); r++)
+		{
+			if (r % 4 == 0)
+				records.push_back(std::make_pair(added[r], page->getRecord(added[r])));
+			else
+				page->deleteRecord(added[r]);
+		}
+		pool.unPinPage(&file, holed, true);
+		pool.flushFile(&file);
+	}
+
+	if (!storedCompressed(filename, sparse) || storedCompressed(filename, full) || !storedCompressed(filename, holed))
+	{
+		PRINT_ERROR("ERROR :: Pages were not stored as expected.");
+	}
+
+	{
+		File file = File::open(filename);
+		BufMgr pool(8);
+		for (std::vector<std::pair<RecordId, std::string> >::const_iterator record = records.begin(); record != records.end(); ++record)
+		{
+			pool.readPage(&file, record->first.page_number, page);
+			if (page->getRecord(record->first) != record->second)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			pool.unPinPage(&file, record->first.page_number, false);
+		}
+
+		//Written again with compression off, which the file remembered until now
+		if (!file.compression())
+		{
+			PRINT_ERROR("ERROR :: The file did not keep compression on.");
+		}
+		file.setCompression(false);
+		pool.readPage(&file, sparse, page);
+		pool.unPinPage(&file, sparse, true);
+		pool.flushFile(&file);
+		if (storedCompressed(filename, sparse))
+		{
+			PRINT_ERROR("ERROR :: Page was still stored compressed.");
+		}
+		if (file.readPage(sparse).getRecord(records.begin()->first) != "test.15 sparse")
+		{
+			PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 15 passed" << "\n";
+}
+
+void test16()
+{
+	//A trace must hold every pin, unpin, allocation and disposal made while it runs, in order per thread, with
+	//hits, dirty unpins and file names as they happened
+	const std::string& filename = "test.16";
+	const std::string& othername = "test.16.other";
+	const std::string& tracename = "test.16.trace";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+	try
+	{
+		File::remove(othername);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	struct Expected
+	{
+		PageId page_number;
+		std::uint8_t type;
+		std::uint8_t flags;
+	};
+	std::vector<Expected> expected;
+	const int otherPins = 500;
+	{
+		File file = File::create(filename);
+		File other = File::create(othername);
+		BufMgr pool(4);
+		PageId otherNo;
+		pool.allocPage(&other, otherNo, page);
+		pool.unPinPage(&other, otherNo, false);
+
+		pool.startTrace(tracename);
+		//Another thread pins pages of its own file meanwhile
+		std::thread worker([&pool, &other, otherNo]() {
+			for (int p = 0; p < otherPins; p++)
+			{
+				Page* pinned;
+				pool.readPage(&other, otherNo, pinned);
+				pool.unPinPage(&other, otherNo, false);
+			}
+		});
+		PageId pageNos[6];
+		for (int p = 0; p < 6; p++)
+		{
+			pool.allocPage(&file, pageNos[p], page);
+			pool.unPinPage(&file, pageNos[p], true);
+			const Expected allocated = {pageNos[p], TRACE_ALLOC, 0};
+			const Expected unpinned = {pageNos[p], TRACE_UNPIN, TRACE_DIRTY};
+			expected.push_back(allocated);
+			expected.push_back(unpinned);
+		}
+		//The last page is resident and the first one was evicted long ago
+		const PageId reread[] = {pageNos[5], pageNos[0]};
+		for (int p = 0; p < 2; p++)
+		{
+			pool.readPage(&file, reread[p], page);
+			pool.unPinPage(&file, reread[p], false);
+			const Expected pinned = {reread[p], TRACE_PIN, (std::uint8_t)(p == 0 ? TRACE_HIT : 0)};
+			const Expected unpinned = {reread[p], TRACE_UNPIN, 0};
+			expected.push_back(pinned);
+			expected.push_back(unpinned);
+		}
+		pool.disposePage(&file, pageNos[3]);
+		const Expected disposed = {pageNos[3], TRACE_DISPOSE, 0};
+		expected.push_back(disposed);
+		worker.join();
+		if (pool.stopTrace() != 0)
+		{
+			PRINT_ERROR("ERROR :: Events were recorded without a file.");
+		}
+
+		//Not traced any more
+		pool.readPage(&file, pageNos[0], page);
+		pool.unPinPage(&file, pageNos[0], false);
+		pool.flushFile(&file);
+		pool.flushFile(&other);
+	}
+
+	{
+		TraceReader reader(tracename);
+		TraceEvent event;
+		std::size_t next = 0;
+		int otherEvents = 0;
+		while (reader.next(event))
+		{
+			if (reader.filename(event.file) == othername)
+			{
+				otherEvents++;
+				continue;
+			}
+			if (reader.filename(event.file) != filename || next == expected.size() ||
+			    event.page_number != expected[next].page_number || event.type != expected[next].type ||
+			    event.flags != expected[next].flags)
+			{
+				PRINT_ERROR("ERROR :: The trace did not match what the pool did.");
+			}
+			next++;
+		}
+		if (next != expected.size() || otherEvents != 2 * otherPins || reader.numFiles() != 2)
+		{
+			PRINT_ERROR("ERROR :: Events are missing from the trace.");
+		}
+	}
+	File::remove(filename);
+	File::remove(othername);
+	unlink(tracename.c_str());
+
+	std::cout << "Test 16 passed" << "\n";
+}
+
+void test17()
+{
+	//A saved resident set must warm up a later pool: pages come back with their contents and are hits, the hottest
+	//ones first when not all fit, and pages deleted or already resident since are skipped
+	const std::string& filename = "test.17";
+	const std::string& residentname = "test.17.resident";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		std::vector<File*> files(1, &file);
+		PageId pageNos[20];
+		RecordId rids[20];
+		{
+			BufMgr pool(8, ReplacementPolicy::LRU_K);
+			for (int p = 0; p < 20; p++)
+			{
+				pool.allocPage(&file, pageNos[p], page);
+				sprintf((char*)tmpbuf, "test.17 Page %d", p);
+				rids[p] = page->insertRecord(tmpbuf);
+				pool.unPinPage(&file, pageNos[p], true);
+			}
+			//Pages 12 to 19 are resident, 12 to 15 the hottest
+			for (int round = 0; round < 2; round++)
+			{
+				for (int p = 12; p < 16; p++)
+				{
+					pool.readPage(&file, pageNos[p], page);
+					pool.unPinPage(&file, pageNos[p], false);
+				}
+			}
+			//Saved before flushing, which drops the file's pages from the pool
+			pool.saveResidentSet(residentname);
+			pool.disposePage(&file, pageNos[19]);
+			pool.flushFile(&file);
+		}
+
+		{
+			BufMgr pool(16, ReplacementPolicy::LRU_K);
+			pool.readPage(&file, pageNos[12], page);
+			pool.unPinPage(&file, pageNos[12], false);
+			if (pool.preloadResidentSet(residentname, files) != 6)
+			{
+				PRINT_ERROR("ERROR :: Wrong number of pages preloaded.");
+			}
+			pool.clearBufStats();
+			for (int p = 12; p < 19; p++)
+			{
+				pool.readPage(&file, pageNos[p], page);
+				sprintf((char*)tmpbuf, "test.17 Page %d", p);
+				if (page->getRecord(rids[p]) != tmpbuf)
+				{
+					PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+				}
+				pool.unPinPage(&file, pageNos[p], false);
+			}
+			const BufStats stats = pool.getBufStats();
+			if (stats.hits != 7 || stats.misses != 0)
+			{
+				PRINT_ERROR("ERROR :: Preloaded pages were not hits.");
+			}
+			pool.flushFile(&file);
+		}
+
+		{
+			BufMgr pool(3, ReplacementPolicy::LRU_K);
+			if (pool.preloadResidentSet(residentname, files) != 3)
+			{
+				PRINT_ERROR("ERROR :: Wrong number of pages preloaded.");
+			}
+			//Under LRU-K, 15 to 13 had the latest second to last accesses, so they are the ones loaded; read first,
+			//they are hits and only 12 misses
+			pool.clearBufStats();
+			for (int p = 15; p >= 12; p--)
+			{
+				pool.readPage(&file, pageNos[p], page);
+				pool.unPinPage(&file, pageNos[p], false);
+			}
+			const BufStats stats = pool.getBufStats();
+			if (stats.hits != 3 || stats.misses != 1)
+			{
+				PRINT_ERROR("ERROR :: The hottest pages were not the ones preloaded.");
+			}
+			pool.flushFile(&file);
+		}
+	}
+	File::remove(filename);
+	unlink(residentname.c_str());
+
+	std::cout << "Test 17 passed" << "\n";
+}
+
+void test18()
+{
+	//Pages of a mapped file are read in place, directly and through the pool, and the file cannot be written to;
+	//files with compression on cannot be mapped
+	const std::string& filename = "test.18";
+	const std::string& compressedname = "test.18.compressed";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+	try
+	{
+		File::remove(compressedname);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	PageId pageNos[10];
+	RecordId rids[10];
+	{
+		File file = File::create(filename);
+		for (int p = 0; p < 10; p++)
+		{
+			Page written = file.allocatePage();
+			sprintf((char*)tmpbuf, "test.18 Page %d", p);
+			rids[p] = written.insertRecord(tmpbuf);
+			pageNos[p] = written.page_number();
+			file.writePage(written);
+		}
+		File compressed = File::create(compressedname);
+		compressed.setCompression(true);
+		compressed.writePage(compressed.allocatePage());
+	}
+
+	{
+		File file = File::openMapped(filename, File::SEQUENTIAL);
+		if (!file.isMapped())
+		{
+			PRINT_ERROR("ERROR :: The file was not mapped.");
+		}
+		BufMgr pool(4);
+		for (int p = 0; p < 10; p++)
+		{
+			sprintf((char*)tmpbuf, "test.18 Page %d", p);
+			const Page* mapped = file.mappedPage(pageNos[p]);
+			pool.readPage(&file, pageNos[p], page);
+			if (mapped->getRecord(rids[p]) != tmpbuf || page != mapped)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+			//Mapped pages take no frame, so the small pool never runs out
+			pool.unPinPage(&file, pageNos[p], false);
+		}
+		try
+		{
+			file.mappedPage(pageNos[9] + 1);
+			PRINT_ERROR("ERROR :: Page past the end of the mapped file was returned.");
+		}
+		catch(const InvalidPageException &)
+		{
+		}
+
+		try
+		{
+			Page changed = *file.mappedPage(pageNos[0]);
+			changed.insertRecord("test.18 changed");
+			file.writePage(changed);
+			PRINT_ERROR("ERROR :: Mapped file was written to.");
+		}
+		catch(const FileIOException &)
+		{
+		}
+		try
+		{
+			pool.writePageGuarded(&file, pageNos[0]);
+			PRINT_ERROR("ERROR :: Mapped page was pinned for writing.");
+		}
+		catch(const FileIOException &)
+		{
+		}
+		try
+		{
+			File::openMapped(filename);
+			PRINT_ERROR("ERROR :: Open file was mapped again.");
+		}
+		catch(const FileOpenException &)
+		{
+		}
+		if (file.mappedPage(pageNos[0])->getRecord(rids[0]) != "test.18 Page 0")
+		{
+			PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+		}
+	}
+
+	try
+	{
+		File::openMapped(compressedname);
+		PRINT_ERROR("ERROR :: File with compression on was mapped.");
+	}
+	catch(const FileIOException &)
+	{
+	}
+	File::remove(filename);
+	File::remove(compressedname);
+
+	std::cout << "Test 18 passed" << "\n";
+}
+
+void test19()
+{
+	//Bulk allocation appends consecutively numbered pages to the used list without reusing deleted ones; running out
+	//of frames allocates nothing and leaves nothing pinned
+	const std::string& filename = "test.19";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		std::vector<PageId> expected;
+		for (int p = 0; p < 3; p++)
+		{
+			Page written = file.allocatePage();
+			written.insertRecord("test.19 single");
+			file.writePage(written);
+			expected.push_back(written.page_number());
+		}
+		file.deletePage(expected[1]);
+		expected.erase(expected.begin() + 1);
+
+		BufMgr pool(32);
+		std::vector<PageId> pageNos;
+		std::vector<Page*> pages;
+		pool.allocPages(&file, 20, pageNos, pages);
+		for (std::size_t p = 0; p < pageNos.size(); p++)
+		{
+			if (pageNos[p] != 4 + p || pages[p]->page_number() != pageNos[p])
+			{
+				PRINT_ERROR("ERROR :: Bulk allocated pages are not consecutive.");
+			}
+			sprintf((char*)tmpbuf, "test.19 Page %u", pageNos[p]);
+			pages[p]->insertRecord(tmpbuf);
+			pool.unPinPage(&file, pageNos[p], true);
+			expected.push_back(pageNos[p]);
+		}
+		pool.flushFile(&file);
+
+		//The used list runs through the old pages and then the new ones, linked both ways
+		std::size_t e = 0;
+		PageId previous = Page::INVALID_NUMBER;
+		for (FileIterator iter = file.begin(); iter != file.end(); ++iter, ++e)
+		{
+			const Page listed = *iter;
+			if (e == expected.size() || listed.page_number() != expected[e] || listed.prev_page_number() != previous)
+			{
+				PRINT_ERROR("ERROR :: Bulk allocated pages are not linked into the used list.");
+			}
+			if (e >= 2)
+			{
+				sprintf((char*)tmpbuf, "test.19 Page %u", listed.page_number());
+				if (listed.getRecord(RecordId{listed.page_number(), 1}) != tmpbuf)
+				{
+					PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+				}
+			}
+			previous = listed.page_number();
+		}
+		if (e != expected.size())
+		{
+			PRINT_ERROR("ERROR :: Pages are missing from the used list.");
+		}
+
+		//With 20 frames pinned, 20 more pages do not fit
+		for (std::size_t p = 0; p < 20; p++)
+			pool.readPage(&file, pageNos[p], page);
+		std::vector<PageId> moreNos;
+		std::vector<Page*> more;
+		try
+		{
+			pool.allocPages(&file, 20, moreNos, more);
+			PRINT_ERROR("ERROR :: Bulk allocation into a short pool did not throw.");
+		}
+		catch(const BufferExceededException &)
+		{
+		}
+		if (!moreNos.empty() || !more.empty())
+		{
+			PRINT_ERROR("ERROR :: A failed bulk allocation returned pages.");
+		}
+		for (std::size_t p = 0; p < 20; p++)
+			pool.unPinPage(&file, pageNos[p], false);
+
+		//Every frame is free to take again, and the file did not grow
+		pool.allocPages(&file, 32, moreNos, more);
+		if (moreNos.front() != pageNos.back() + 1)
+		{
+			PRINT_ERROR("ERROR :: A failed bulk allocation allocated pages.");
+		}
+		for (std::size_t p = 0; p < moreNos.size(); p++)
+			pool.unPinPage(&file, moreNos[p], false);
+		pool.flushFile(&file);
+	}
+	File::remove(filename);
+
+	std::cout << "Test 19 passed" << "\n";
+}
+
+//Returns true if the resident page is pinned, leaving its pin count as it was
+bool isPinned(BufMgr& pool, File* file, const PageId pageNo)
+{
+	try
+	{
+		pool.unPinPage(file, pageNo, false);
+	}
+	catch(const PageNotPinnedException &)
+	{
+		return false;
+	}
+	Page* repinned;
+	pool.readPage(file, pageNo, repinned);
+	return true;
+}
+
+//Returns the number of pages flushFile() writes out
+std::uint64_t pagesFlushed(BufMgr& pool, File* file)
+{
+	pool.clearBufStats();
+	pool.flushFile(file);
+	return pool.getBufStats().diskwrites;
+}
+
+void test20()
+{
+	//Page guards hold one pin for as long as they hold the page, pass it on when moved, and unpin dirty exactly
+	//when the page was accessed for writing
+	const std::string& filename = "test.20";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		BufMgr pool(8);
+		PageId pageNos[4];
+		for (int p = 0; p < 4; p++)
+		{
+			pool.allocPage(&file, pageNos[p], page);
+			page->insertRecord("test.20 original");
+			pool.unPinPage(&file, pageNos[p], true);
+		}
+		pool.flushFile(&file);
+		const RecordId first = {pageNos[0], 1};
+
+		{
+			ReadPageGuard reading = pool.readPageGuarded(&file, pageNos[0]);
+			if (!isPinned(pool, &file, pageNos[0]) || reading->getRecord(first) != "test.20 original")
+			{
+				PRINT_ERROR("ERROR :: Read guard does not hold the page.");
+			}
+		}
+		if (isPinned(pool, &file, pageNos[0]))
+		{
+			PRINT_ERROR("ERROR :: Read guard left the page pinned.");
+		}
+
+		//Only reading through a write guard leaves the page clean
+		{
+			WritePageGuard writing = pool.writePageGuarded(&file, pageNos[0]);
+			const WritePageGuard& reading = writing;
+			if (reading->getRecord(first) != "test.20 original")
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+		if (isPinned(pool, &file, pageNos[0]) || pagesFlushed(pool, &file) != 0)
+		{
+			PRINT_ERROR("ERROR :: Write guard read from made the page dirty.");
+		}
+		{
+			WritePageGuard writing = pool.writePageGuarded(&file, pageNos[0]);
+			writing->updateRecord(first, "test.20 changed");
+		}
+		if (isPinned(pool, &file, pageNos[0]) || pagesFlushed(pool, &file) != 1 ||
+		    file.readPage(pageNos[0]).getRecord(first) != "test.20 changed")
+		{
+			PRINT_ERROR("ERROR :: Write guard did not unpin the page dirty.");
+		}
+
+		//Moving passes on the pin and the dirty flag
+		{
+			WritePageGuard moved = pool.writePageGuarded(&file, pageNos[1]);
+			moved->updateRecord(RecordId{pageNos[1], 1}, "test.20 moved");
+			WritePageGuard holder(std::move(moved));
+			if (moved.holdsPage() || !holder.holdsPage() || holder.page_number() != pageNos[1])
+			{
+				PRINT_ERROR("ERROR :: Moving the guard did not move the page.");
+			}
+		}
+		if (isPinned(pool, &file, pageNos[1]) || pagesFlushed(pool, &file) != 1)
+		{
+			PRINT_ERROR("ERROR :: Moved guard did not unpin the page dirty once.");
+		}
+
+		//Assigning over a guard releases the page it held first
+		{
+			ReadPageGuard target = pool.readPageGuarded(&file, pageNos[2]);
+			ReadPageGuard source = pool.readPageGuarded(&file, pageNos[3]);
+			target = std::move(source);
+			if (isPinned(pool, &file, pageNos[2]) || !isPinned(pool, &file, pageNos[3]) || source.holdsPage() ||
+			    target.page_number() != pageNos[3])
+			{
+				PRINT_ERROR("ERROR :: Assigning the guard did not swap the pages held.");
+			}
+		}
+		if (isPinned(pool, &file, pageNos[3]))
+		{
+			PRINT_ERROR("ERROR :: Assigned guard left the page pinned.");
+		}
+		{
+			WritePageGuard target = pool.writePageGuarded(&file, pageNos[2]);
+			target->updateRecord(RecordId{pageNos[2], 1}, "test.20 assigned");
+			WritePageGuard source = pool.writePageGuarded(&file, pageNos[3]);
+			target = std::move(source);
+		}
+		if (pagesFlushed(pool, &file) != 1 ||
+		    file.readPage(pageNos[2]).getRecord(RecordId{pageNos[2], 1}) != "test.20 assigned")
+		{
+			PRINT_ERROR("ERROR :: Assigned over guard was not unpinned dirty.");
+		}
+
+		//Releasing early unpins once
+		{
+			WritePageGuard writing = pool.writePageGuarded(&file, pageNos[3]);
+			writing.release();
+			writing.release();
+			if (writing.holdsPage() || isPinned(pool, &file, pageNos[3]))
+			{
+				PRINT_ERROR("ERROR :: Released guard still holds the page.");
+			}
+		}
+		pool.flushFile(&file);
+	}
+	File::remove(filename);
+
+	std::cout << "Test 20 passed" << "\n";
+}
+
+void test21()
+{
+	//An asynchronous batch pins resident pages at once and reads the others in the background; a page that cannot
+	//be read comes back as the exception readPage() would throw
+	const std::string& filename = "test.21";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		BufMgr pool(16);
+		PageId pageNos[12];
+		for (int p = 0; p < 12; p++)
+		{
+			pool.allocPage(&file, pageNos[p], page);
+			sprintf((char*)tmpbuf, "test.21 Page %d", p);
+			page->insertRecord(tmpbuf);
+			pool.unPinPage(&file, pageNos[p], true);
+		}
+		pool.flushFile(&file);
+		for (int p = 0; p < 12; p += 3)
+		{
+			pool.readPage(&file, pageNos[p], page);
+			pool.unPinPage(&file, pageNos[p], false);
+		}
+
+		std::vector<std::pair<File*, PageId> > requests;
+		for (int p = 0; p < 12; p++)
+			requests.push_back(std::make_pair(&file, pageNos[p]));
+		requests.push_back(std::make_pair(&file, pageNos[11] + 50));
+		pool.clearBufStats();
+		std::vector<std::future<Page*> > results = pool.readPagesAsync(requests);
+		if (results.size() != requests.size())
+		{
+			PRINT_ERROR("ERROR :: Wrong number of results.");
+		}
+		for (int p = 0; p < 12; p++)
+		{
+			if (p % 3 == 0 && results[p].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				PRINT_ERROR("ERROR :: Resident page was not ready at once.");
+			}
+			Page* read = results[p].get();
+			sprintf((char*)tmpbuf, "test.21 Page %d", p);
+			if (read->getRecord(RecordId{pageNos[p], 1}) != tmpbuf)
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+		try
+		{
+			results[12].get();
+			PRINT_ERROR("ERROR :: Page that does not exist was read.");
+		}
+		catch(const InvalidPageException &)
+		{
+		}
+		const BufStats stats = pool.getBufStats();
+		if (stats.hits != 4 || stats.misses != 8)
+		{
+			PRINT_ERROR("ERROR :: Batch was not read as four hits and eight misses.");
+		}
+
+		//Every page came back pinned once
+		for (int p = 0; p < 12; p++)
+			pool.unPinPage(&file, pageNos[p], false);
+		pool.flushFile(&file);
+	}
+	File::remove(filename);
+
+	std::cout << "Test 21 passed" << "\n";
+}
+
+//Waits up to ten seconds for the record on disk to read as given
+bool waitForDisk(File& file, const RecordId& rid, const std::string& expected)
+{
+	for (int wait = 0; wait < 10000; wait++)
+	{
+		if (file.readPage(rid.page_number).getRecord(rid) == expected)
+			return true;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	return false;
+}
+
+void test22()
+{
+	//The background writer cleans dirty, unpinned frames without evicting them and leaves pinned ones alone;
+	//starting and stopping it twice is harmless, and it can be started again
+	const std::string& filename = "test.22";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		BufMgr pool(16);
+		PageId pageNos[9];
+		RecordId rids[9];
+		for (int p = 0; p < 9; p++)
+		{
+			pool.allocPage(&file, pageNos[p], page);
+			rids[p] = page->insertRecord("test.22 original");
+			pool.unPinPage(&file, pageNos[p], true);
+		}
+		pool.flushFile(&file);
+
+		//Eight pages are changed and unpinned, the ninth stays pinned
+		for (int p = 0; p < 9; p++)
+		{
+			pool.readPage(&file, pageNos[p], page);
+			page->updateRecord(rids[p], "test.22 changed");
+			pool.unPinPage(&file, pageNos[p], true);
+		}
+		pool.readPage(&file, pageNos[8], page);
+
+		pool.startBackgroundWriter(64, 1);
+		pool.startBackgroundWriter(64, 1000);
+		for (int p = 0; p < 8; p++)
+		{
+			if (!waitForDisk(file, rids[p], "test.22 changed"))
+			{
+				PRINT_ERROR("ERROR :: The background writer did not clean the page.");
+			}
+		}
+		pool.stopBackgroundWriter();
+		pool.stopBackgroundWriter();
+		if (file.readPage(pageNos[8]).getRecord(rids[8]) != "test.22 original")
+		{
+			PRINT_ERROR("ERROR :: The background writer wrote a pinned page.");
+		}
+
+		//The cleaned pages are still resident, and clean
+		pool.clearBufStats();
+		for (int p = 0; p < 8; p++)
+		{
+			Page* resident;
+			pool.readPage(&file, pageNos[p], resident);
+			pool.unPinPage(&file, pageNos[p], false);
+		}
+		const BufStats stats = pool.getBufStats();
+		if (stats.hits != 8 || stats.misses != 0 || stats.cleanEvictions + stats.dirtyEvictions != 0)
+		{
+			PRINT_ERROR("ERROR :: The background writer evicted pages.");
+		}
+
+		//Restarted, the writer picks up the page once it is unpinned
+		pool.unPinPage(&file, pageNos[8], false);
+		pool.startBackgroundWriter(64, 1);
+		if (!waitForDisk(file, rids[8], "test.22 changed"))
+		{
+			PRINT_ERROR("ERROR :: The restarted background writer did not clean the page.");
+		}
+		pool.stopBackgroundWriter();
+		pool.clearBufStats();
+		pool.flushFile(&file);
+		if (pool.getBufStats().diskwrites != 0)
+		{
+			PRINT_ERROR("ERROR :: Cleaned pages were still dirty.");
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 22 passed" << "\n";
+}
+
+void test23()
+{
+	//Scanning through the pool visits the same pages as FileIterator, writes back the pages marked dirty, and
+	//prefetches a window ahead only while page numbers are consecutive
+	const std::string& filename = "test.23";
+	try
+	{
+		File::remove(filename);
+	}
+	catch(const FileNotFoundException &)
+	{
+	}
+
+	{
+		File file = File::create(filename);
+		BufMgr pool(64);
+		for (int p = 1; p <= 40; p++)
+		{
+			PageId pageNo;
+			pool.allocPage(&file, pageNo, page);
+			sprintf((char*)tmpbuf, "test.23 Page %u", pageNo);
+			page->insertRecord(tmpbuf);
+			pool.unPinPage(&file, pageNo, true);
+		}
+		pool.flushFile(&file);
+		//The used list runs 1 to 10, then 21 to 40
+		for (PageId pageNo = 11; pageNo <= 20; pageNo++)
+			file.deletePage(pageNo);
+
+		std::vector<PageId> expected;
+		for (FileIterator iter = file.begin(); iter != file.end(); ++iter)
+			expected.push_back((*iter).page_number());
+
+		//Every third page is changed on the way
+		std::vector<PageId> scanned;
+		pool.clearBufStats();
+		for (BufFileIterator iter = BufFileIterator::begin(&pool, &file, 4); iter != BufFileIterator::end(&pool, &file);
+		     ++iter)
+		{
+			scanned.push_back(iter->page_number());
+			if (scanned.size() % 3 == 0)
+			{
+				(*iter).updateRecord(RecordId{iter->page_number(), 1}, "test.23 marked");
+				iter.markDirty();
+			}
+		}
+		if (scanned != expected)
+		{
+			PRINT_ERROR("ERROR :: The scan through the pool did not match FileIterator.");
+		}
+		if (pagesFlushed(pool, &file) != expected.size() / 3)
+		{
+			PRINT_ERROR("ERROR :: The scan did not write back exactly the pages marked dirty.");
+		}
+		std::size_t e = 0;
+		for (FileIterator iter = file.begin(); iter != file.end(); ++iter, ++e)
+		{
+			const Page stored = *iter;
+			sprintf((char*)tmpbuf, "test.23 Page %u", stored.page_number());
+			const std::string found = stored.getRecord(RecordId{stored.page_number(), 1});
+			if (found != ((e + 1) % 3 == 0 ? "test.23 marked" : tmpbuf))
+			{
+				PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+			}
+		}
+
+		//Stopping at page 23: pages up to 10 come in ahead of the scan, and 11 to 14 are asked for too but are
+		//deleted and not loaded.  The step from 10 to 21 prefetches nothing, and 22 prefetches up to 26.  Every
+		//page is read from disk once at most, prefetched or not.
+		pool.clearBufStats();
+		{
+			BufFileIterator iter = BufFileIterator::begin(&pool, &file, 4);
+			while (iter->page_number() != 22)
+				++iter;
+			//Moving the iterator moves its pin and its place in the window
+			BufFileIterator moved(std::move(iter));
+			if (iter != BufFileIterator::end(&pool, &file) || moved->page_number() != 22)
+			{
+				PRINT_ERROR("ERROR :: Moving the scan did not move its position.");
+			}
+			++moved;
+		}
+		pool.flushFile(&file);
+		const BufStats stats = pool.getBufStats();
+		if (stats.hits + stats.misses != 13 || stats.diskreads != 16)
+		{
+			PRINT_ERROR("ERROR :: The scan did not prefetch the expected window.");
+		}
+	}
+	File::remove(filename);
+
+	std::cout << "Test 23 passed" << "\n";
+}
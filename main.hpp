@@ -102,9 +102,15 @@
  *  badgerdb::File existing_file = badgerdb::File::open("filename.db");
  * @endcode
  *
- * Multiple File objects share the same stream to the underlying file.  The
- * stream will be automatically closed when the last File object is out of
- * scope; no explicit close command is necessary.
+ * Multiple File objects share the same descriptor for the underlying file.
+ * The descriptor will be automatically closed when the last File object is out
+ * of scope; no explicit close command is necessary.
+ *
+ * Files used through the buffer manager can be opened for direct I/O, which
+ * bypasses the operating system's page cache:
+ * @code
+ *  badgerdb::File direct_file = badgerdb::File::open("filename.db", true);
+ * @endcode
  *
  * You can delete a file with File::remove:
  * @code
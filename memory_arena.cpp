@@ -0,0 +1,144 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "memory_arena.h"
+
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Rounds <value> up to a multiple of <alignment>.
+ */
+std::size_t roundUp(const std::size_t value, const std::size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * NUMA policy preferring the given node, as defined by the kernel.
+ */
+const int PREFERRED_NODE_POLICY = 1;
+
+}
+
+MemoryArena::MemoryArena(const std::size_t bytes,
+                         const std::uint32_t num_nodes)
+    : base_(NULL), length_(bytes), huge_pages_(false) {
+  const int protection = PROT_READ | PROT_WRITE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+  if (bytes < HUGE_PAGE_SIZE) {
+    // Too small to benefit from huge pages.
+    void* memory = ::mmap(NULL, length_, protection, flags, -1, 0);
+    if (memory == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    base_ = memory;
+  } else {
+    length_ = roundUp(bytes, HUGE_PAGE_SIZE);
+#ifdef MAP_HUGETLB
+    void* memory = ::mmap(NULL, length_, protection, flags | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+      base_ = memory;
+      huge_pages_ = true;
+    }
+#endif
+    if (base_ == NULL) {
+      // Map one huge page more than needed and trim both ends, so that the
+      // arena starts on a huge page boundary as transparent huge pages
+      // require.
+      const std::size_t mapped = length_ + HUGE_PAGE_SIZE;
+      void* memory = ::mmap(NULL, mapped, protection, flags, -1, 0);
+      if (memory == MAP_FAILED) {
+        throw std::bad_alloc();
+      }
+      char* start = static_cast<char*>(memory);
+      char* aligned = reinterpret_cast<char*>(
+          roundUp(reinterpret_cast<std::uintptr_t>(start), HUGE_PAGE_SIZE));
+      if (aligned != start) {
+        ::munmap(start, aligned - start);
+      }
+      const std::size_t tail = (start + mapped) - (aligned + length_);
+      if (tail > 0) {
+        ::munmap(aligned + length_, tail);
+      }
+      base_ = aligned;
+#ifdef MADV_HUGEPAGE
+      ::madvise(base_, length_, MADV_HUGEPAGE);
+#endif
+    }
+  }
+
+  if (num_nodes > 1) {
+    bindToNodes(num_nodes);
+  }
+}
+
+MemoryArena::~MemoryArena() {
+  ::munmap(base_, length_);
+}
+
+void MemoryArena::bindToNodes(const std::uint32_t num_nodes) {
+#ifdef SYS_mbind
+  // Parts are whole huge pages so that no page straddles two nodes.
+  const std::size_t part = length_ / num_nodes / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+  if (part == 0 || num_nodes > sizeof(unsigned long) * 8) {
+    return;
+  }
+  char* start = static_cast<char*>(base_);
+  for (std::uint32_t node = 0; node < num_nodes; ++node) {
+    const std::size_t offset = node * part;
+    const std::size_t length = node + 1 == num_nodes ? length_ - offset : part;
+    const unsigned long node_mask = 1UL << node;
+    // Only a hint, so failure is not an error.
+    ::syscall(SYS_mbind, start + offset, length, PREFERRED_NODE_POLICY,
+              &node_mask, sizeof(node_mask) * 8, 0);
+  }
+#endif
+}
+
+std::uint32_t MemoryArena::availableNodes() {
+  // Lists the online nodes as ranges, e.g. "0-1" or "0,2-3".
+  std::ifstream online("/sys/devices/system/node/online");
+  std::string ranges;
+  if (!(online >> ranges)) {
+    return 1;
+  }
+  std::uint32_t highest = 0;
+  std::uint32_t number = 0;
+  for (std::size_t i = 0; i <= ranges.size(); ++i) {
+    if (i < ranges.size() && ranges[i] >= '0' && ranges[i] <= '9') {
+      number = number * 10 + (ranges[i] - '0');
+    } else {
+      if (number > highest) {
+        highest = number;
+      }
+      number = 0;
+    }
+  }
+  return highest + 1;
+}
+
+std::uint32_t MemoryArena::currentNode() {
+#ifdef SYS_getcpu
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (::syscall(SYS_getcpu, &cpu, &node, NULL) == 0) {
+    return node;
+  }
+#endif
+  return 0;
+}
+
+}
@@ -0,0 +1,96 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * @brief Large, page-aligned block of memory for a buffer pool's frames.
+ *
+ * Arenas of at least HUGE_PAGE_SIZE bytes are backed by explicit huge pages
+ * (MAP_HUGETLB) when the system has some reserved, and otherwise by ordinary
+ * pages aligned and marked for transparent huge pages, which cuts TLB misses
+ * on large pools.  The arena can also be split evenly across NUMA nodes, with
+ * each node's share placed in that node's memory.  Both are best effort:
+ * where the system does not support them the arena is plain memory.
+ */
+class MemoryArena {
+ public:
+  /**
+   * Huge page size the arena is sized and aligned for.
+   */
+  static const std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+  /**
+   * Allocates an arena.
+   *
+   * @param bytes       Size of the arena.
+   * @param num_nodes   Number of NUMA nodes to spread the arena over, in
+   *                    equal consecutive parts; 1 leaves placement to the
+   *                    operating system.
+   * @throws  std::bad_alloc  If the memory cannot be allocated.
+   */
+  MemoryArena(const std::size_t bytes, const std::uint32_t num_nodes);
+
+  /**
+   * Releases the arena's memory.
+   */
+  ~MemoryArena();
+
+  /**
+   * Returns the start of the arena, aligned to at least 4 KB.
+   */
+  void* base() const { return base_; }
+
+  /**
+   * Returns true if the arena is backed by explicit huge pages.
+   */
+  bool hugePages() const { return huge_pages_; }
+
+  /**
+   * Returns the number of NUMA nodes of this machine, or 1 if it cannot be
+   * determined.
+   */
+  static std::uint32_t availableNodes();
+
+  /**
+   * Returns the NUMA node the calling thread is running on, or 0 if it cannot
+   * be determined.
+   */
+  static std::uint32_t currentNode();
+
+ private:
+  MemoryArena(const MemoryArena&);
+  MemoryArena& operator=(const MemoryArena&);
+
+  /**
+   * Asks for each of <num_nodes> equal parts of the arena to be placed on the
+   * corresponding node.
+   */
+  void bindToNodes(const std::uint32_t num_nodes);
+
+  /**
+   * Start of the arena.
+   */
+  void* base_;
+
+  /**
+   * Length of the mapping holding the arena.
+   */
+  std::size_t length_;
+
+  /**
+   * Whether the arena is backed by explicit huge pages.
+   */
+  bool huge_pages_;
+};
+
+}
@@ -5,8 +5,15 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "crc32c.h"
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
 #include "exceptions/invalid_slot_exception.h"
@@ -25,31 +32,46 @@ void Page::initialize() {
   header_.free_space_upper_bound = DATA_SIZE;
   header_.num_slots = 0;
   header_.num_free_slots = 0;
+  header_.fragmented_bytes = 0;
+  header_.checksum = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
-  data_.assign(DATA_SIZE, char());
+  header_.prev_page_number = INVALID_NUMBER;
+  header_.lsn = 0;
+  std::memset(data_, 0, DATA_SIZE);
 }
 
-RecordId Page::insertRecord(const std::string& record_data) {
+RecordId Page::insertRecord(const RecordView& record_data) {
   if (!hasSpaceForRecord(record_data)) {
     throw InsufficientSpaceException(
         page_number(), record_data.length(), getFreeSpace());
   }
+  reserveContiguousSpace(record_data.length() +
+                         (header_.num_free_slots == 0 ? sizeof(PageSlot) : 0));
   const SlotId slot_number = getAvailableSlot();
   insertRecordInSlot(slot_number, record_data);
   return {page_number(), slot_number};
 }
 
-std::string Page::getRecord(const RecordId& record_id) const {
+RecordView Page::getRecordView(const RecordId& record_id) const {
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-  return data_.substr(slot.item_offset, slot.item_length);
+  return RecordView(&data_[slot.item_offset], slot.item_length);
 }
 
 void Page::updateRecord(const RecordId& record_id,
-                        const std::string& record_data) {
+                        const RecordView& record_data) {
   validateRecordId(record_id);
-  const PageSlot* slot = getSlot(record_id.slot_number);
+  PageSlot* slot = getSlot(record_id.slot_number);
+  if (record_data.length() <= slot->item_length) {
+    // The new version fits where the old one was; what it leaves over becomes
+    // a hole.
+    std::copy(record_data.begin(), record_data.end(),
+              &data_[slot->item_offset]);
+    header_.fragmented_bytes += slot->item_length - record_data.length();
+    slot->item_length = record_data.length();
+    return;
+  }
   const std::size_t free_space_after_delete =
       getFreeSpace() + slot->item_length;
   if (record_data.length() > free_space_after_delete) {
@@ -60,6 +82,7 @@ void Page::updateRecord(const RecordId& record_id,
   // record data in the same slot, and compaction might delete the slot if we
   // permit it.
   deleteRecord(record_id, false /* allow_slot_compaction */);
+  reserveContiguousSpace(record_data.length());
   insertRecordInSlot(record_id.slot_number, record_data);
 }
 
@@ -71,34 +94,7 @@ void Page::deleteRecord(const RecordId& record_id,
                         const bool allow_slot_compaction) {
   validateRecordId(record_id);
   PageSlot* slot = getSlot(record_id.slot_number);
-  data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset; 
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
-      }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
-    }
-  }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move = data_.substr(move_offset, move_bytes);
-    data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
-  }
-  header_.free_space_upper_bound += slot->item_length;
-
-  // Mark slot as unused.
-  slot->used = false;
-  slot->item_offset = 0;
-  slot->item_length = 0;
+  releaseRecordSpace(slot);
   ++header_.num_free_slots;
 
   if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
@@ -108,7 +104,7 @@ void Page::deleteRecord(const RecordId& record_id,
     for (SlotId i = 1; i < header_.num_slots; ++i) {
       // Traverse list backwards, looking for unused slots.
       const PageSlot* other_slot = getSlot(header_.num_slots - i);
-      if (!other_slot->used) {
+      if (!other_slot->used()) {
         ++num_slots_to_delete;
       } else {
         // Stop at the first used slot we find, since we can't move used slots
@@ -122,7 +118,115 @@ void Page::deleteRecord(const RecordId& record_id,
   }
 }
 
-bool Page::hasSpaceForRecord(const std::string& record_data) const {
+void Page::releaseRecordSpace(PageSlot* slot) {
+  std::memset(&data_[slot->item_offset], 0, slot->item_length);
+  if (slot->item_offset == header_.free_space_upper_bound) {
+    // The record borders on the free space, which simply grows over it.
+    header_.free_space_upper_bound += slot->item_length;
+  } else {
+    header_.fragmented_bytes += slot->item_length;
+  }
+
+  // Mark slot as unused.
+  slot->item_offset = 0;
+  slot->item_length = 0;
+}
+
+void Page::reserveContiguousSpace(const std::size_t length) {
+  if (getContiguousFreeSpace() < length && header_.fragmented_bytes > 0) {
+    compact();
+  }
+}
+
+void Page::compact() {
+  // Records are moved in order of decreasing offset, so each one slides
+  // towards the end of the page over space that is already free.
+  SlotId order[DATA_SIZE / sizeof(PageSlot)];
+  std::size_t count = 0;
+  for (SlotId i = 1; i <= header_.num_slots; ++i) {
+    if (getSlot(i)->used()) {
+      order[count++] = i;
+    }
+  }
+  std::sort(order, order + count, [this](const SlotId a, const SlotId b) {
+    return getSlot(a)->item_offset > getSlot(b)->item_offset;
+  });
+
+  std::uint16_t end = DATA_SIZE;
+  for (std::size_t i = 0; i < count; ++i) {
+    PageSlot* slot = getSlot(order[i]);
+    end -= slot->item_length;
+    if (slot->item_offset != end) {
+      std::memmove(&data_[end], &data_[slot->item_offset], slot->item_length);
+      slot->item_offset = end;
+    }
+  }
+  header_.free_space_upper_bound = end;
+  header_.fragmented_bytes = 0;
+}
+
+std::size_t Page::scanRecords(ScannedRecord* records,
+                              const std::size_t capacity, SlotId& next,
+                              const RecordPredicate& predicate) const {
+  const PageSlot* slots = &getSlot(1);
+  const SlotId last = header_.num_slots;
+  std::size_t count = 0;
+  SlotId i = std::max<SlotId>(next, 1);
+
+#if defined(__SSE2__)
+  // Four slots per step: a slot is unused iff its offset, the low 16 bits of
+  // its 32-bit lane, is zero.  Steps are only taken while four more records
+  // would fit.
+  const __m128i zero = _mm_setzero_si128();
+  while (i + 3 <= last && count + 4 <= capacity) {
+    const __m128i lanes = _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(&slots[i - 1]));
+    const int unused = _mm_movemask_epi8(_mm_cmpeq_epi16(lanes, zero));
+    const int used = ~unused & 0x1111;
+    if (used != 0) {
+      for (int j = 0; j < 4; ++j) {
+        if (used & (1 << (4 * j))) {
+          const PageSlot& slot = slots[i - 1 + j];
+          const RecordView record(&data_[slot.item_offset], slot.item_length);
+          if (predicate.matches(record)) {
+            records[count].slot_number = i + j;
+            records[count].record = record;
+            ++count;
+          }
+        }
+      }
+    }
+    i += 4;
+  }
+#endif
+
+  for (; i <= last && count < capacity; ++i) {
+    const PageSlot& slot = slots[i - 1];
+    if (!slot.used()) {
+      continue;
+    }
+    const RecordView record(&data_[slot.item_offset], slot.item_length);
+    if (predicate.matches(record)) {
+      records[count].slot_number = i;
+      records[count].record = record;
+      ++count;
+    }
+  }
+  next = i;
+  return count;
+}
+
+std::uint32_t Page::computeChecksum() const {
+  const char* bytes = reinterpret_cast<const char*>(this);
+  const std::size_t field = offsetof(PageHeader, checksum);
+  const std::size_t rest = field + sizeof(header_.checksum);
+  std::uint32_t crc = crc32c(bytes, field);
+  crc = crc32c(bytes + rest, SIZE - rest, crc);
+  // 0 means "no checksum".
+  return crc == 0 ? 1 : crc;
+}
+
+bool Page::hasSpaceForRecord(const RecordView& record_data) const {
   std::size_t record_size = record_data.length();
   if (header_.num_free_slots == 0) {
     record_size += sizeof(PageSlot);
@@ -144,7 +248,7 @@ SlotId Page::getAvailableSlot() {
     // Have an allocated but unused slot that we can reuse.
     for (SlotId i = 1; i <= header_.num_slots; ++i) {
       const PageSlot* slot = getSlot(i);
-      if (!slot->used) {
+      if (!slot->used()) {
         // We don't decrement the number of free slots until someone actually
         // puts data in the slot.
         slot_number = i;
@@ -157,28 +261,32 @@ SlotId Page::getAvailableSlot() {
     ++header_.num_slots;
     ++header_.num_free_slots;
     header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    // The space taken over may hold stale bytes of records moved by a
+    // compaction.
+    PageSlot* slot = getSlot(slot_number);
+    slot->item_offset = 0;
+    slot->item_length = 0;
   }
   assert(slot_number != INVALID_SLOT);
   return slot_number;
 }
 
 void Page::insertRecordInSlot(const SlotId slot_number,
-                              const std::string& record_data) {
+                              const RecordView& record_data) {
   if (slot_number > header_.num_slots ||
       slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
   }
   PageSlot* slot = getSlot(slot_number);
-  if (slot->used) {
+  if (slot->used()) {
     throw SlotInUseException(page_number(), slot_number);
   }
   const int record_length = record_data.length();
-  slot->used = true;
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
   --header_.num_free_slots;
-  data_.replace(slot->item_offset, slot->item_length, record_data);
+  std::copy(record_data.begin(), record_data.end(), &data_[slot->item_offset]);
 }
 
 void Page::validateRecordId(const RecordId& record_id) const {
@@ -186,7 +294,7 @@ void Page::validateRecordId(const RecordId& record_id) const {
     throw InvalidRecordException(record_id, page_number());
   }
   const PageSlot& slot = getSlot(record_id.slot_number);
-  if (!slot.used) {
+  if (!slot.used()) {
     throw InvalidRecordException(record_id, page_number());
   }
 }
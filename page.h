@@ -12,15 +12,26 @@
 #include <memory>
 #include <string>
 
+#include "record_view.h"
 #include "types.h"
 
+/**
+ * Page size in bytes, fixed when the library is built (for instance with
+ * -DBADGERDB_PAGE_SIZE=4096).  Small pages suit point lookups, large ones
+ * scans.  It must be a multiple of 4096 no larger than 65536, as record
+ * offsets are 16 bits.
+ */
+#ifndef BADGERDB_PAGE_SIZE
+#define BADGERDB_PAGE_SIZE 8192
+#endif
+
 namespace badgerdb {
 
 /**
  * @brief Header metadata in a page.
  *
  * Header metadata in each page which tracks where space has been used and
- * contains a pointer to the next page in the file.
+ * contains pointers to the next and previous pages in the file.
  */
 struct PageHeader {
   /**
@@ -47,6 +58,13 @@ struct PageHeader {
    */
   SlotId num_free_slots;
 
+  /**
+   * Bytes between the free space upper bound and the end of the page that no
+   * record uses any more (holes left by deleted or shrunk records).  They are
+   * reclaimed by compacting the page.
+   */
+  std::uint16_t fragmented_bytes;
+
   /**
    * Number of the page within the file.
    */
@@ -57,6 +75,25 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * Number of the previous used page in the file.
+   */
+  PageId prev_page_number;
+
+  /**
+   * CRC-32C of the page as written to a file with checksums enabled (see
+   * File::setChecksums()), computed with this field taken as zero; 0 if the
+   * page was written without a checksum.
+   */
+  std::uint32_t checksum;
+
+  /**
+   * LSN of the log record describing the latest change to the page, or 0 if
+   * the page has not been changed under a log.  The log must be durable up
+   * to this LSN before the page is written back.
+   */
+  Lsn lsn;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -67,22 +104,20 @@ struct PageHeader {
     return num_slots == rhs.num_slots &&
         num_free_slots == rhs.num_free_slots &&
         current_page_number == rhs.current_page_number &&
-        next_page_number == rhs.next_page_number;
+        next_page_number == rhs.next_page_number &&
+        prev_page_number == rhs.prev_page_number;
   }
 };
 
 /**
  * @brief Slot metadata that tracks where a record is in the data space.
+ *
+ * Slots are packed into four bytes.  Records always lie after the slot array,
+ * so a used slot never has offset 0, and an offset of 0 marks an unused slot.
  */
 struct PageSlot {
   /**
-   * Whether the slot currently holds data.  May be false if this slot's
-   * record has been deleted after insertion.
-   */
-  bool used;
-
-  /**
-   * Offset of the data item in the page.
+   * Offset of the data item in the page, or 0 if the slot is unused.
    */
   std::uint16_t item_offset;
 
@@ -90,6 +125,105 @@ struct PageSlot {
    * Length of the data item in this slot.
    */
   std::uint16_t item_length;
+
+  /**
+   * Returns whether the slot currently holds data.  May be false if this
+   * slot's record has been deleted after insertion.
+   */
+  bool used() const { return item_offset != 0; }
+};
+
+/**
+ * @brief A record found by Page::scanRecords().
+ */
+struct ScannedRecord {
+  /**
+   * Slot holding the record.
+   */
+  SlotId slot_number;
+
+  /**
+   * The record's bytes on the page.
+   */
+  RecordView record;
+};
+
+/**
+ * @brief Condition on the bytes of a record, evaluated by Page::scanRecords()
+ *        while it scans the slot array.
+ */
+class RecordPredicate {
+ public:
+  /**
+   * Constructs a predicate every record satisfies.
+   */
+  RecordPredicate()
+      : kind_(ALL),
+        position_(0),
+        value_(0) {
+  }
+
+  /**
+   * Returns a predicate satisfied by records starting with the given bytes.
+   * The bytes are not copied and must outlive the predicate.
+   *
+   * @param prefix  Bytes the record must start with.
+   */
+  static RecordPredicate prefix(const RecordView& prefix) {
+    RecordPredicate predicate;
+    predicate.kind_ = PREFIX;
+    predicate.prefix_ = prefix;
+    return predicate;
+  }
+
+  /**
+   * Returns a predicate satisfied by records with the given byte at the given
+   * position.
+   *
+   * @param position  Position of the byte in the record.
+   * @param value     Value the byte must have.
+   */
+  static RecordPredicate byteAt(const std::size_t position, const char value) {
+    RecordPredicate predicate;
+    predicate.kind_ = BYTE_AT;
+    predicate.position_ = position;
+    predicate.value_ = value;
+    return predicate;
+  }
+
+  /**
+   * Returns true if the record satisfies the predicate.
+   */
+  bool matches(const RecordView& record) const {
+    switch (kind_) {
+      case PREFIX:
+        return record.startsWith(prefix_);
+      case BYTE_AT:
+        return position_ < record.length() && record[position_] == value_;
+      case ALL:
+      default:
+        return true;
+    }
+  }
+
+ private:
+  enum Kind { ALL, PREFIX, BYTE_AT };
+
+  /**
+   * Kind of test.
+   */
+  Kind kind_;
+
+  /**
+   * Prefix tested for by PREFIX.
+   */
+  RecordView prefix_;
+
+  /**
+   * Position and value of the byte tested for by BYTE_AT.
+   */
+  std::size_t position_;
+  char value_;
 };
 
 class PageIterator;
@@ -102,21 +236,37 @@ class PageIterator;
  * slots and identified by a RecordId.  Although a record's actual contents may
  * be moved on the page, accessing a record by its slot is consistent.
  *
+ * A Page is a plain block of exactly SIZE bytes (header followed by data) with
+ * no heap allocations of its own, so it is read from and written to disk as is
+ * and an array of Pages is a contiguous run of frames.
+ *
  * @warning This class is not threadsafe.
  */
 class Page {
  public:
   /**
-   * Page size in bytes.  If this is changed, database files created with a
-   * different page size value will be unreadable by the resulting binaries.
+   * Page size in bytes, set by BADGERDB_PAGE_SIZE.  Database files record the
+   * page size they were created with and cannot be opened by binaries built
+   * with a different one.
    */
-  static const std::size_t SIZE = 8192;
+  static const std::size_t SIZE = BADGERDB_PAGE_SIZE;
 
   /**
    * Size of page free space area in bytes.
    */
   static const std::size_t DATA_SIZE = SIZE - sizeof(PageHeader);
 
+  /**
+   * Alignment of page frames in memory.  Frames aligned to this boundary can be
+   * used as buffers for direct (unbuffered) I/O.
+   */
+  static const std::size_t ALIGNMENT = 4096;
+
+  /**
+   * Largest number of slots a page can have.
+   */
+  static const std::size_t MAX_SLOTS = DATA_SIZE / sizeof(PageSlot);
+
   /**
    * Number of page indicating that it's invalid.
    */
@@ -138,7 +288,18 @@ class Page {
    * @param record_data  Bytes that compose the record.
    * @return  ID of the newly inserted record.
    */
-  RecordId insertRecord(const std::string& record_data);
+  RecordId insertRecord(const std::string& record_data) {
+    return insertRecord(RecordView(record_data));
+  }
+
+  /**
+   * Inserts a new record into the page, copying it from wherever the view
+   * points, which must not be this page.
+   *
+   * @param record_data  Bytes that compose the record.
+   * @return  ID of the newly inserted record.
+   */
+  RecordId insertRecord(const RecordView& record_data);
 
   /**
    * Returns the record with the given ID.  Returned data is a copy of what is
@@ -148,7 +309,19 @@ class Page {
    * @param record_id  ID of the record to return.
    * @return  The record.
    */
-  std::string getRecord(const RecordId& record_id) const;
+  std::string getRecord(const RecordId& record_id) const {
+    return getRecordView(record_id).str();
+  }
+
+  /**
+   * Returns a view of the record with the given ID, without copying it.  The
+   * view points into the page and is only valid until the record or the page
+   * changes, and for a buffer pool page only while the page is pinned.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  View of the record.
+   */
+  RecordView getRecordView(const RecordId& record_id) const;
 
   /**
    * Updates the record with the given ID, replacing its data with a new
@@ -158,12 +331,24 @@ class Page {
    * @param record_id   ID of record to update.
    * @param record_data Updated bytes that compose the record.
    */
-  void updateRecord(const RecordId& record_id, const std::string& record_data);
+  void updateRecord(const RecordId& record_id, const std::string& record_data) {
+    updateRecord(record_id, RecordView(record_data));
+  }
+
+  /**
+   * Updates the record with the given ID from bytes the view points to, which
+   * must not be on this page.
+   *
+   * @param record_id   ID of record to update.
+   * @param record_data Updated bytes that compose the record.
+   */
+  void updateRecord(const RecordId& record_id, const RecordView& record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Deletes the record with the given ID.  The record's bytes become a hole
+   * that is reclaimed only when an insert or update needs the space (see
+   * compact()), so deleting does not move other records.  Slot array is
+   * compacted if the slot deleted is at the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
    */
@@ -175,15 +360,20 @@ class Page {
    * @param record_data Bytes that compose the record.
    * @return  Whether the page can hold the data.
    */
-  bool hasSpaceForRecord(const std::string& record_data) const;
+  bool hasSpaceForRecord(const std::string& record_data) const {
+    return hasSpaceForRecord(RecordView(record_data));
+  }
+
+  bool hasSpaceForRecord(const RecordView& record_data) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes, including holes left by deleted
+   * records.
    *
    * @return  Free space in bytes.
    */
-  std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+  std::uint16_t getFreeSpace() const { return getContiguousFreeSpace() +
+                                              header_.fragmented_bytes; }
 
   /**
    * Returns this page's number in its file.
@@ -199,6 +389,52 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the number of the used page before this page in its file.
+   *
+   * @return  Page number of previous used page in file.
+   */
+  PageId prev_page_number() const { return header_.prev_page_number; }
+
+  /**
+   * Returns the LSN of the latest logged change to this page.
+   *
+   * @return  Page LSN.
+   */
+  Lsn lsn() const { return header_.lsn; }
+
+  /**
+   * Records that the page has been changed as described by the log record
+   * with the given LSN.  The LSN never moves backwards.
+   *
+   * @param new_lsn   LSN of the log record.
+   */
+  void set_lsn(const Lsn new_lsn) {
+    if (new_lsn > header_.lsn) {
+      header_.lsn = new_lsn;
+    }
+  }
+
+  /**
+   * Collects the records that satisfy a predicate, a slot array's worth at a
+   * time, rather than one record per iterator step.  Unused slots are skipped
+   * several at a time using SIMD compares where available.  The views are
+   * valid as long as getRecordView() says.
+   *
+   * @param records   Receives the records found, in slot order.
+   * @param capacity  Number of entries <records> can hold; MAX_SLOTS is
+   *                  always enough for the whole page.
+   * @param next      Slot to start at, 1 or INVALID_SLOT for the first one;
+   *                  set to the slot to resume at, beyond the last slot once
+   *                  the whole page has been scanned.
+   * @param predicate Condition records must satisfy.
+   * @return  Number of records stored in <records>.
+   */
+  std::size_t scanRecords(ScannedRecord* records, const std::size_t capacity,
+                          SlotId& next,
+                          const RecordPredicate& predicate =
+                              RecordPredicate()) const;
+
   /**
    * Returns an iterator at the first record in the page.
    *
@@ -220,6 +456,47 @@ class Page {
    */
   void initialize();
 
+  /**
+   * Computes the checksum to store in the page's header: the CRC-32C of the
+   * whole page except the checksum field, never 0.
+   *
+   * @return  Checksum of the page.
+   */
+  std::uint32_t computeChecksum() const;
+
+  /**
+   * Returns the free space between the slot array and the record data, i.e.
+   * the space usable without compacting the page.
+   *
+   * @return  Contiguous free space in bytes.
+   */
+  std::uint16_t getContiguousFreeSpace() const {
+    return header_.free_space_upper_bound - header_.free_space_lower_bound;
+  }
+
+  /**
+   * Moves all records to the end of the data area, in place, so that the
+   * holes left by deleted records become part of the contiguous free space.
+   * Record IDs do not change.
+   */
+  void compact();
+
+  /**
+   * Compacts the page if the contiguous free space is smaller than the given
+   * number of bytes.
+   *
+   * @param length  Bytes needed.
+   */
+  void reserveContiguousSpace(const std::size_t length);
+
+  /**
+   * Turns the data of the record in the given slot into a hole and marks the
+   * slot unused, without touching other records.
+   *
+   * @param slot  Slot of the record.
+   */
+  void releaseRecordSpace(PageSlot* slot);
+
   /**
    * Sets this page's number in its file.
    *
@@ -239,9 +516,17 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array and
+   * Sets the number of the previous used page before this page in its file.
+   *
+   * @param prev_page_number  Page number of previous used page in file.
+   */
+  void set_prev_page_number(const PageId new_prev_page_number) {
+    header_.prev_page_number = new_prev_page_number;
+  }
+
+  /**
+   * Deletes the record with the given ID, leaving a hole in the data.  Slot
+   * array is compacted if the slot deleted is at the end of the slot array and
    * <allow_slot_compaction> is set.
    *
    * @param record_id             ID of the record to delete.
@@ -301,7 +586,7 @@ class Page {
    * @throws  SlotInUseException  Thrown when given slot is in use.
    */
   void insertRecordInSlot(const SlotId slot_number,
-                          const std::string& record_data);
+                          const RecordView& record_data);
 
   /**
    * Throws an exception if the given record ID is not valid for this page
@@ -329,8 +614,7 @@ class Page {
    * Data stored on the page.  Includes bookkeeping information about slots as
    * well as actual content.
    */
-
-  std::string data_;
+  char data_[DATA_SIZE];
 
   friend class File;
   friend class PageIterator;
@@ -340,7 +624,15 @@ class Page {
 
 static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
+static_assert(sizeof(PageSlot) == 4,
+              "Slots must be packed so that the slot array is dense.");
+static_assert(Page::DATA_SIZE <= 0xFFFF,
+              "Record offsets must fit in a slot.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert(sizeof(Page) == Page::SIZE,
+              "Page must be laid out exactly as it is stored on disk.");
+static_assert(Page::SIZE % Page::ALIGNMENT == 0,
+              "Page size must be a multiple of the frame alignment.");
 
 }
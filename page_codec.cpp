@@ -0,0 +1,141 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_codec.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "page.h"
+
+namespace badgerdb {
+
+namespace {
+
+/**
+ * Zero runs shorter than this are kept as literals, since encoding a run
+ * costs a token.
+ */
+const std::size_t MIN_ZERO_RUN = 8;
+
+/**
+ * Each token is a literal length, the literals and a zero run length.
+ */
+typedef std::uint16_t RunLength;
+
+/**
+ * Longest run a token can hold; longer runs are split across tokens.
+ */
+const std::size_t MAX_RUN = 0xFFFF;
+
+}
+
+const std::uint32_t CompressedPageHeader::MAGIC;
+
+std::size_t compressPage(const char* page, char* out,
+                         const std::size_t capacity) {
+  if (capacity < sizeof(CompressedPageHeader)) {
+    return 0;
+  }
+  std::size_t used = sizeof(CompressedPageHeader);
+  std::size_t position = 0;
+  while (position < Page::SIZE) {
+    // Extend the literal run up to the next zero run long enough to pay off.
+    const std::size_t literal_start = position;
+    std::size_t zero_start = position;
+    std::size_t zero_end = position;
+    while (zero_start < Page::SIZE) {
+      if (page[zero_start] != 0) {
+        ++zero_start;
+        continue;
+      }
+      zero_end = zero_start;
+      while (zero_end < Page::SIZE && page[zero_end] == 0) {
+        ++zero_end;
+      }
+      if (zero_end - zero_start >= MIN_ZERO_RUN || zero_end == Page::SIZE) {
+        break;
+      }
+      zero_start = zero_end;
+    }
+    if (zero_start == Page::SIZE) {
+      zero_end = Page::SIZE;
+    }
+    if (zero_start - literal_start > MAX_RUN) {
+      zero_start = literal_start + MAX_RUN;
+      zero_end = zero_start;
+    }
+    zero_end = std::min(zero_end, zero_start + MAX_RUN);
+
+    const RunLength literals = static_cast<RunLength>(zero_start - literal_start);
+    const RunLength zeros = static_cast<RunLength>(zero_end - zero_start);
+    if (used + 2 * sizeof(RunLength) + literals > capacity) {
+      return 0;
+    }
+    std::memcpy(out + used, &literals, sizeof(literals));
+    used += sizeof(literals);
+    std::memcpy(out + used, page + literal_start, literals);
+    used += literals;
+    std::memcpy(out + used, &zeros, sizeof(zeros));
+    used += sizeof(zeros);
+    position = zero_end;
+  }
+
+  CompressedPageHeader header;
+  header.magic = CompressedPageHeader::MAGIC;
+  header.length = static_cast<std::uint32_t>(used - sizeof(header));
+  std::memcpy(out, &header, sizeof(header));
+  return used;
+}
+
+bool isCompressedPage(const char* stored) {
+  std::uint32_t magic;
+  std::memcpy(&magic, stored, sizeof(magic));
+  return magic == CompressedPageHeader::MAGIC;
+}
+
+bool decompressPage(const char* stored, const std::size_t length, char* page) {
+  CompressedPageHeader header;
+  if (length < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, stored, sizeof(header));
+  if (header.magic != CompressedPageHeader::MAGIC ||
+      header.length > length - sizeof(header)) {
+    return false;
+  }
+
+  const char* in = stored + sizeof(header);
+  const char* const end = in + header.length;
+  std::size_t position = 0;
+  while (in < end) {
+    RunLength literals;
+    RunLength zeros;
+    if (end - in < static_cast<std::ptrdiff_t>(sizeof(literals))) {
+      return false;
+    }
+    std::memcpy(&literals, in, sizeof(literals));
+    in += sizeof(literals);
+    if (end - in < static_cast<std::ptrdiff_t>(literals + sizeof(zeros)) ||
+        position + literals > Page::SIZE) {
+      return false;
+    }
+    std::memcpy(page + position, in, literals);
+    in += literals;
+    position += literals;
+    std::memcpy(&zeros, in, sizeof(zeros));
+    in += sizeof(zeros);
+    if (position + zeros > Page::SIZE) {
+      return false;
+    }
+    std::memset(page + position, 0, zeros);
+    position += zeros;
+  }
+  return position == Page::SIZE;
+}
+
+}
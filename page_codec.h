@@ -0,0 +1,70 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * @brief Header of a compressed page as stored in the page's place in a file.
+ *
+ * The compressed bytes follow the header.  The magic number is chosen so that
+ * its low 16 bits, where an uncompressed page stores its free space lower
+ * bound, exceed any valid bound; a compressed page can therefore always be
+ * told from an uncompressed one.
+ */
+struct CompressedPageHeader {
+  /**
+   * Always MAGIC.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Number of compressed bytes following the header.
+   */
+  std::uint32_t length;
+
+  static const std::uint32_t MAGIC = 0x5A50FFFF;
+};
+
+/**
+ * Compresses a page with a codec suited to slotted pages: the slot array and
+ * records are kept as literal runs and the runs of zero bytes between and
+ * around them, typically most of a sparsely filled page, are replaced by
+ * their length.  The result starts with a CompressedPageHeader.
+ *
+ * @param page      Page of Page::SIZE bytes.
+ * @param out       Receives the compressed page.
+ * @param capacity  Size of <out>; compression fails if the result would not
+ *                  fit.
+ * @return  Length of the compressed page, header included, or 0 if it did not
+ *          fit in <capacity> bytes.
+ */
+std::size_t compressPage(const char* page, char* out,
+                         const std::size_t capacity);
+
+/**
+ * Returns true if the given bytes, read from a page's place in a file, are a
+ * compressed page.
+ */
+bool isCompressedPage(const char* stored);
+
+/**
+ * Decompresses a page produced by compressPage().
+ *
+ * @param stored    Compressed page, header included.
+ * @param length    Number of bytes available at <stored>.
+ * @param page      Receives the Page::SIZE bytes of the page; must not
+ *                  overlap <stored>.
+ * @return  False if the compressed page is malformed.
+ */
+bool decompressPage(const char* stored, const std::size_t length, char* page);
+
+}
@@ -0,0 +1,183 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cassert>
+#include <utility>
+#include "buffer.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Pin on a page in the buffer pool, released when the guard goes out of
+ *        scope.
+ *
+ * Guards are obtained from BufMgr::readPageGuarded(),
+ * BufMgr::writePageGuarded() and BufMgr::allocPageGuarded().  They remember the
+ * frame holding the page, so unpinning needs no hash table lookup.  Guards can
+ * be moved but not copied; a guard that has been moved from or released holds
+ * no page.
+ */
+class PageGuard {
+ public:
+  /**
+   * Unpins the page now rather than when the guard is destroyed.
+   */
+  void release() {
+    if (page_ != NULL) {
+      buf_mgr_->unPinFrame(frame_, dirty_);
+      page_ = NULL;
+    }
+    dirty_ = false;
+  }
+
+  /**
+   * Returns true if the guard holds a page.
+   */
+  bool holdsPage() const { return page_ != NULL; }
+
+  /**
+   * Returns the number of the guarded page.
+   */
+  PageId page_number() const {
+    assert(page_ != NULL);
+    return page_->page_number();
+  }
+
+ protected:
+  PageGuard(BufMgr* buf_mgr, const FrameId frame, Page* page)
+      : buf_mgr_(buf_mgr), frame_(frame), page_(page), dirty_(false) {}
+
+  PageGuard(PageGuard&& other)
+      : buf_mgr_(other.buf_mgr_),
+        frame_(other.frame_),
+        page_(other.page_),
+        dirty_(other.dirty_) {
+    other.page_ = NULL;
+    other.dirty_ = false;
+  }
+
+  ~PageGuard() {
+    release();
+  }
+
+  /**
+   * Releases this guard's page and takes over the page of another guard.
+   */
+  void moveFrom(PageGuard& other) {
+    if (this != &other) {
+      release();
+      buf_mgr_ = other.buf_mgr_;
+      frame_ = other.frame_;
+      page_ = other.page_;
+      dirty_ = other.dirty_;
+      other.page_ = NULL;
+      other.dirty_ = false;
+    }
+  }
+
+  /**
+   * Buffer manager the page is pinned in.
+   */
+  BufMgr* buf_mgr_;
+
+  /**
+   * Frame holding the page.
+   */
+  FrameId frame_;
+
+  /**
+   * The pinned page, or NULL if the guard holds none.
+   */
+  Page* page_;
+
+  /**
+   * Whether the page is to be unpinned as dirty.
+   */
+  bool dirty_;
+
+ private:
+  PageGuard(const PageGuard&);
+  PageGuard& operator=(const PageGuard&);
+};
+
+/**
+ * @brief Guard giving read-only access to a pinned page.
+ */
+class ReadPageGuard : public PageGuard {
+ public:
+  ReadPageGuard(ReadPageGuard&& other) : PageGuard(std::move(other)) {}
+
+  ReadPageGuard& operator=(ReadPageGuard&& other) {
+    moveFrom(other);
+    return *this;
+  }
+
+  /**
+   * Returns the guarded page.
+   */
+  const Page& page() const {
+    assert(page_ != NULL);
+    return *page_;
+  }
+
+  const Page& operator*() const { return page(); }
+  const Page* operator->() const { return &page(); }
+
+ private:
+  ReadPageGuard(BufMgr* buf_mgr, const FrameId frame, Page* page)
+      : PageGuard(buf_mgr, frame, page) {}
+
+  friend class BufMgr;
+};
+
+/**
+ * @brief Guard giving read-write access to a pinned page.  The page is
+ *        unpinned as dirty if it was accessed through a non-const method.
+ */
+class WritePageGuard : public PageGuard {
+ public:
+  WritePageGuard(WritePageGuard&& other) : PageGuard(std::move(other)) {}
+
+  WritePageGuard& operator=(WritePageGuard&& other) {
+    moveFrom(other);
+    return *this;
+  }
+
+  /**
+   * Returns the guarded page for modification and marks it dirty.
+   */
+  Page& page() {
+    assert(page_ != NULL);
+    dirty_ = true;
+    return *page_;
+  }
+
+  /**
+   * Returns the guarded page for reading, without marking it dirty.
+   */
+  const Page& page() const {
+    assert(page_ != NULL);
+    return *page_;
+  }
+
+  Page& operator*() { return page(); }
+  Page* operator->() { return &page(); }
+  const Page& operator*() const { return page(); }
+  const Page* operator->() const { return &page(); }
+
+ private:
+  WritePageGuard(BufMgr* buf_mgr, const FrameId frame, Page* page)
+      : PageGuard(buf_mgr, frame, page) {}
+
+  friend class BufMgr;
+};
+
+}
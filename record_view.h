@@ -0,0 +1,132 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+
+namespace badgerdb {
+
+/**
+ * @brief Non-owning view of the bytes of a record.
+ *
+ * A view refers to memory owned by someone else, typically a record on a
+ * page, and is only valid as long as that memory is: a view of a record on a
+ * buffer pool page must not be used after the page is unpinned or the record
+ * is changed, deleted or moved by an insert that compacts the page.  Use
+ * str() to keep a copy.
+ */
+class RecordView {
+ public:
+  /**
+   * Constructs an empty view.
+   */
+  RecordView()
+      : data_(NULL),
+        length_(0) {
+  }
+
+  /**
+   * Constructs a view of the given bytes.
+   *
+   * @param data    First byte.
+   * @param length  Number of bytes.
+   */
+  RecordView(const char* data, const std::size_t length)
+      : data_(data),
+        length_(length) {
+  }
+
+  /**
+   * Constructs a view of the contents of a string, valid while the string is
+   * not changed.
+   *
+   * @param data  String to view.
+   */
+  RecordView(const std::string& data)
+      : data_(data.data()),
+        length_(data.length()) {
+  }
+
+  /**
+   * Returns the first byte of the record.  The bytes are not null-terminated.
+   */
+  const char* data() const { return data_; }
+
+  /**
+   * Returns the length of the record in bytes.
+   */
+  std::size_t length() const { return length_; }
+  std::size_t size() const { return length_; }
+
+  /**
+   * Returns true if the record has no bytes.
+   */
+  bool empty() const { return length_ == 0; }
+
+  char operator[](const std::size_t i) const { return data_[i]; }
+
+  const char* begin() const { return data_; }
+  const char* end() const { return data_ + length_; }
+
+  /**
+   * Returns a copy of the record.
+   */
+  std::string str() const { return std::string(data_, length_); }
+
+  /**
+   * Compares the bytes of two records as memcmp() would, a shorter record
+   * that is a prefix of the other ordering first.
+   *
+   * @param rhs   Record to compare against.
+   * @return  Negative, zero or positive like memcmp().
+   */
+  int compare(const RecordView& rhs) const {
+    const std::size_t common = std::min(length_, rhs.length_);
+    const int result = common == 0 ? 0 : std::memcmp(data_, rhs.data_, common);
+    if (result != 0) {
+      return result;
+    }
+    return length_ < rhs.length_ ? -1 : (length_ > rhs.length_ ? 1 : 0);
+  }
+
+  /**
+   * Returns true if the record starts with the given bytes.
+   *
+   * @param prefix  Bytes to look for.
+   * @return  Whether the record starts with them.
+   */
+  bool startsWith(const RecordView& prefix) const {
+    return prefix.length_ <= length_ &&
+        (prefix.length_ == 0 ||
+         std::memcmp(data_, prefix.data_, prefix.length_) == 0);
+  }
+
+  bool operator==(const RecordView& rhs) const { return compare(rhs) == 0; }
+  bool operator!=(const RecordView& rhs) const { return compare(rhs) != 0; }
+
+ private:
+  /**
+   * First byte of the record.
+   */
+  const char* data_;
+
+  /**
+   * Length of the record in bytes.
+   */
+  std::size_t length_;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const RecordView& record) {
+  return out.write(record.data(), record.length());
+}
+
+}
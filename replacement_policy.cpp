@@ -0,0 +1,359 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include "buffer.h"
+#include "memory_arena.h"
+#include "replacement_policy.h"
+
+namespace badgerdb {
+
+ReplacementPolicy* ReplacementPolicy::create(const Type type, FrameState* states, const std::uint32_t numFrames,
+                                             const std::uint32_t numPartitions)
+{
+  switch (type) {
+    case LRU_K:
+      return new LRUKPolicy(numFrames);
+    case ARC:
+      return new ARCPolicy(numFrames);
+    case CLOCK:
+    default:
+      return new ClockPolicy(states, numFrames, numPartitions);
+  }
+}
+
+//----------------------------------------
+// CLOCK
+//----------------------------------------
+
+ClockPolicy::ClockPolicy(FrameState* states, const std::uint32_t numFrames, const std::uint32_t numPartitions)
+  : states_(states), numFrames_(numFrames), numPartitions_(numPartitions),
+    clockHands_(new std::atomic<FrameId>[numPartitions])
+{
+  for (std::uint32_t p = 0; p < numPartitions_; p++)
+    clockHands_[p] = partitionStart(p + 1) - partitionStart(p) - 1;
+}
+
+ClockPolicy::~ClockPolicy()
+{
+  delete[] clockHands_;
+}
+
+FrameId ClockPolicy::partitionStart(const std::uint32_t partition) const
+{
+  // Equal shares, with the remainder going to the last partition.
+  return partition == numPartitions_ ? numFrames_ : partition * (numFrames_ / numPartitions_);
+}
+
+FrameId ClockPolicy::advanceClock(const std::uint32_t partition)
+{
+  const FrameId start = partitionStart(partition);
+  const std::uint32_t size = partitionStart(partition + 1) - start;
+  return start + (clockHands_[partition].fetch_add(1) + 1) % size;
+}
+
+void ClockPolicy::loaded(const FrameId frame, const File*, const PageId)
+{
+  states_[frame].set(FrameState::REFERENCED);
+}
+
+void ClockPolicy::accessed(const FrameId frame)
+{
+  states_[frame].set(FrameState::REFERENCED);
+}
+
+void ClockPolicy::removed(const FrameId frame)
+{
+  states_[frame].clear(FrameState::REFERENCED);
+}
+
+bool ClockPolicy::sweep(const std::uint32_t partition, VictimFilter& filter, FrameId& frame)
+{
+  // Frames that cannot be claimed count against the limit; frames that merely lose their reference bit do
+  // not, so the sweep gives up once it has seen every frame pinned or busy.
+  const std::uint32_t size = partitionStart(partition + 1) - partitionStart(partition);
+  std::uint32_t count = 0;
+  while (count <= size) {
+    const FrameId hand = advanceClock(partition);
+    const std::uint32_t state = states_[hand].load();
+    if (state & FrameState::REFERENCED) {
+      states_[hand].clear(FrameState::REFERENCED);
+      continue;
+    }
+    if (!FrameState::evictable(state)) {
+      count++;
+      continue;
+    }
+    if (filter.tryClaim(hand)) {
+      frame = hand;
+      return true;
+    }
+    count++;
+  }
+  return false;
+}
+
+bool ClockPolicy::chooseVictim(VictimFilter& filter, FrameId& frame)
+{
+  if (numPartitions_ == 1)
+    return sweep(0, filter, frame);
+
+  const std::uint32_t home = MemoryArena::currentNode() % numPartitions_;
+  for (std::uint32_t i = 0; i < numPartitions_; i++) {
+    if (sweep((home + i) % numPartitions_, filter, frame))
+      return true;
+  }
+  return false;
+}
+
+void ClockPolicy::upcomingVictims(const std::uint32_t max, std::vector<FrameId>& frames) const
+{
+  // Frames still holding their reference bit survive the next sweep, so they are only listed after the others.
+  for (int referenced = 0; referenced < 2; referenced++) {
+    for (std::uint32_t p = 0; p < numPartitions_; p++) {
+      const FrameId start = partitionStart(p);
+      const std::uint32_t size = partitionStart(p + 1) - start;
+      const FrameId hand = clockHands_[p].load();
+      for (std::uint32_t i = 1; i <= size && frames.size() < max; i++) {
+        const FrameId frame = start + (hand + i) % size;
+        if (states_[frame].referenced() == (referenced != 0))
+          frames.push_back(frame);
+      }
+    }
+  }
+}
+
+void ClockPolicy::printSelf() const
+{
+  std::cout << "Policy:CLOCK";
+  for (std::uint32_t p = 0; p < numPartitions_; p++) {
+    const FrameId start = partitionStart(p);
+    std::cout << " clockHand:" << start + clockHands_[p].load() % (partitionStart(p + 1) - start);
+  }
+  std::cout << "\n";
+}
+
+//----------------------------------------
+// LRU-K
+//----------------------------------------
+
+LRUKPolicy::LRUKPolicy(const std::uint32_t numFrames)
+  : now_(0), history_(numFrames * K, 0), resident_(numFrames, false)
+{
+}
+
+LRUKPolicy::RankKey LRUKPolicy::rankOf(const FrameId frame) const
+{
+  const std::uint64_t* times = &history_[frame * K];
+  return RankKey(std::make_pair(times[K - 1], times[0]), frame);
+}
+
+void LRUKPolicy::touch(const FrameId frame)
+{
+  std::uint64_t* times = &history_[frame * K];
+  for (int i = K - 1; i > 0; i--)
+    times[i] = times[i - 1];
+  times[0] = ++now_;
+}
+
+void LRUKPolicy::loaded(const FrameId frame, const File*, const PageId)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  if (resident_[frame])
+    ranking_.erase(rankOf(frame));
+  std::fill(history_.begin() + frame * K, history_.begin() + (frame + 1) * K, 0);
+  touch(frame);
+  resident_[frame] = true;
+  ranking_.insert(rankOf(frame));
+}
+
+void LRUKPolicy::accessed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  if (!resident_[frame])
+    return;
+  ranking_.erase(rankOf(frame));
+  touch(frame);
+  ranking_.insert(rankOf(frame));
+}
+
+void LRUKPolicy::removed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  if (!resident_[frame])
+    return;
+  ranking_.erase(rankOf(frame));
+  resident_[frame] = false;
+}
+
+bool LRUKPolicy::chooseVictim(VictimFilter& filter, FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  for (std::set<RankKey>::iterator it = ranking_.begin(); it != ranking_.end(); ++it) {
+    if (filter.tryClaim(it->second)) {
+      frame = it->second;
+      resident_[frame] = false;
+      ranking_.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+void LRUKPolicy::upcomingVictims(const std::uint32_t max, std::vector<FrameId>& frames) const
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  for (std::set<RankKey>::const_iterator it = ranking_.begin(); it != ranking_.end() && frames.size() < max; ++it)
+    frames.push_back(it->second);
+}
+
+void LRUKPolicy::printSelf() const
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  std::cout << "Policy:LRU-" << K << " residentFrames:" << ranking_.size() << "\n";
+}
+
+//----------------------------------------
+// ARC
+//----------------------------------------
+
+ARCPolicy::ARCPolicy(const std::uint32_t numFrames)
+  : capacity_(numFrames), target_(0)
+{
+}
+
+void ARCPolicy::moveTo(const Position& from, const ListId to)
+{
+  Entry entry = *from.entry;
+  lists_[from.list].erase(from.entry);
+  lists_[to].push_front(entry);
+
+  Position position = {to, lists_[to].begin()};
+  if (to == T1 || to == T2)
+    frames_[entry.frame] = position;
+  else
+    ghosts_[entry.key] = position;
+}
+
+void ARCPolicy::dropOldestGhost(const ListId list)
+{
+  ghosts_.erase(lists_[list].back().key);
+  lists_[list].pop_back();
+}
+
+void ARCPolicy::trimGhosts()
+{
+  while (!lists_[B1].empty() && lists_[T1].size() + lists_[B1].size() > capacity_)
+    dropOldestGhost(B1);
+  while (!lists_[B2].empty() &&
+         lists_[T1].size() + lists_[T2].size() + lists_[B1].size() + lists_[B2].size() > 2 * capacity_)
+    dropOldestGhost(B2);
+}
+
+void ARCPolicy::loaded(const FrameId frame, const File* file, const PageId pageNo)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  const PageKey key(file, pageNo);
+  Entry entry = {key, frame};
+
+  std::map<FrameId, Position>::iterator stale = frames_.find(frame);
+  if (stale != frames_.end()) {
+    lists_[stale->second.list].erase(stale->second.entry);
+    frames_.erase(stale);
+  }
+
+  std::map<PageKey, Position>::iterator ghost = ghosts_.find(key);
+  if (ghost == ghosts_.end()) {
+    // A page not seen recently starts out in the recency list.
+    lists_[T1].push_front(entry);
+    Position position = {T1, lists_[T1].begin()};
+    frames_[frame] = position;
+    trimGhosts();
+    return;
+  }
+
+  // A hit on a ghost shifts the target towards the list that would have kept the page.
+  const std::uint32_t b1 = lists_[B1].size();
+  const std::uint32_t b2 = lists_[B2].size();
+  if (ghost->second.list == B1)
+    target_ = std::min(capacity_, target_ + std::max<std::uint32_t>(b2 / b1, 1));
+  else
+    target_ = target_ - std::min(target_, std::max<std::uint32_t>(b1 / b2, 1));
+
+  lists_[ghost->second.list].erase(ghost->second.entry);
+  ghosts_.erase(ghost);
+  lists_[T2].push_front(entry);
+  Position position = {T2, lists_[T2].begin()};
+  frames_[frame] = position;
+}
+
+void ARCPolicy::accessed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  std::map<FrameId, Position>::iterator it = frames_.find(frame);
+  if (it != frames_.end())
+    moveTo(it->second, T2);
+}
+
+void ARCPolicy::removed(const FrameId frame)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  std::map<FrameId, Position>::iterator it = frames_.find(frame);
+  if (it == frames_.end())
+    return;
+  lists_[it->second.list].erase(it->second.entry);
+  frames_.erase(it);
+}
+
+bool ARCPolicy::evictFrom(const ListId list, VictimFilter& filter, FrameId& frame)
+{
+  for (List::iterator it = lists_[list].end(); it != lists_[list].begin(); ) {
+    --it;
+    if (!filter.tryClaim(it->frame))
+      continue;
+    frame = it->frame;
+    frames_.erase(frame);
+    Position from = {list, it};
+    moveTo(from, list == T1 ? B1 : B2);
+    trimGhosts();
+    return true;
+  }
+  return false;
+}
+
+bool ARCPolicy::chooseVictim(VictimFilter& filter, FrameId& frame)
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  // Take from T1 while it is above its target, otherwise from T2; fall back to the other list if every frame
+  // in the preferred one is pinned.
+  const bool preferT1 = !lists_[T1].empty() && (lists_[T1].size() > target_ || lists_[T2].empty());
+  if (preferT1)
+    return evictFrom(T1, filter, frame) || evictFrom(T2, filter, frame);
+  return evictFrom(T2, filter, frame) || evictFrom(T1, filter, frame);
+}
+
+void ARCPolicy::upcomingVictims(const std::uint32_t max, std::vector<FrameId>& frames) const
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  const bool preferT1 = !lists_[T1].empty() && (lists_[T1].size() > target_ || lists_[T2].empty());
+  const ListId order[2] = {preferT1 ? T1 : T2, preferT1 ? T2 : T1};
+  for (int i = 0; i < 2; i++) {
+    const List& list = lists_[order[i]];
+    for (List::const_reverse_iterator it = list.rbegin(); it != list.rend() && frames.size() < max; ++it)
+      frames.push_back(it->frame);
+  }
+}
+
+void ARCPolicy::printSelf() const
+{
+  std::lock_guard<std::mutex> guard(latch_);
+  std::cout << "Policy:ARC target:" << target_ << " T1:" << lists_[T1].size() << " T2:" << lists_[T2].size()
+            << " B1:" << lists_[B1].size() << " B2:" << lists_[B2].size() << "\n";
+}
+
+}
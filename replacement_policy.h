@@ -0,0 +1,360 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+
+namespace badgerdb {
+
+class File;
+class FrameState;
+
+/**
+ * @brief Callback through which a replacement policy claims the frame it wants to evict.
+ */
+class VictimFilter {
+ public:
+  virtual ~VictimFilter() {}
+
+  /**
+   * Tries to claim the given frame for eviction.  Only a valid, unpinned frame whose latch is free can be
+   * claimed; on success its latch stays held by the buffer manager.
+   *
+   * @param frame   Frame proposed by the policy
+   * @return  True if the frame was claimed.
+   */
+  virtual bool tryClaim(const FrameId frame) = 0;
+};
+
+/**
+ * @brief Decides which frame the buffer manager evicts when it needs a frame and none is free.
+ *
+ * The buffer manager reports every page loaded into a frame, every access to a resident page and every frame
+ * emptied without eviction (flushed or disposed pages).  When it needs a victim it calls chooseVictim(), which
+ * proposes frames in the policy's order until one can be claimed and then forgets that frame.
+ *
+ * All methods may be called concurrently.  They are called with the affected frame's latch held, except
+ * chooseVictim(), which only ever try-locks latches through the VictimFilter.
+ */
+class ReplacementPolicy {
+ public:
+  /**
+   * Available policies.
+   */
+  enum Type {
+    /**
+     * One-bit second chance clock sweeping the frames in order (the original BufMgr algorithm).
+     */
+    CLOCK,
+
+    /**
+     * LRU-K with K = 2: evicts the page whose second most recent access is oldest, so pages touched only once,
+     * such as those of a large scan, go first.
+     */
+    LRU_K,
+
+    /**
+     * Adaptive Replacement Cache: balances recency and frequency lists, tuning the split from hits on
+     * recently evicted pages.
+     */
+    ARC
+  };
+
+  /**
+   * Creates a policy of the given type.
+   *
+   * @param type        Policy to create
+   * @param states      State words of the buffer pool's frames (used by CLOCK for the reference bits)
+   * @param numFrames   Number of frames in the buffer pool
+   * @param numPartitions Number of NUMA partitions the frames are split into (see BufMgr); CLOCK keeps a hand per
+   *                    partition, the other policies ignore partitions
+   * @return  The new policy, owned by the caller.
+   */
+  static ReplacementPolicy* create(const Type type, FrameState* states, const std::uint32_t numFrames,
+                                   const std::uint32_t numPartitions = 1);
+
+  virtual ~ReplacementPolicy() {}
+
+  /**
+   * Records that the given page was just read into, or allocated in, a frame.
+   */
+  virtual void loaded(const FrameId frame, const File* file, const PageId pageNo) = 0;
+
+  /**
+   * Records an access to the page resident in the given frame.
+   */
+  virtual void accessed(const FrameId frame) = 0;
+
+  /**
+   * Records that the given frame was emptied without being evicted.
+   */
+  virtual void removed(const FrameId frame) = 0;
+
+  /**
+   * Picks a resident frame to evict and claims it through the filter.
+   *
+   * @param filter  Claims a proposed frame for the buffer manager
+   * @param frame   Claimed frame returned via this variable
+   * @return  False if no frame could be claimed.
+   */
+  virtual bool chooseVictim(VictimFilter& filter, FrameId& frame) = 0;
+
+  /**
+   * Lists frames the policy expects to evict soon, most imminent first, without claiming or reordering them.
+   * Used by the background writer to clean frames before they are needed.  The frames may be pinned or busy.
+   *
+   * @param max     Maximum number of frames to list
+   * @param frames  Receives the frames
+   */
+  virtual void upcomingVictims(const std::uint32_t max, std::vector<FrameId>& frames) const = 0;
+
+  /**
+   * Prints the policy's state.
+   */
+  virtual void printSelf() const = 0;
+};
+
+/**
+ * @brief The CLOCK policy: frames are swept in order by a clock hand and the reference bit in each frame's state
+ *        word grants a second chance.
+ *
+ * Lock-free: the hand is advanced atomically and reference bits are atomic, so sweeps from several threads
+ * proceed in parallel.
+ *
+ * When the pool is split into NUMA partitions, each partition has its own hand and a thread looking for a victim
+ * sweeps the partition of the node it runs on first, so frames tend to be reused by threads on the same node.
+ */
+class ClockPolicy : public ReplacementPolicy {
+ public:
+  ClockPolicy(FrameState* states, const std::uint32_t numFrames, const std::uint32_t numPartitions);
+  virtual ~ClockPolicy();
+
+  virtual void loaded(const FrameId frame, const File* file, const PageId pageNo);
+  virtual void accessed(const FrameId frame);
+  virtual void removed(const FrameId frame);
+  virtual bool chooseVictim(VictimFilter& filter, FrameId& frame);
+  virtual void upcomingVictims(const std::uint32_t max, std::vector<FrameId>& frames) const;
+  virtual void printSelf() const;
+
+ private:
+  /**
+   * Advance the clock hand of a partition to its next frame
+   *
+   * @param partition   Partition whose hand to advance
+   * @return  Frame the clock hand now points at
+   */
+  FrameId advanceClock(const std::uint32_t partition);
+
+  /**
+   * Sweeps one partition for a victim.
+   */
+  bool sweep(const std::uint32_t partition, VictimFilter& filter, FrameId& frame);
+
+  /**
+   * Returns the first frame of a partition; partition numPartitions_ gives the end of the last one.
+   */
+  FrameId partitionStart(const std::uint32_t partition) const;
+
+  /**
+   * State words holding the reference bits
+   */
+  FrameState* states_;
+
+  /**
+   * Number of frames in the buffer pool
+   */
+  const std::uint32_t numFrames_;
+
+  /**
+   * Number of partitions, each with its own hand
+   */
+  const std::uint32_t numPartitions_;
+
+  /**
+   * Current position of the clock hand of each partition.  Grows monotonically; the frame it points at is the
+   * value modulo the partition's size, counted from partitionStart().
+   */
+  std::atomic<FrameId>* clockHands_;
+};
+
+/**
+ * @brief The LRU-K policy for K = 2.
+ *
+ * Each resident frame keeps the logical times of its last K accesses.  The victim is the frame whose K-th most
+ * recent access is oldest; frames with fewer than K accesses count as infinitely old and among them the least
+ * recently used goes first.  History is dropped when a page leaves the pool.
+ */
+class LRUKPolicy : public ReplacementPolicy {
+ public:
+  /**
+   * Number of accesses remembered per frame.
+   */
+  static const int K = 2;
+
+  explicit LRUKPolicy(const std::uint32_t numFrames);
+
+  virtual void loaded(const FrameId frame, const File* file, const PageId pageNo);
+  virtual void accessed(const FrameId frame);
+  virtual void removed(const FrameId frame);
+  virtual bool chooseVictim(VictimFilter& filter, FrameId& frame);
+  virtual void upcomingVictims(const std::uint32_t max, std::vector<FrameId>& frames) const;
+  virtual void printSelf() const;
+
+ private:
+  /**
+   * Ordering key of a frame: (K-th most recent access, most recent access, frame); smallest is evicted first
+   */
+  typedef std::pair<std::pair<std::uint64_t, std::uint64_t>, FrameId> RankKey;
+
+  /**
+   * Returns the ordering key of a resident frame.
+   */
+  RankKey rankOf(const FrameId frame) const;
+
+  /**
+   * Appends an access at the current time to a frame's history.  Caller must hold latch_.
+   */
+  void touch(const FrameId frame);
+
+  /**
+   * Latch guarding all members below
+   */
+  mutable std::mutex latch_;
+
+  /**
+   * Logical clock, incremented on every access
+   */
+  std::uint64_t now_;
+
+  /**
+   * Last K access times of each frame, most recent first; 0 means no access
+   */
+  std::vector<std::uint64_t> history_;
+
+  /**
+   * Whether each frame currently holds a page the policy tracks
+   */
+  std::vector<bool> resident_;
+
+  /**
+   * Resident frames in eviction order
+   */
+  std::set<RankKey> ranking_;
+};
+
+/**
+ * @brief The Adaptive Replacement Cache (ARC) policy of Megiddo and Modha.
+ *
+ * Resident pages live in T1 (seen once recently) or T2 (seen at least twice); the ghost lists B1 and B2
+ * remember pages recently evicted from each.  A miss on a page in B1 grows the target size p of T1, a miss on
+ * a page in B2 shrinks it, and victims are taken from T1 while it exceeds p.  One-time scans therefore churn
+ * through T1 without displacing the frequently used pages in T2.
+ */
+class ARCPolicy : public ReplacementPolicy {
+ public:
+  explicit ARCPolicy(const std::uint32_t numFrames);
+
+  virtual void loaded(const FrameId frame, const File* file, const PageId pageNo);
+  virtual void accessed(const FrameId frame);
+  virtual void removed(const FrameId frame);
+  virtual bool chooseVictim(VictimFilter& filter, FrameId& frame);
+  virtual void upcomingVictims(const std::uint32_t max, std::vector<FrameId>& frames) const;
+  virtual void printSelf() const;
+
+ private:
+  /**
+   * Identity of a page, used to recognise pages in the ghost lists
+   */
+  typedef std::pair<const File*, PageId> PageKey;
+
+  /**
+   * Identifiers of the four lists
+   */
+  enum ListId { T1, T2, B1, B2, NUM_LISTS };
+
+  /**
+   * Entry of a list.  For T1/T2 frame is the frame holding the page; ghosts only keep the key.
+   */
+  struct Entry {
+    PageKey key;
+    FrameId frame;
+  };
+
+  typedef std::list<Entry> List;
+
+  /**
+   * Where an entry lives
+   */
+  struct Position {
+    ListId list;
+    List::iterator entry;
+  };
+
+  /**
+   * Moves an entry to the most recently used end of a list.  Caller must hold latch_.
+   */
+  void moveTo(const Position& from, const ListId to);
+
+  /**
+   * Drops least recently used ghosts until |T1| + |B1| <= c and the total is at most 2c.  Caller must hold
+   * latch_.
+   */
+  void trimGhosts();
+
+  /**
+   * Drops the least recently used ghost of a list.  Caller must hold latch_.
+   */
+  void dropOldestGhost(const ListId list);
+
+  /**
+   * Tries to claim a victim from a resident list, starting at its least recently used end, and turns it into a
+   * ghost.  Caller must hold latch_.
+   */
+  bool evictFrom(const ListId list, VictimFilter& filter, FrameId& frame);
+
+  /**
+   * Latch guarding all members below
+   */
+  mutable std::mutex latch_;
+
+  /**
+   * Cache size c in frames
+   */
+  const std::uint32_t capacity_;
+
+  /**
+   * Target size of T1
+   */
+  std::uint32_t target_;
+
+  /**
+   * T1, T2, B1 and B2, most recently used at the front
+   */
+  List lists_[NUM_LISTS];
+
+  /**
+   * Positions of resident pages by frame
+   */
+  std::map<FrameId, Position> frames_;
+
+  /**
+   * Positions of ghost pages by key
+   */
+  std::map<PageKey, Position> ghosts_;
+};
+
+}
@@ -0,0 +1,443 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+/**
+ * Replays a buffer pool trace recorded by BufMgr::startTrace() against other
+ * pool sizes and replacement policies, and prints the hit ratio of each, as a
+ * guide to sizing the pool for the traced workload.
+ *
+ * The LRU column is the exact miss ratio curve of an LRU pool, computed for
+ * all sizes at once in a single pass from the stack distances of the accesses
+ * (Mattson et al., 1970).  It ignores pins.  The other columns simulate the
+ * buffer manager's policies, pins included: a mark means that the pool ran out
+ * of unpinned frames, where BufMgr would have thrown BufferExceededException,
+ * and those accesses were skipped.
+ *
+ * Only the page accesses are replayed; the pool's own writes and the files
+ * themselves are not needed.
+ *
+ * Usage: trace_replay TRACE [--sizes=N,N,...] [--policies=clock,lru-k,arc]
+ * Sizes default to powers of two up to the number of distinct pages.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "buf_trace.h"
+#include "buffer.h"
+#include "replacement_policy.h"
+#include "exceptions/file_io_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Identifies a page across the files of a trace.
+ */
+std::uint64_t pageKey(const TraceEvent& event) {
+  return static_cast<std::uint64_t>(event.file) << 32 | event.page_number;
+}
+
+/**
+ * @brief Computes LRU hit ratios for every pool size in one pass over the
+ *        accesses.
+ *
+ * The stack distance of an access is the number of distinct pages used since
+ * the previous access to the same page; an LRU pool of n frames hits exactly
+ * the accesses at distances below n.  Distances are found with a Fenwick tree
+ * over the time of each access, in which only the most recent access to every
+ * page is marked, so each access costs O(log accesses).
+ */
+class StackDistances {
+ public:
+  explicit StackDistances(const std::size_t maxAccesses)
+      : tree_(maxAccesses + 1, 0), now_(0), pins_(0) {}
+
+  /**
+   * Records an access to a page.  Only pins count towards the hit ratio; an
+   * allocated page is not read, but it is put on top of the stack.
+   */
+  void access(const std::uint64_t key, const bool counted) {
+    const std::size_t time = ++now_;
+    std::unordered_map<std::uint64_t, std::size_t>::iterator last =
+        last_.find(key);
+    if (last != last_.end()) {
+      const std::size_t distance = sum(time - 1) - sum(last->second);
+      if (counted) {
+        if (distance >= distances_.size()) {
+          distances_.resize(distance + 1, 0);
+        }
+        ++distances_[distance];
+      }
+      add(last->second, -1);
+      last->second = time;
+    } else {
+      last_[key] = time;
+    }
+    add(time, 1);
+    pins_ += counted;
+  }
+
+  /**
+   * Records that a page was deleted, which takes it off the stack.
+   */
+  void remove(const std::uint64_t key) {
+    std::unordered_map<std::uint64_t, std::size_t>::iterator last =
+        last_.find(key);
+    if (last != last_.end()) {
+      add(last->second, -1);
+      last_.erase(last);
+    }
+  }
+
+  /**
+   * Returns the hit ratio of an LRU pool of the given size.
+   */
+  double hitRatio(const std::size_t frames) const {
+    std::uint64_t hits = 0;
+    for (std::size_t d = 0; d < frames && d < distances_.size(); ++d) {
+      hits += distances_[d];
+    }
+    return pins_ == 0 ? 0 : static_cast<double>(hits) / pins_;
+  }
+
+ private:
+  /**
+   * Adds to the mark of a time.
+   */
+  void add(std::size_t time, const int delta) {
+    for (; time < tree_.size(); time += time & -time) {
+      tree_[time] += delta;
+    }
+  }
+
+  /**
+   * Returns the number of marks at or before a time.
+   */
+  std::size_t sum(std::size_t time) const {
+    std::size_t marks = 0;
+    for (; time > 0; time -= time & -time) {
+      marks += tree_[time];
+    }
+    return marks;
+  }
+
+  std::vector<std::int32_t> tree_;
+  std::size_t now_;
+  std::uint64_t pins_;
+  std::unordered_map<std::uint64_t, std::size_t> last_;
+
+  /**
+   * Number of counted accesses at each stack distance.
+   */
+  std::vector<std::uint64_t> distances_;
+};
+
+/**
+ * @brief Simulates which pages a pool of a given size and replacement policy
+ *        holds, the way BufMgr manages its frames, without any page contents.
+ */
+class PoolSimulator {
+ public:
+  PoolSimulator(const std::uint32_t frames, const ReplacementPolicy::Type type)
+      : states_(new FrameState[frames]),
+        policy_(ReplacementPolicy::create(type, states_, frames)),
+        frameKeys_(frames),
+        hits_(0),
+        misses_(0),
+        exceeded_(0) {
+    for (FrameId f = frames; f > 0; --f) {
+      free_.push_back(f - 1);
+    }
+    // Policies only compare file pointers, so any distinct address per file
+    // number does.
+    fileTokens_.resize(1 << 16);
+  }
+
+  ~PoolSimulator() {
+    delete policy_;
+    delete[] states_;
+  }
+
+  void replay(const TraceEvent& event) {
+    const std::uint64_t key = pageKey(event);
+    std::unordered_map<std::uint64_t, FrameId>::iterator resident =
+        resident_.find(key);
+    switch (event.type) {
+      case TRACE_PIN:
+        if (resident != resident_.end()) {
+          ++hits_;
+          states_[resident->second].pin();
+          policy_->accessed(resident->second);
+        } else {
+          ++misses_;
+          load(event, key);
+        }
+        break;
+      case TRACE_ALLOC:
+        if (resident == resident_.end()) {
+          load(event, key);
+        }
+        break;
+      case TRACE_UNPIN:
+        if (resident != resident_.end() &&
+            states_[resident->second].pinCnt() > 0) {
+          states_[resident->second].unpin();
+        }
+        break;
+      case TRACE_DISPOSE:
+        if (resident != resident_.end()) {
+          const FrameId frame = resident->second;
+          resident_.erase(resident);
+          states_[frame].reset(0);
+          policy_->removed(frame);
+          free_.push_back(frame);
+        }
+        break;
+    }
+  }
+
+  double hitRatio() const {
+    return hits_ + misses_ == 0
+               ? 0
+               : static_cast<double>(hits_) / (hits_ + misses_);
+  }
+
+  /**
+   * Returns the number of pages that found no unpinned frame.
+   */
+  std::uint64_t exceeded() const { return exceeded_; }
+
+ private:
+  /**
+   * Claims a proposed victim if it is evictable, as BufMgr does.
+   */
+  class Claimer : public VictimFilter {
+   public:
+    explicit Claimer(FrameState* states) : states_(states) {}
+
+    virtual bool tryClaim(const FrameId frame) {
+      return FrameState::evictable(states_[frame].load());
+    }
+
+   private:
+    FrameState* states_;
+  };
+
+  /**
+   * Puts a page into a free or evicted frame, pinned once.
+   */
+  void load(const TraceEvent& event, const std::uint64_t key) {
+    FrameId frame;
+    if (!free_.empty()) {
+      frame = free_.back();
+      free_.pop_back();
+    } else {
+      Claimer claimer(states_);
+      if (!policy_->chooseVictim(claimer, frame)) {
+        ++exceeded_;
+        return;
+      }
+      resident_.erase(frameKeys_[frame]);
+    }
+    resident_[key] = frame;
+    frameKeys_[frame] = key;
+    states_[frame].reset(FrameState::VALID | FrameState::REFERENCED | 1);
+    policy_->loaded(frame,
+                    reinterpret_cast<const File*>(&fileTokens_[event.file]),
+                    event.page_number);
+  }
+
+  FrameState* states_;
+  ReplacementPolicy* policy_;
+  std::vector<FrameId> free_;
+  std::unordered_map<std::uint64_t, FrameId> resident_;
+  std::vector<std::uint64_t> frameKeys_;
+  std::vector<char> fileTokens_;
+  std::uint64_t hits_;
+  std::uint64_t misses_;
+  std::uint64_t exceeded_;
+
+  /**
+   * Disallow copying.
+   */
+  PoolSimulator(const PoolSimulator&);
+  PoolSimulator& operator=(const PoolSimulator&);
+};
+
+struct PolicyName {
+  const char* name;
+  ReplacementPolicy::Type type;
+};
+
+const PolicyName POLICIES[] = {{"clock", ReplacementPolicy::CLOCK},
+                               {"lru-k", ReplacementPolicy::LRU_K},
+                               {"arc", ReplacementPolicy::ARC}};
+
+/**
+ * Splits a comma-separated list.
+ */
+std::vector<std::string> splitList(const std::string& list) {
+  std::vector<std::string> items;
+  std::size_t start = 0;
+  for (;;) {
+    const std::size_t comma = list.find(',', start);
+    items.push_back(list.substr(start, comma - start));
+    if (comma == std::string::npos) {
+      return items;
+    }
+    start = comma + 1;
+  }
+}
+
+int usage() {
+  std::cerr << "Usage: trace_replay TRACE [--sizes=N,N,...] "
+               "[--policies=clock,lru-k,arc]\n";
+  return 2;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+  std::string trace_name;
+  std::vector<std::uint32_t> sizes;
+  std::vector<PolicyName> policies(POLICIES, POLICIES + 3);
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--sizes=", 8) == 0) {
+      const std::vector<std::string> items = splitList(argv[i] + 8);
+      for (std::size_t s = 0; s < items.size(); ++s) {
+        const long size = std::atol(items[s].c_str());
+        if (size <= 0) {
+          return usage();
+        }
+        sizes.push_back(static_cast<std::uint32_t>(size));
+      }
+    } else if (std::strncmp(argv[i], "--policies=", 11) == 0) {
+      const std::vector<std::string> items = splitList(argv[i] + 11);
+      policies.clear();
+      for (std::size_t p = 0; p < items.size(); ++p) {
+        std::size_t known = 0;
+        while (known < 3 && items[p] != POLICIES[known].name) {
+          ++known;
+        }
+        if (known == 3) {
+          return usage();
+        }
+        policies.push_back(POLICIES[known]);
+      }
+    } else if (trace_name.empty() && argv[i][0] != '-') {
+      trace_name = argv[i];
+    } else {
+      return usage();
+    }
+  }
+  if (trace_name.empty()) {
+    return usage();
+  }
+
+  // Load the trace; at eight bytes an event it is replayed from memory.
+  std::vector<TraceEvent> events;
+  std::size_t files = 0;
+  std::uint64_t pins = 0, traced_hits = 0, unpins = 0, allocs = 0,
+                disposals = 0, overflowed = 0;
+  try {
+    TraceReader reader(trace_name);
+    TraceEvent event;
+    while (reader.next(event)) {
+      events.push_back(event);
+      pins += event.type == TRACE_PIN;
+      traced_hits += event.type == TRACE_PIN && (event.flags & TRACE_HIT);
+      unpins += event.type == TRACE_UNPIN;
+      allocs += event.type == TRACE_ALLOC;
+      disposals += event.type == TRACE_DISPOSE;
+      overflowed += event.file == TraceEvent::OVERFLOW_FILE;
+    }
+    files = reader.numFiles();
+  } catch (const FileIOException& e) {
+    std::cerr << e.message() << "\n";
+    return 1;
+  }
+
+  StackDistances distances(pins + allocs);
+  std::unordered_set<std::uint64_t> pages;
+  std::int64_t pinned = 0, peak_pinned = 0;
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    const TraceEvent& event = events[i];
+    switch (event.type) {
+      case TRACE_PIN:
+      case TRACE_ALLOC:
+        distances.access(pageKey(event), event.type == TRACE_PIN);
+        pages.insert(pageKey(event));
+        peak_pinned = std::max(peak_pinned, ++pinned);
+        break;
+      case TRACE_UNPIN:
+        --pinned;
+        break;
+      case TRACE_DISPOSE:
+        distances.remove(pageKey(event));
+        break;
+    }
+  }
+
+  if (sizes.empty()) {
+    std::uint64_t size = 8;
+    for (; size < pages.size(); size *= 2) {
+      sizes.push_back(static_cast<std::uint32_t>(size));
+    }
+    sizes.push_back(static_cast<std::uint32_t>(std::max<std::uint64_t>(
+        pages.size(), 1)));
+  }
+
+  std::printf("%zu events: %llu pins (%.2f%% hits when traced), %llu unpins, "
+              "%llu allocations, %llu disposals\n",
+              events.size(), static_cast<unsigned long long>(pins),
+              pins == 0 ? 0.0 : 100.0 * traced_hits / pins,
+              static_cast<unsigned long long>(unpins),
+              static_cast<unsigned long long>(allocs),
+              static_cast<unsigned long long>(disposals));
+  std::printf("%zu files, %zu distinct pages, at most %lld pinned at once\n",
+              files, pages.size(), static_cast<long long>(peak_pinned));
+  if (overflowed > 0) {
+    std::printf("%llu events of files beyond the last file number, replayed "
+                "as one file\n",
+                static_cast<unsigned long long>(overflowed));
+  }
+  std::printf("\n");
+
+  std::printf("%10s %9s ", "frames", "lru");
+  for (std::size_t p = 0; p < policies.size(); ++p) {
+    std::printf(" %9s ", policies[p].name);
+  }
+  std::printf("\n");
+  bool any_exceeded = false;
+  for (std::size_t s = 0; s < sizes.size(); ++s) {
+    std::printf("%10u %8.2f%% ", sizes[s], 100 * distances.hitRatio(sizes[s]));
+    for (std::size_t p = 0; p < policies.size(); ++p) {
+      PoolSimulator pool(sizes[s], policies[p].type);
+      for (std::size_t i = 0; i < events.size(); ++i) {
+        pool.replay(events[i]);
+      }
+      const bool exceeded = pool.exceeded() > 0;
+      any_exceeded = any_exceeded || exceeded;
+      std::printf(" %8.2f%%%s", 100 * pool.hitRatio(), exceeded ? "*" : " ");
+    }
+    std::printf("\n");
+  }
+  if (any_exceeded) {
+    std::printf("\n* ran out of unpinned frames; those accesses were skipped\n");
+  }
+  return 0;
+}